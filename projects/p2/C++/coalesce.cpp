@@ -0,0 +1,324 @@
+/*
+ * File: coalesce.cpp
+ *
+ * Description:
+ *   Load/store coalescing. Code that unpacks or updates neighbouring
+ *   narrow fields (bit-slice code, codec state structs) issues one byte,
+ *   short or int access per field. Within a block, simple integer loads
+ *   from the same base pointer at constant offsets that exactly tile 2, 4
+ *   or 8 bytes become one wide load plus a shift and truncate per field.
+ *   Stores that tile the same way become zext/shl/or and one wide store.
+ *
+ *   The wide load replaces the group at its first member, so nothing in
+ *   between may write the bytes. The wide store goes at the last member,
+ *   so nothing in between may read or write them. Another access off the
+ *   same base is compared by offset. Two different identified objects
+ *   (allocas, globals) cannot overlap. An alloca whose address is never
+ *   captured cannot overlap a pointer that comes from somewhere it could
+ *   not have reached either: another identified object, an argument, or
+ *   the result of a load or call. A pointer whose underlying object is
+ *   not found (a select or phi of pointers) may still be the alloca.
+ *   Anything else, including calls, is assumed to alias.
+ */
+#include <algorithm>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "coalesce.h"
+
+using namespace llvm;
+
+static llvm::Statistic CoalesceLoadGroups = {"", "CoalesceLoadGroups", "Coalescing load groups merged"};
+static llvm::Statistic CoalesceStoreGroups = {"", "CoalesceStoreGroups", "Coalescing store groups merged"};
+static llvm::Statistic CoalesceRemoved = {"", "CoalesceRemoved", "Coalescing memory operations removed"};
+
+// widest access the pass creates, in bytes
+static const unsigned CoalesceMaxBytes = 8;
+
+struct Access {
+    Instruction *I;
+    Value *Base;      // pointer with the constant offsets stripped
+    int64_t Offset;   // bytes from Base
+    unsigned Size;    // bytes accessed
+    unsigned Order;   // position in the block
+};
+
+static bool describe(Instruction *I, const DataLayout &DL, Access &A)
+{
+    Value *Ptr;
+    Type *Ty;
+    if (auto *LI = dyn_cast<LoadInst>(I)) {
+        if (!LI->isSimple())
+            return false;
+        Ptr = LI->getPointerOperand();
+        Ty = LI->getType();
+    } else if (auto *SI = dyn_cast<StoreInst>(I)) {
+        if (!SI->isSimple())
+            return false;
+        Ptr = SI->getPointerOperand();
+        Ty = SI->getValueOperand()->getType();
+    } else {
+        return false;
+    }
+
+    APInt Off(DL.getIndexTypeSizeInBits(Ptr->getType()), 0);
+    A.I = I;
+    A.Base = Ptr->stripAndAccumulateConstantOffsets(DL, Off, true);
+    A.Offset = Off.getSExtValue();
+    A.Size = DL.getTypeStoreSize(Ty);
+    return true;
+}
+
+static bool isUncapturedLocal(const Value *V)
+{
+    return isa<AllocaInst>(V) && !PointerMayBeCaptured(V, true, true);
+}
+
+// a pointer that cannot be derived from an alloca whose address never escapes
+static bool isEscapeSource(const Value *V)
+{
+    return isIdentifiedObject(V) || isa<Argument>(V) || isa<LoadInst>(V) || isa<CallBase>(V);
+}
+
+//***********************Function mayTouch*********************************//
+// true if I might access [Offset, Offset+Size) off Base
+//*************************************************************************//
+
+static bool mayTouch(Instruction *I, Value *Base, int64_t Offset, unsigned Size,
+                     const DataLayout &DL)
+{
+    Access A;
+    if (!describe(I, DL, A))
+        return true;
+    if (A.Base == Base)
+        return A.Offset < Offset + (int64_t)Size && Offset < A.Offset + (int64_t)A.Size;
+
+    const Value *U1 = getUnderlyingObject(A.Base);
+    const Value *U2 = getUnderlyingObject(Base);
+    if (U1 == U2)
+        return true;
+    if (isIdentifiedObject(U1) && isIdentifiedObject(U2))
+        return false;
+    // A local whose address never escapes cannot be reached from a pointer
+    // made elsewhere; a select or phi may still pick the local itself.
+    if (isUncapturedLocal(U1) && isEscapeSource(U2))
+        return false;
+    if (isUncapturedLocal(U2) && isEscapeSource(U1))
+        return false;
+    return true;
+}
+
+static bool isCandidate(Instruction *I)
+{
+    Type *Ty = isa<LoadInst>(I) ? I->getType() : cast<StoreInst>(I)->getValueOperand()->getType();
+    auto *IT = dyn_cast<IntegerType>(Ty);
+    return IT && IT->getBitWidth() % 8 == 0 && IT->getBitWidth() < CoalesceMaxBytes * 8;
+}
+
+//***********************Function clobbered********************************//
+// true if an instruction between the group's first and last member (in
+// block order) that is not a member may interfere
+//*************************************************************************//
+
+static bool clobbered(std::vector<Access *> &group, bool loads, const DataLayout &DL)
+{
+    unsigned first = group[0]->Order, last = group[0]->Order;
+    for (Access *A : group) {
+        first = std::min(first, A->Order);
+        last = std::max(last, A->Order);
+    }
+    int64_t lo = group.front()->Offset;
+    unsigned size = group.back()->Offset + group.back()->Size - lo;
+
+    Instruction *I = nullptr;
+    for (Access *A : group)
+        if (A->Order == first)
+            I = A->I;
+    for (unsigned pos = first; pos < last; pos++, I = I->getNextNode()) {
+        bool member = false;
+        for (Access *A : group)
+            if (A->I == I)
+                member = true;
+        if (member)
+            continue;
+        bool interferes = loads ? I->mayWriteToMemory() : I->mayReadOrWriteMemory();
+        if (interferes && mayTouch(I, group[0]->Base, lo, size, DL))
+            return true;
+    }
+    return false;
+}
+
+static unsigned shiftFor(Access *A, int64_t lo, unsigned total, const DataLayout &DL)
+{
+    unsigned byte = A->Offset - lo;
+    if (DL.isBigEndian())
+        byte = total - byte - A->Size;
+    return byte * 8;
+}
+
+static Value *widePointer(IRBuilder<> &B, Access *Lowest, Type *WideTy, Instruction *At)
+{
+    Value *Ptr = getLoadStorePointerOperand(Lowest->I);
+    unsigned AS = Ptr->getType()->getPointerAddressSpace();
+    auto *PtrI = dyn_cast<Instruction>(Ptr);
+    if (PtrI && PtrI->getParent() == At->getParent() && !PtrI->comesBefore(At)) {
+        // The lowest member's address is computed after the insertion
+        // point; rebuild it from the base, which comes first.
+        Value *Base = B.CreateBitCast(Lowest->Base, B.getInt8PtrTy(AS));
+        Ptr = B.CreateInBoundsGEP(B.getInt8Ty(), Base, B.getInt64(Lowest->Offset));
+    }
+    return B.CreateBitCast(Ptr, WideTy->getPointerTo(AS));
+}
+
+static void mergeLoads(std::vector<Access *> &group, unsigned total, const DataLayout &DL)
+{
+    Access *Lowest = group.front();
+    Access *Earliest = group.front();
+    for (Access *A : group)
+        if (A->Order < Earliest->Order)
+            Earliest = A;
+
+    IRBuilder<> B(Earliest->I);
+    Type *WideTy = B.getIntNTy(total * 8);
+    Value *Ptr = widePointer(B, Lowest, WideTy, Earliest->I);
+    LoadInst *Wide = B.CreateAlignedLoad(WideTy, Ptr, cast<LoadInst>(Lowest->I)->getAlign(),
+                                         "coalesced");
+    for (Access *A : group) {
+        Value *V = Wide;
+        if (unsigned shift = shiftFor(A, Lowest->Offset, total, DL))
+            V = B.CreateLShr(V, shift);
+        V = B.CreateTrunc(V, A->I->getType());
+        V->takeName(A->I);
+        A->I->replaceAllUsesWith(V);
+    }
+    for (Access *A : group)
+        A->I->eraseFromParent();
+    CoalesceLoadGroups++;
+    CoalesceRemoved += group.size() - 1;
+}
+
+static void mergeStores(std::vector<Access *> &group, unsigned total, const DataLayout &DL)
+{
+    Access *Lowest = group.front();
+    Access *Latest = group.front();
+    for (Access *A : group)
+        if (A->Order > Latest->Order)
+            Latest = A;
+
+    IRBuilder<> B(Latest->I);
+    Type *WideTy = B.getIntNTy(total * 8);
+    Value *Wide = nullptr;
+    for (Access *A : group) {
+        Value *V = B.CreateZExt(cast<StoreInst>(A->I)->getValueOperand(), WideTy);
+        if (unsigned shift = shiftFor(A, Lowest->Offset, total, DL))
+            V = B.CreateShl(V, shift);
+        if (!Wide)
+            Wide = V;
+        else if (!isa<Constant>(V) || !cast<Constant>(V)->isNullValue())
+            Wide = B.CreateOr(Wide, V);
+    }
+    Value *Ptr = widePointer(B, Lowest, WideTy, Latest->I);
+    B.CreateAlignedStore(Wide, Ptr, cast<StoreInst>(Lowest->I)->getAlign());
+    for (Access *A : group)
+        A->I->eraseFromParent();
+    CoalesceStoreGroups++;
+    CoalesceRemoved += group.size() - 1;
+}
+
+//***********************Function coalesceBlock****************************//
+// group the block's loads (or stores) by base, walk each base's accesses
+// in offset order and merge the longest contiguous run from each start
+// whose size is a power of two
+//*************************************************************************//
+
+static bool coalesceBlock(BasicBlock &BB, bool loads, const DataLayout &DL)
+{
+    std::vector<Access> accesses;
+    unsigned order = 0;
+    for (Instruction &I : BB) {
+        Access A;
+        if ((loads ? isa<LoadInst>(&I) : isa<StoreInst>(&I)) && isCandidate(&I) &&
+            describe(&I, DL, A)) {
+            A.Order = order;
+            accesses.push_back(A);
+        }
+        order++;
+    }
+    // Bases in order of first appearance keep the output deterministic.
+    DenseMap<Value *, unsigned> rank;
+    std::vector<Access *> sorted;
+    for (Access &A : accesses) {
+        rank.insert(std::make_pair(A.Base, rank.size()));
+        sorted.push_back(&A);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [&](Access *a, Access *b) {
+        if (a->Base != b->Base)
+            return rank[a->Base] < rank[b->Base];
+        return a->Offset < b->Offset;
+    });
+
+    std::vector<std::pair<std::vector<Access *>, unsigned>> merges;
+    std::vector<bool> used(sorted.size(), false);
+    for (unsigned s = 0; s < sorted.size(); s++) {
+        if (used[s])
+            continue;
+        std::vector<Access *> run;
+        std::vector<unsigned> runIdx;
+        int64_t end = sorted[s]->Offset;
+        for (unsigned j = s; j < sorted.size() && sorted[j]->Base == sorted[s]->Base; j++) {
+            if (used[j] || sorted[j]->Offset != end)
+                continue;
+            if (end + sorted[j]->Size - sorted[s]->Offset > CoalesceMaxBytes)
+                break;
+            run.push_back(sorted[j]);
+            runIdx.push_back(j);
+            end += sorted[j]->Size;
+        }
+
+        // Longest prefix with at least two members that tiles a legal width.
+        while (run.size() >= 2) {
+            unsigned total = run.back()->Offset + run.back()->Size - run.front()->Offset;
+            if (isPowerOf2_32(total) && !clobbered(run, loads, DL))
+                break;
+            run.pop_back();
+            runIdx.pop_back();
+        }
+        if (run.size() < 2)
+            continue;
+        for (unsigned j : runIdx)
+            used[j] = true;
+        unsigned total = run.back()->Offset + run.back()->Size - run.front()->Offset;
+        merges.push_back(std::make_pair(run, total));
+    }
+
+    for (auto &m : merges) {
+        if (loads)
+            mergeLoads(m.first, m.second, DL);
+        else
+            mergeStores(m.first, m.second, DL);
+    }
+    return !merges.empty();
+}
+
+void CoalesceMemoryAccesses(Module *M)
+{
+    const DataLayout &DL = M->getDataLayout();
+    for (auto f = M->begin(); f != M->end(); f++)
+        for (BasicBlock &BB : *f) {
+            // A merge moves accesses, so positions are recomputed after
+            // each round.
+            while (coalesceBlock(BB, true, DL))
+                ;
+            while (coalesceBlock(BB, false, DL))
+                ;
+        }
+}
@@ -0,0 +1,10 @@
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include "llvm/IR/Module.h"
+
+/* Merge adjacent narrow integer loads (or stores) off one base pointer in
+   a block into a single wide access plus shifts and masks. */
+void CoalesceMemoryAccesses(llvm::Module *M);
+
+#endif
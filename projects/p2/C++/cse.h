@@ -0,0 +1,10 @@
+#ifndef CSE_H
+#define CSE_H
+
+#include "llvm/IR/Function.h"
+
+/* Run the p2 CSE scan over a single function. Later passes call this to
+   clean up a function after they have rewritten it. */
+void CommonSubexpressionElimination(llvm::Function *F);
+
+#endif
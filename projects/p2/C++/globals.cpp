@@ -0,0 +1,308 @@
+/*
+ * File: globals.cpp
+ *
+ * Description:
+ *   Global-to-local promotion and constant-global folding. Every access
+ *   to a global is a memory operation that CSE has to treat as clobbered
+ *   by any store or call, so this pass removes as many of them as it can:
+ *
+ *   - globals that are only ever read are marked constant and loads at
+ *     constant addresses are replaced by the initializer's value,
+ *   - scalars stored exactly once, with a constant, at the top of main
+ *     become constants holding that value,
+ *   - scalars only touched by one non-recursive function become allocas
+ *     in that function and are promoted to SSA values.
+ *
+ *   wolfbench links a whole program into one module before the custom tool
+ *   runs, so when the module defines main, external globals are treated
+ *   like internal ones. Otherwise only local globals are touched.
+ */
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+
+#include "globals.h"
+
+using namespace llvm;
+
+static llvm::Statistic GlobalsConstant = {"", "GlobalsConstant", "Globals marked constant"};
+static llvm::Statistic GlobalsFolded = {"", "GlobalsFolded", "Global loads folded to constants"};
+static llvm::Statistic GlobalsWriteOnce = {"", "GlobalsWriteOnce", "Write-once globals frozen after initialization"};
+static llvm::Statistic GlobalsLocalized = {"", "GlobalsLocalized", "Globals promoted to locals"};
+static llvm::Statistic GlobalsRemoved = {"", "GlobalsRemoved", "Globals removed after folding"};
+
+static bool isOptimizable(GlobalVariable *G, bool wholeProgram)
+{
+    if (G->isConstant() || !G->hasDefinitiveInitializer() ||
+        G->isThreadLocal() || G->isExternallyInitialized())
+        return false;
+    return G->hasLocalLinkage() || wholeProgram;
+}
+
+//***********************Function isOnlyRead*******************************//
+// true if every use of V (a global or an address derived from it) only
+// reads memory: loads, address arithmetic and pointer compares
+//*************************************************************************//
+
+static bool isOnlyRead(Value *V)
+{
+    for (User *U : V->users()) {
+        if (auto *LI = dyn_cast<LoadInst>(U)) {
+            if (LI->isVolatile())
+                return false;
+        } else if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U)) {
+            if (!isOnlyRead(U))
+                return false;
+        } else if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+            if (CE->getOpcode() != Instruction::GetElementPtr &&
+                CE->getOpcode() != Instruction::BitCast)
+                return false;
+            if (!isOnlyRead(CE))
+                return false;
+        } else if (!isa<ICmpInst>(U)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//***********************Function foldConstantLoads************************//
+// replace loads whose address is G or a constant expression on top of G
+// with the value the (now constant) initializer holds there
+//*************************************************************************//
+
+static void foldConstantLoads(Constant *Ptr, const DataLayout &DL)
+{
+    std::vector<User *> users(Ptr->user_begin(), Ptr->user_end());
+    for (User *U : users) {
+        if (auto *LI = dyn_cast<LoadInst>(U)) {
+            if (Constant *C = ConstantFoldLoadFromConstPtr(Ptr, LI->getType(), DL)) {
+                LI->replaceAllUsesWith(C);
+                LI->eraseFromParent();
+                GlobalsFolded++;
+            }
+        } else if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+            foldConstantLoads(CE, DL);
+        }
+    }
+}
+
+//***********************Function isWriteOnce******************************//
+// a scalar whose only store puts a constant into it at the top of main,
+// before anything in main could have looked at it; returns that store
+//*************************************************************************//
+
+static StoreInst *isWriteOnce(GlobalVariable *G, Function *Main)
+{
+    if (!Main || !Main->use_empty() || !G->getValueType()->isSingleValueType())
+        return nullptr;
+
+    StoreInst *only = nullptr;
+    for (User *U : G->users()) {
+        if (auto *LI = dyn_cast<LoadInst>(U)) {
+            if (LI->isVolatile() || LI->getType() != G->getValueType())
+                return nullptr;
+        } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+            if (only || SI->isVolatile() || SI->getPointerOperand() != G ||
+                !isa<Constant>(SI->getValueOperand()))
+                return nullptr;
+            only = SI;
+        } else {
+            return nullptr;
+        }
+    }
+    if (!only || only->getFunction() != Main ||
+        only->getParent() != &Main->getEntryBlock())
+        return nullptr;
+
+    // Nothing ahead of the store in main's entry block may read G.
+    for (Instruction &I : Main->getEntryBlock()) {
+        if (&I == only)
+            return only;
+        if (isa<CallBase>(&I) || (isa<LoadInst>(&I) && I.getOperand(0) == G))
+            return nullptr;
+    }
+    return nullptr;
+}
+
+//***********************Function singleUserFunction***********************//
+// the one function whose loads/stores are the only uses of G, or null if
+// G is used in any other way (address taken, aggregate access, ...)
+//*************************************************************************//
+
+static Function *singleUserFunction(GlobalVariable *G)
+{
+    if (!G->getValueType()->isSingleValueType())
+        return nullptr;
+
+    Function *F = nullptr;
+    for (User *U : G->users()) {
+        Instruction *I = dyn_cast<Instruction>(U);
+        if (auto *LI = dyn_cast_or_null<LoadInst>(I)) {
+            if (LI->isVolatile() || LI->getType() != G->getValueType())
+                return nullptr;
+        } else if (auto *SI = dyn_cast_or_null<StoreInst>(I)) {
+            if (SI->isVolatile() || SI->getPointerOperand() != G ||
+                SI->getValueOperand()->getType() != G->getValueType())
+                return nullptr;
+        } else {
+            return nullptr;
+        }
+        if (F && I->getFunction() != F)
+            return nullptr;
+        F = I->getFunction();
+    }
+    return F;
+}
+
+//***********************Function isDeadOnEntry****************************//
+// forward must-store dataflow over F: true if every load of G is preceded
+// by a store to G on all paths from entry, so the value G holds when F is
+// called can never be observed
+//*************************************************************************//
+
+static bool isDeadOnEntry(GlobalVariable *G, Function *F)
+{
+    DenseMap<BasicBlock *, bool> out;
+    for (BasicBlock &BB : *F)
+        out[&BB] = true;
+
+    auto blockIn = [&](BasicBlock *BB) {
+        if (BB == &F->getEntryBlock())
+            return false;
+        for (BasicBlock *P : predecessors(BB))
+            if (!out[P])
+                return false;
+        return true;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (BasicBlock &BB : *F) {
+            bool stored = blockIn(&BB);
+            for (Instruction &I : BB)
+                if (auto *SI = dyn_cast<StoreInst>(&I))
+                    if (SI->getPointerOperand() == G)
+                        stored = true;
+            if (stored != out[&BB]) {
+                out[&BB] = stored;
+                changed = true;
+            }
+        }
+    }
+
+    for (BasicBlock &BB : *F) {
+        bool stored = blockIn(&BB);
+        for (Instruction &I : BB) {
+            if (auto *SI = dyn_cast<StoreInst>(&I)) {
+                if (SI->getPointerOperand() == G)
+                    stored = true;
+            } else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+                if (LI->getPointerOperand() == G && !stored)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void localize(GlobalVariable *G, Function *F, std::vector<AllocaInst *> &allocas)
+{
+    BasicBlock &Entry = F->getEntryBlock();
+    AllocaInst *AI = new AllocaInst(G->getValueType(), 0, G->getName() + ".local",
+                                    &*Entry.getFirstInsertionPt());
+    new StoreInst(G->getInitializer(), AI, AI->getNextNode());
+    G->replaceAllUsesWith(AI);
+    G->eraseFromParent();
+    allocas.push_back(AI);
+    GlobalsLocalized++;
+}
+
+void GlobalPromotion(Module *M)
+{
+    const DataLayout &DL = M->getDataLayout();
+    Function *Main = M->getFunction("main");
+    if (Main && Main->isDeclaration())
+        Main = nullptr;
+    bool wholeProgram = Main != nullptr;
+
+    std::vector<GlobalVariable *> globals;
+    for (auto g = M->global_begin(); g != M->global_end(); g++)
+        if (isOptimizable(&*g, wholeProgram))
+            globals.push_back(&*g);
+
+    // Functions that are part of a call-graph cycle (or may be re-entered
+    // through a pointer) keep their globals: each activation needs to see
+    // the stores made by the others. Indirect calls and calls to external
+    // code go to the calls-external node; give it edges to everything that
+    // could be called back from there so such re-entry shows up as a cycle.
+    SmallPtrSet<Function *, 16> recursive;
+    CallGraph CG(*M);
+    for (Function &F : *M)
+        if (!F.isDeclaration() &&
+            (F.hasAddressTaken() || (!wholeProgram && !F.hasLocalLinkage())))
+            CG.getCallsExternalNode()->addCalledFunction(nullptr, CG[&F]);
+    for (auto I = scc_begin(&CG); !I.isAtEnd(); ++I)
+        if (I.hasCycle())
+            for (CallGraphNode *N : *I)
+                if (N->getFunction())
+                    recursive.insert(N->getFunction());
+
+    std::vector<GlobalVariable *> remaining;
+    for (GlobalVariable *G : globals) {
+        if (isOnlyRead(G)) {
+            G->setConstant(true);
+            GlobalsConstant++;
+            foldConstantLoads(G, DL);
+        } else if (StoreInst *SI = isWriteOnce(G, Main)) {
+            Constant *C = cast<Constant>(SI->getValueOperand());
+            SI->eraseFromParent();
+            G->setInitializer(C);
+            G->setConstant(true);
+            GlobalsWriteOnce++;
+            foldConstantLoads(G, DL);
+        } else {
+            remaining.push_back(G);
+        }
+    }
+
+    // Folding may have removed the last use of a constant global.
+    for (GlobalVariable *G : globals) {
+        if (G->isConstant()) {
+            G->removeDeadConstantUsers();
+            if (G->use_empty()) {
+                G->eraseFromParent();
+                GlobalsRemoved++;
+            }
+        }
+    }
+
+    std::map<Function *, std::vector<AllocaInst *>> promoted;
+    for (GlobalVariable *G : remaining) {
+        Function *F = singleUserFunction(G);
+        if (!F || recursive.count(F) || F->hasAddressTaken())
+            continue;
+        // main runs once, so its copy can start from the initializer; any
+        // other function must never read the value left by a previous call.
+        bool once = F == Main && F->use_empty();
+        if (once || isDeadOnEntry(G, F))
+            localize(G, F, promoted[F]);
+    }
+
+    for (auto &p : promoted) {
+        DominatorTree DT(*p.first);
+        PromoteMemToReg(p.second, DT);
+    }
+}
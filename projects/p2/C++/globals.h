@@ -0,0 +1,10 @@
+#ifndef GLOBALS_H
+#define GLOBALS_H
+
+#include "llvm/IR/Module.h"
+
+/* Fold never-written globals into constants, freeze write-once globals
+   and turn globals used by one non-recursive function into locals. */
+void GlobalPromotion(llvm::Module *M);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * File: heap2stack.cpp
+ *
+ * Description:
+ *   Heap-to-stack promotion. A call to malloc with a constant size (or a
+ *   select between constant sizes) whose result never escapes the
+ *   function is replaced with a fixed stack slot in the entry block, and
+ *   every free of that pointer is deleted.
+ *
+ *   The escape check follows the pointer through bitcasts and GEPs. Loads
+ *   from it, stores into it, compares, mem intrinsics and free are
+ *   allowed. Anything else counts as an escape: storing the pointer, passing
+ *   it to a call, returning it, phis and selects. Phis and memory are the
+ *   only ways one loop iteration's object could reach the next, so a malloc
+ *   inside a loop can reuse one slot hoisted to the entry block.
+ *
+ *   The analysis works on SSA values. Run with -mem2reg so that pointers
+ *   are not kept in allocas.
+ */
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "heap2stack.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+        Heap2StackMax("heap2stack-max",
+                      cl::desc("Largest allocation (bytes) moved to the stack."),
+                      cl::init(1024));
+
+static cl::opt<unsigned>
+        Heap2StackFrame("heap2stack-frame",
+                        cl::desc("Stack bytes heap-to-stack may add to one function."),
+                        cl::init(8192));
+
+static llvm::Statistic H2SPromoted = {"", "H2SPromoted", "Heap-to-stack allocations promoted"};
+static llvm::Statistic H2SLoopSlots = {"", "H2SLoopSlots", "Heap-to-stack slots hoisted out of a loop"};
+static llvm::Statistic H2SCallsRemoved = {"", "H2SCallsRemoved", "Heap-to-stack allocator calls removed"};
+
+static bool isCallTo(Instruction *I, StringRef name)
+{
+    auto *CI = dyn_cast<CallInst>(I);
+    if (!CI)
+        return false;
+    Function *F = CI->getCalledFunction();
+    return F && F->isDeclaration() && F->getName() == name;
+}
+
+//***********************Function allocationSize***************************//
+// the number of bytes a malloc asks for when it is known at compile time;
+// a select between two constants is bounded by the larger one
+//*************************************************************************//
+
+static uint64_t allocationSize(CallInst *CI)
+{
+    Value *size = CI->getArgOperand(0);
+    if (auto *C = dyn_cast<ConstantInt>(size))
+        return C->getZExtValue();
+    if (auto *SI = dyn_cast<SelectInst>(size)) {
+        auto *T = dyn_cast<ConstantInt>(SI->getTrueValue());
+        auto *F = dyn_cast<ConstantInt>(SI->getFalseValue());
+        if (T && F)
+            return std::max(T->getZExtValue(), F->getZExtValue());
+    }
+    return 0;
+}
+
+//***********************Function escapes**********************************//
+// walk every value derived from the allocation; collects the frees of it
+// and returns true if the pointer may outlive the function or iteration
+//*************************************************************************//
+
+static bool escapes(Instruction *Alloc, std::vector<CallInst *> &frees)
+{
+    std::vector<Value *> worklist;
+    worklist.push_back(Alloc);
+    while (!worklist.empty()) {
+        Value *V = worklist.back();
+        worklist.pop_back();
+        for (User *U : V->users()) {
+            Instruction *I = dyn_cast<Instruction>(U);
+            if (!I)
+                return true;
+            if (isa<LoadInst>(I) || isa<ICmpInst>(I))
+                continue;
+            if (auto *SI = dyn_cast<StoreInst>(I)) {
+                if (SI->getValueOperand() == V)
+                    return true;
+                continue;
+            }
+            if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I)) {
+                worklist.push_back(I);
+                continue;
+            }
+            if (isCallTo(I, "free")) {
+                frees.push_back(cast<CallInst>(I));
+                continue;
+            }
+            if (auto *II = dyn_cast<IntrinsicInst>(I)) {
+                if (isa<MemIntrinsic>(II) || II->isLifetimeStartOrEnd())
+                    continue;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static void promoteFunction(Function &F)
+{
+    std::vector<CallInst *> mallocs;
+    for (BasicBlock &BB : F)
+        for (Instruction &I : BB)
+            if (isCallTo(&I, "malloc") && cast<CallInst>(&I)->arg_size() == 1)
+                mallocs.push_back(cast<CallInst>(&I));
+    if (mallocs.empty())
+        return;
+
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    BasicBlock &Entry = F.getEntryBlock();
+    Type *Int8Ty = Type::getInt8Ty(F.getContext());
+    uint64_t frame = 0;
+
+    for (CallInst *CI : mallocs) {
+        uint64_t size = allocationSize(CI);
+        if (size == 0 || size > Heap2StackMax || frame + size > Heap2StackFrame)
+            continue;
+
+        std::vector<CallInst *> frees;
+        if (escapes(CI, frees))
+            continue;
+
+        Value *count = ConstantInt::get(CI->getArgOperand(0)->getType(), size);
+        AllocaInst *AI = new AllocaInst(Int8Ty, 0, count, Align(16),
+                                        CI->getName() + ".stack",
+                                        &*Entry.getFirstInsertionPt());
+        Value *slot = AI;
+        if (slot->getType() != CI->getType())
+            slot = new BitCastInst(AI, CI->getType(), "", AI->getNextNode());
+
+        if (LI.getLoopFor(CI->getParent()))
+            H2SLoopSlots++;
+        CI->replaceAllUsesWith(slot);
+        CI->eraseFromParent();
+        for (CallInst *FreeCI : frees) {
+            FreeCI->eraseFromParent();
+            H2SCallsRemoved++;
+        }
+        H2SCallsRemoved++;
+        H2SPromoted++;
+        frame += size;
+    }
+}
+
+void HeapToStack(Module *M)
+{
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration())
+            promoteFunction(*f);
+}
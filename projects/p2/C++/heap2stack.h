@@ -0,0 +1,10 @@
+#ifndef HEAP2STACK_H
+#define HEAP2STACK_H
+
+#include "llvm/IR/Module.h"
+
+/* Turn small mallocs whose pointer never escapes the function into
+   stack slots and drop the matching frees. */
+void HeapToStack(llvm::Module *M);
+
+#endif
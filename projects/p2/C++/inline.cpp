@@ -0,0 +1,242 @@
+/*
+ * File: inline.cpp
+ *
+ * Description:
+ *   Cost-model-driven function inliner. Functions are visited bottom-up
+ *   over the call graph (callees before callers). Each direct call site is
+ *   inlined when the callee's size, estimated after folding the constant
+ *   arguments of that call, is under -inline-size. Callers that changed are
+ *   cleaned up with the p2 CSE pass.
+ */
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "cse.h"
+#include "inline.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+        InlineSize("inline-size",
+                   cl::desc("Largest estimated callee size (instructions) the inliner accepts."),
+                   cl::init(40));
+
+static llvm::Statistic InlineCalls = {"", "InlineCalls", "Inliner call sites inlined"};
+static llvm::Statistic InlineGrowth = {"", "InlineGrowth", "Inliner instructions added to callers"};
+static llvm::Statistic InlineDeleted = {"", "InlineDeleted", "Inliner dead functions removed"};
+
+static unsigned instructionCount(Function *F)
+{
+    unsigned count = 0;
+    for (auto bb = F->begin(); bb != F->end(); bb++)
+        count += bb->size();
+    return count;
+}
+
+//***********************Function instructionCost**************************//
+// rough cost of keeping I once it is copied into a caller
+// casts, allocas (they become caller frame slots), phis and debug/lifetime
+// markers are free, returns turn into a branch, calls pay for their args
+//*************************************************************************//
+
+static unsigned instructionCost(Instruction &I)
+{
+    if (isa<DbgInfoIntrinsic>(&I) || isa<PHINode>(&I) || isa<AllocaInst>(&I) ||
+        isa<ReturnInst>(&I) || isa<BitCastInst>(&I))
+        return 0;
+    if (auto *II = dyn_cast<IntrinsicInst>(&I))
+        if (II->isLifetimeStartOrEnd())
+            return 0;
+    if (auto *CB = dyn_cast<CallBase>(&I))
+        return 1 + CB->arg_size();
+    return 1;
+}
+
+//***********************Function foldWithKnown****************************//
+// returns the constant I evaluates to if all of its operands are constants
+// or values already known to be constant, otherwise null
+//*************************************************************************//
+
+static Constant *foldWithKnown(Instruction &I, DenseMap<Value *, Constant *> &known,
+                               const DataLayout &DL)
+{
+    if (isa<PHINode>(&I) || isa<CallBase>(&I) || I.isTerminator() ||
+        I.mayReadOrWriteMemory() || isa<AllocaInst>(&I))
+        return nullptr;
+
+    SmallVector<Constant *, 4> ops;
+    for (Value *op : I.operands()) {
+        Constant *C = dyn_cast<Constant>(op);
+        if (!C) {
+            auto it = known.find(op);
+            if (it == known.end())
+                return nullptr;
+            C = it->second;
+        }
+        ops.push_back(C);
+    }
+
+    if (auto *Cmp = dyn_cast<CmpInst>(&I))
+        return ConstantFoldCompareInstOperands(Cmp->getPredicate(), ops[0], ops[1], DL);
+    return ConstantFoldInstOperands(&I, ops, DL);
+}
+
+unsigned EstimateSizeWithConstants(Function *F, ArrayRef<Constant *> Args)
+{
+    DenseMap<Value *, Constant *> known;
+    for (unsigned a = 0; a < Args.size() && a < F->arg_size(); a++)
+        if (Args[a])
+            known[F->getArg(a)] = Args[a];
+
+    const DataLayout &DL = F->getParent()->getDataLayout();
+    SmallPtrSet<BasicBlock *, 16> visited;
+    std::vector<BasicBlock *> worklist;
+    worklist.push_back(&F->getEntryBlock());
+    unsigned size = 0;
+
+    // Blocks are only reached through edges that stay live under the
+    // known constants, so a branch on a constant argument prunes the path.
+    while (!worklist.empty()) {
+        BasicBlock *BB = worklist.back();
+        worklist.pop_back();
+        if (!visited.insert(BB).second)
+            continue;
+
+        for (Instruction &I : *BB) {
+            if (Constant *C = foldWithKnown(I, known, DL)) {
+                known[&I] = C;
+                continue;
+            }
+            size += instructionCost(I);
+        }
+
+        Instruction *T = BB->getTerminator();
+        Value *cond = nullptr;
+        if (auto *Br = dyn_cast<BranchInst>(T)) {
+            if (Br->isConditional())
+                cond = Br->getCondition();
+        } else if (auto *Sw = dyn_cast<SwitchInst>(T)) {
+            cond = Sw->getCondition();
+        }
+
+        ConstantInt *CI = cond ? dyn_cast<ConstantInt>(cond) : nullptr;
+        if (cond && !CI) {
+            auto it = known.find(cond);
+            if (it != known.end())
+                CI = dyn_cast<ConstantInt>(it->second);
+        }
+
+        if (CI && isa<BranchInst>(T)) {
+            worklist.push_back(T->getSuccessor(CI->isZero() ? 1 : 0));
+        } else if (CI && isa<SwitchInst>(T)) {
+            worklist.push_back(cast<SwitchInst>(T)->findCaseValue(CI)->getCaseSuccessor());
+        } else {
+            for (unsigned s = 0; s < T->getNumSuccessors(); s++)
+                worklist.push_back(T->getSuccessor(s));
+        }
+    }
+    return size;
+}
+
+//***********************Function isInlineCandidate************************//
+// direct calls to a defined, non-varargs function outside of the caller's
+// own SCC (inlining recursion would never terminate)
+//*************************************************************************//
+
+static bool isInlineCandidate(CallBase *CB, SmallPtrSetImpl<Function *> &scc)
+{
+    Function *Callee = CB->getCalledFunction();
+    if (!Callee || Callee->isDeclaration() || Callee->isVarArg())
+        return false;
+    if (scc.count(Callee) || CB->isNoInline() ||
+        Callee->hasFnAttribute(Attribute::NoInline))
+        return false;
+    return Callee->getFunctionType() == CB->getFunctionType();
+}
+
+static bool inlineCallSites(Function *F, SmallPtrSetImpl<Function *> &scc)
+{
+    std::vector<CallBase *> sites;
+    for (auto bb = F->begin(); bb != F->end(); bb++)
+        for (auto i = bb->begin(); i != bb->end(); i++)
+            if (auto *CB = dyn_cast<CallBase>(&*i))
+                if (isInlineCandidate(CB, scc))
+                    sites.push_back(CB);
+
+    bool changed = false;
+    for (CallBase *CB : sites) {
+        Function *Callee = CB->getCalledFunction();
+
+        SmallVector<Constant *, 8> args;
+        for (unsigned a = 0; a < CB->arg_size(); a++)
+            args.push_back(dyn_cast<Constant>(CB->getArgOperand(a)));
+
+        // The last call to a local function takes the whole body with it,
+        // so code size barely changes and a larger callee is acceptable.
+        unsigned limit = InlineSize;
+        if (Callee->hasLocalLinkage() && Callee->hasOneUse())
+            limit *= 4;
+
+        if (!Callee->hasFnAttribute(Attribute::AlwaysInline) &&
+            EstimateSizeWithConstants(Callee, args) > limit)
+            continue;
+
+        InlineFunctionInfo IFI;
+        if (InlineFunction(*CB, IFI).isSuccess()) {
+            InlineCalls++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void FunctionInlining(Module *M)
+{
+    // scc_iterator hands out SCCs in post-order, so callees are finished
+    // (and already have their own call sites inlined) before any caller.
+    CallGraph CG(*M);
+    std::vector<std::vector<Function *>> order;
+    for (auto I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+        std::vector<Function *> scc;
+        for (CallGraphNode *N : *I)
+            if (Function *F = N->getFunction())
+                if (!F->isDeclaration())
+                    scc.push_back(F);
+        if (!scc.empty())
+            order.push_back(scc);
+    }
+
+    for (auto &scc : order) {
+        SmallPtrSet<Function *, 4> members(scc.begin(), scc.end());
+        for (Function *F : scc) {
+            unsigned before = instructionCount(F);
+            if (!inlineCallSites(F, members))
+                continue;
+            CommonSubexpressionElimination(F);
+            unsigned after = instructionCount(F);
+            if (after > before)
+                InlineGrowth += after - before;
+        }
+    }
+
+    // Local functions whose every call site was inlined are dead now.
+    for (auto f = M->begin(); f != M->end(); ) {
+        Function *F = &*f;
+        f++;
+        if (!F->isDeclaration() && F->hasLocalLinkage() && F->use_empty()) {
+            F->eraseFromParent();
+            InlineDeleted++;
+        }
+    }
+}
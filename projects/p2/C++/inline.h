@@ -0,0 +1,18 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Constant.h"
+#include "llvm/IR/Module.h"
+
+/* Bottom-up, cost-model-driven inliner. Callers are cleaned up with CSE
+   after their call sites have been inlined. */
+void FunctionInlining(llvm::Module *M);
+
+/* Estimate the size of F in instructions once the arguments in Args are
+   replaced by constants (a null entry means the argument is unknown).
+   Instructions that fold and blocks that become unreachable are free. */
+unsigned EstimateSizeWithConstants(llvm::Function *F,
+                                   llvm::ArrayRef<llvm::Constant *> Args);
+
+#endif
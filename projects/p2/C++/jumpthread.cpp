@@ -0,0 +1,373 @@
+/*
+ * File: jumpthread.cpp
+ *
+ * Description:
+ *   Dominating-condition elimination and jump threading.
+ *
+ *   1. Facts: an edge P->S of a conditional branch on c, where the edge
+ *      dominates S, makes c true (or false) in every block S dominates.
+ *      Walking the dominator tree with a stack of these facts, each
+ *      integer compare that a fact implies (isImpliedCondition covers
+ *      equality, constant ranges, null and and/or of conditions) is
+ *      replaced by the constant. Branches on constants are then folded
+ *      and blocks that became unreachable removed.
+ *   2. Threading: a block B that ends in a conditional branch, when its
+ *      outcome is fixed on an incoming edge P->B, is duplicated for that
+ *      edge and the copy jumps straight to the known successor. The
+ *      outcome is fixed when the condition, after replacing B's phis by
+ *      their values from P, folds to a constant or is implied by the
+ *      facts at the end of P (including the P->B edge itself). Values
+ *      that B defines and uses outside it are rejoined with SSAUpdater.
+ *
+ *   Only blocks of at most -jumpthread-size instructions are duplicated,
+ *   loop headers never are, and each function may grow by at most
+ *   GrowthPercent of its size (at least MinGrowth instructions). The
+ *   facts are applied again after threading, then unreachable blocks are
+ *   removed and blocks with a single predecessor merged into it.
+ */
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include "jumpthread.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+        JumpThreadSize("jumpthread-size",
+                       cl::desc("Largest block (in instructions) duplicated to thread an edge."),
+                       cl::init(6));
+
+static llvm::Statistic JTFolded = {"", "JTFolded", "JumpThread compares folded by dominating conditions"};
+static llvm::Statistic JTBranches = {"", "JTBranches", "JumpThread conditional branches folded"};
+static llvm::Statistic JTThreaded = {"", "JTThreaded", "JumpThread edges threaded"};
+static llvm::Statistic JTDuplicated = {"", "JTDuplicated", "JumpThread instructions duplicated"};
+
+static const unsigned GrowthPercent = 10;
+static const unsigned MinGrowth = 32;
+
+struct Fact {
+    Value *cond;
+    bool truth;
+};
+
+//***********************Function edgeFact*********************************//
+// the fact the edge From->To establishes, if From branches on a condition
+// and the edge is the only way into To from From
+//*************************************************************************//
+
+static bool edgeFact(BasicBlock *From, BasicBlock *To, Fact &F)
+{
+    auto *BI = dyn_cast<BranchInst>(From->getTerminator());
+    if (!BI || !BI->isConditional() || isa<Constant>(BI->getCondition()) ||
+        BI->getSuccessor(0) == BI->getSuccessor(1))
+        return false;
+    F.cond = BI->getCondition();
+    F.truth = BI->getSuccessor(0) == To;
+    return BI->getSuccessor(0) == To || BI->getSuccessor(1) == To;
+}
+
+static Optional<bool> implied(const std::vector<Fact> &facts, Value *cond, const DataLayout &DL)
+{
+    for (auto f = facts.rbegin(); f != facts.rend(); f++) {
+        if (f->cond == cond)
+            return f->truth;
+        if (Optional<bool> r = isImpliedCondition(f->cond, cond, DL, f->truth))
+            return r;
+    }
+    return None;
+}
+
+//***********************Function foldDominated****************************//
+// replace the compares the dominating facts decide, then fold the branches
+// on constants
+//*************************************************************************//
+
+static bool foldDominated(Function &F)
+{
+    const DataLayout &DL = F.getParent()->getDataLayout();
+    DominatorTree DT(F);
+    bool changed = false;
+
+    std::vector<Fact> facts;
+    std::vector<std::pair<DomTreeNode *, unsigned>> work{{DT.getRootNode(), 0}};
+    while (!work.empty()) {
+        DomTreeNode *N = work.back().first;
+        facts.resize(work.back().second);
+        work.pop_back();
+
+        BasicBlock *BB = N->getBlock();
+        Fact fact;
+        if (N->getIDom() && edgeFact(N->getIDom()->getBlock(), BB, fact) &&
+            DT.dominates(BasicBlockEdge(N->getIDom()->getBlock(), BB), BB))
+            facts.push_back(fact);
+
+        if (!facts.empty())
+            for (auto i = BB->begin(); i != BB->end();) {
+                auto *Cmp = dyn_cast<ICmpInst>(&*i++);
+                if (!Cmp)
+                    continue;
+                if (Optional<bool> r = implied(facts, Cmp, DL)) {
+                    Cmp->replaceAllUsesWith(ConstantInt::getBool(Cmp->getType(), *r));
+                    Cmp->eraseFromParent();
+                    JTFolded++;
+                    changed = true;
+                }
+            }
+
+        for (DomTreeNode *C : N->children())
+            work.push_back(std::make_pair(C, facts.size()));
+    }
+
+    for (BasicBlock &BB : F) {
+        auto *BI = dyn_cast<BranchInst>(BB.getTerminator());
+        if (BI && BI->isConditional() && isa<ConstantInt>(BI->getCondition()) &&
+            ConstantFoldTerminator(&BB, true)) {
+            JTBranches++;
+            changed = true;
+        }
+    }
+    if (changed)
+        removeUnreachableBlocks(F);
+    return changed;
+}
+
+// the facts that hold at the end of P
+static std::vector<Fact> factsAtEnd(BasicBlock *P, DominatorTree &DT)
+{
+    std::vector<Fact> facts;
+    for (DomTreeNode *N = DT.getNode(P); N && N->getIDom(); N = N->getIDom()) {
+        BasicBlock *D = N->getIDom()->getBlock();
+        Fact fact;
+        if (edgeFact(D, N->getBlock(), fact) && DT.dominates(BasicBlockEdge(D, N->getBlock()), N->getBlock()))
+            facts.insert(facts.begin(), fact);
+    }
+    return facts;
+}
+
+//***********************Function knownSuccessor***************************//
+// the successor B's branch takes whenever it is entered from P, or null
+//*************************************************************************//
+
+static BasicBlock *knownSuccessor(BasicBlock *P, BasicBlock *B, DominatorTree &DT)
+{
+    const DataLayout &DL = B->getModule()->getDataLayout();
+    auto *BI = cast<BranchInst>(B->getTerminator());
+    Value *C = BI->getCondition();
+
+    Value *Known = nullptr;
+    if (auto *PN = dyn_cast<PHINode>(C)) {
+        if (PN->getParent() == B)
+            Known = PN->getIncomingValueForBlock(P);
+    } else if (auto *Cmp = dyn_cast<ICmpInst>(C)) {
+        Value *L = Cmp->getOperand(0), *R = Cmp->getOperand(1);
+        if (Cmp->getParent() == B) {
+            auto *LP = dyn_cast<PHINode>(L);
+            auto *RP = dyn_cast<PHINode>(R);
+            if (LP && LP->getParent() == B)
+                L = LP->getIncomingValueForBlock(P);
+            if (RP && RP->getParent() == B)
+                R = RP->getIncomingValueForBlock(P);
+            // anything else defined in B is not known on the edge
+            for (Value *V : {L, R})
+                if (auto *I = dyn_cast<Instruction>(V))
+                    if (I->getParent() == B)
+                        return nullptr;
+        }
+        if (isa<Constant>(L) && isa<Constant>(R))
+            Known = ConstantFoldCompareInstOperands(Cmp->getPredicate(), cast<Constant>(L),
+                                                    cast<Constant>(R), DL);
+        if (!Known) {
+            std::vector<Fact> facts = factsAtEnd(P, DT);
+            Fact fact;
+            if (edgeFact(P, B, fact))
+                facts.push_back(fact);
+            for (auto f = facts.rbegin(); f != facts.rend() && !Known; f++)
+                if (Optional<bool> r = isImpliedCondition(f->cond, Cmp->getPredicate(), L, R, DL, f->truth))
+                    Known = ConstantInt::getBool(C->getType(), *r);
+        }
+    } else if (!isa<Instruction>(C) || cast<Instruction>(C)->getParent() != B) {
+        std::vector<Fact> facts = factsAtEnd(P, DT);
+        Fact fact;
+        if (edgeFact(P, B, fact))
+            facts.push_back(fact);
+        if (Optional<bool> r = implied(facts, C, DL))
+            Known = ConstantInt::getBool(C->getType(), *r);
+    }
+
+    auto *CI = dyn_cast_or_null<ConstantInt>(Known);
+    if (!CI)
+        return nullptr;
+    return BI->getSuccessor(CI->isZero() ? 1 : 0);
+}
+
+static unsigned blockSize(BasicBlock *B)
+{
+    unsigned n = 0;
+    for (Instruction &I : *B)
+        if (!isa<PHINode>(&I) && !I.isTerminator() && !I.isDebugOrPseudoInst())
+            n++;
+    return n;
+}
+
+static bool canDuplicate(BasicBlock *B, DominatorTree &DT)
+{
+    auto *BI = dyn_cast<BranchInst>(B->getTerminator());
+    if (!BI || !BI->isConditional() || B->isEHPad() || B->hasAddressTaken() ||
+        blockSize(B) > JumpThreadSize)
+        return false;
+    for (BasicBlock *P : predecessors(B))
+        if (DT.dominates(B, P))
+            return false; // loop header
+    for (Instruction &I : *B) {
+        if (I.getType()->isTokenTy())
+            return false;
+        if (auto *CB = dyn_cast<CallBase>(&I))
+            if (CB->cannotDuplicate() || CB->isConvergent())
+                return false;
+    }
+    return true;
+}
+
+//***********************Function threadEdge*******************************//
+// give P its own copy of B that jumps straight to S
+//*************************************************************************//
+
+static void threadEdge(BasicBlock *P, BasicBlock *B, BasicBlock *S)
+{
+    ValueToValueMapTy VM;
+    BasicBlock *NB = BasicBlock::Create(B->getContext(), B->getName() + ".thread", B->getParent(), B);
+    for (Instruction &I : *B) {
+        if (auto *PN = dyn_cast<PHINode>(&I)) {
+            VM[PN] = PN->getIncomingValueForBlock(P);
+            continue;
+        }
+        if (I.isTerminator())
+            break;
+        Instruction *C = I.clone();
+        C->setName(I.getName());
+        NB->getInstList().push_back(C);
+        RemapInstruction(C, VM, RF_NoModuleLevelChanges | RF_IgnoreMissingLocals);
+        VM[&I] = C;
+        JTDuplicated++;
+    }
+    BranchInst::Create(S, NB);
+
+    for (PHINode &PN : S->phis()) {
+        Value *V = PN.getIncomingValueForBlock(B);
+        auto it = VM.find(V);
+        PN.addIncoming(it != VM.end() ? (Value *)it->second : V, NB);
+    }
+    B->removePredecessor(P, true);
+    P->getTerminator()->replaceSuccessorWith(B, NB);
+
+    // B's values now reach the rest of the function from two blocks
+    for (Instruction &I : *B) {
+        auto it = VM.find(&I);
+        if (it == VM.end())
+            continue;
+        std::vector<Use *> outside;
+        for (Use &U : I.uses()) {
+            auto *User = cast<Instruction>(U.getUser());
+            BasicBlock *UB = User->getParent();
+            if (auto *PN = dyn_cast<PHINode>(User))
+                UB = PN->getIncomingBlock(U);
+            if (UB != B)
+                outside.push_back(&U);
+        }
+        if (outside.empty())
+            continue;
+        SSAUpdater SSA;
+        SSA.Initialize(I.getType(), I.getName());
+        SSA.AddAvailableValue(B, &I);
+        SSA.AddAvailableValue(NB, it->second);
+        for (Use *U : outside)
+            SSA.RewriteUse(*U);
+    }
+
+    for (auto i = NB->rbegin(); i != NB->rend();) {
+        Instruction *I = &*i++;
+        if (isInstructionTriviallyDead(I))
+            I->eraseFromParent();
+    }
+}
+
+//***********************Function cleanUp**********************************//
+// drop the blocks threading left unreachable and fold the forwarding
+// blocks that threading and branch folding leave behind
+//*************************************************************************//
+
+static void cleanUp(Function &F)
+{
+    removeUnreachableBlocks(F);
+    for (auto b = F.begin(); b != F.end();) {
+        BasicBlock *BB = &*b++;
+        if (BB->getSinglePredecessor())
+            FoldSingleEntryPHINodes(BB);
+        MergeBlockIntoPredecessor(BB);
+    }
+}
+
+static bool threadFunction(Function &F)
+{
+    unsigned size = 0;
+    for (BasicBlock &BB : F)
+        size += BB.size();
+    unsigned budget = std::max(MinGrowth, size * GrowthPercent / 100);
+    bool changed = false;
+
+    for (bool again = true; again;) {
+        again = false;
+        DominatorTree DT(F);
+        for (BasicBlock &B : F) {
+            unsigned cost = std::max(1u, blockSize(&B));
+            if (cost > budget || !canDuplicate(&B, DT))
+                continue;
+            for (BasicBlock *P : predecessors(&B)) {
+                Instruction *TI = P->getTerminator();
+                if (!isa<BranchInst>(TI) || count(successors(P), &B) != 1)
+                    continue;
+                BasicBlock *S = knownSuccessor(P, &B, DT);
+                if (!S || S == &B)
+                    continue;
+                budget -= cost;
+                threadEdge(P, &B, S);
+                JTThreaded++;
+                changed = again = true;
+                break;
+            }
+            if (again)
+                break;
+        }
+    }
+    return changed;
+}
+
+void JumpThreading(Module *M)
+{
+    for (auto f = M->begin(); f != M->end(); f++) {
+        if (f->isDeclaration())
+            continue;
+        bool changed = foldDominated(*f);
+        if (threadFunction(*f)) {
+            removeUnreachableBlocks(*f);
+            foldDominated(*f);
+            changed = true;
+        }
+        if (changed)
+            cleanUp(*f);
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef JUMPTHREAD_H
+#define JUMPTHREAD_H
+
+#include "llvm/IR/Module.h"
+
+/* Fold compares decided by dominating branch conditions, and thread
+   edges through small blocks whose branch is decided on that edge. */
+void JumpThreading(llvm::Module *M);
+
+#endif
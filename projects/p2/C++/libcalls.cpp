@@ -0,0 +1,333 @@
+/*
+ * File: libcalls.cpp
+ *
+ * Description:
+ *   Math library call simplification for numeric benchmark code.
+ *
+ *   1. K&R declarations such as "double sqrt();" produce calls through a
+ *      varargs or mismatched function type, so nothing downstream knows
+ *      what they are. Calls to a known libm function whose declaration
+ *      does not match its prototype get that prototype, with the
+ *      arguments converted the way the prototype would have converted
+ *      them.
+ *   2. pow(x, c) with c = 0, -1, 1 .. N, 0.5, N+0.5 or 0.25 becomes
+ *      multiplies, a divide and square roots (N is -libcall-pow-max). The
+ *      sqrt forms keep pow's results for -0.0 and -inf. More than one
+ *      multiply can differ from libm in the last bit, like -ffast-math;
+ *      -libcall-pow-max=2 keeps only the exact rewrites. Other negative
+ *      exponents are left alone, since 1/(x*x) rounds twice.
+ *   3. sqrt and fabs become the llvm.sqrt / llvm.fabs intrinsics (as with
+ *      -fno-math-errno), which the back end turns into single
+ *      instructions.
+ *   4. sin(x) and cos(x) of the same x in one function become one sincos
+ *      call at the nearest block that dominates all of them.
+ */
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "libcalls.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+        LibcallPowMax("libcall-pow-max",
+                      cl::desc("Largest integer exponent of pow expanded into multiplies."),
+                      cl::init(3));
+
+static llvm::Statistic LibPrototypes = {"", "LibPrototypes", "Library calls given their prototype"};
+static llvm::Statistic LibPow = {"", "LibPow", "Library pow calls expanded"};
+static llvm::Statistic LibIntrinsics = {"", "LibIntrinsics", "Library calls turned into intrinsics"};
+static llvm::Statistic LibSinCos = {"", "LibSinCos", "Library sin/cos calls merged into sincos"};
+static llvm::Statistic LibReplaced = {"", "LibReplaced", "Library calls replaced"};
+
+//***********************Function prototypeOf******************************//
+// the real signature of a libm function we know, or null
+//*************************************************************************//
+
+static FunctionType *prototypeOf(StringRef name, LLVMContext &C)
+{
+    static const StringMap<unsigned> arity = {
+        {"sqrt", 1}, {"fabs", 1}, {"sin", 1},   {"cos", 1},   {"tan", 1},
+        {"asin", 1}, {"acos", 1}, {"atan", 1},  {"exp", 1},   {"log", 1},
+        {"log10", 1}, {"floor", 1}, {"ceil", 1}, {"sinh", 1}, {"cosh", 1},
+        {"tanh", 1}, {"pow", 2},  {"atan2", 2}, {"fmod", 2}};
+
+    Type *FPTy = Type::getDoubleTy(C);
+    StringRef base = name;
+    if (name.endswith("f") && arity.count(name.drop_back())) {
+        FPTy = Type::getFloatTy(C);
+        base = name.drop_back();
+    }
+    auto it = arity.find(base);
+    if (it == arity.end())
+        return nullptr;
+    std::vector<Type *> params(it->second, FPTy);
+    return FunctionType::get(FPTy, params, false);
+}
+
+static Value *convertNumber(IRBuilder<> &B, Value *V, Type *To)
+{
+    Type *From = V->getType();
+    if (From == To)
+        return V;
+    if (From->isFloatingPointTy() && To->isFloatingPointTy())
+        return B.CreateFPCast(V, To);
+    if (From->isIntegerTy() && To->isFloatingPointTy())
+        return B.CreateSIToFP(V, To);
+    if (From->isFloatingPointTy() && To->isIntegerTy())
+        return B.CreateFPToSI(V, To);
+    return nullptr;
+}
+
+//***********************Function fixPrototype*****************************//
+// redeclare F with its real type and move every call over to it
+//*************************************************************************//
+
+static void fixPrototype(Module *M, Function *F, FunctionType *Proto)
+{
+    std::string name = F->getName().str();
+    F->setName(name + ".noproto");
+    Function *NewF = Function::Create(Proto, GlobalValue::ExternalLinkage, name, M);
+
+    std::vector<CallBase *> calls;
+    for (User *U : F->users()) {
+        if (auto *CB = dyn_cast<CallBase>(U)) {
+            if (CB->getCalledOperand() == F)
+                calls.push_back(CB);
+        } else if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+            if (CE->isCast())
+                for (User *CU : CE->users())
+                    if (auto *CB = dyn_cast<CallBase>(CU))
+                        if (CB->getCalledOperand() == CE)
+                            calls.push_back(CB);
+        }
+    }
+
+    for (CallBase *CB : calls) {
+        if (!isa<CallInst>(CB) || CB->arg_size() != Proto->getNumParams())
+            continue;
+        IRBuilder<> B(CB);
+        std::vector<Value *> args;
+        for (unsigned a = 0; a < CB->arg_size(); a++)
+            if (Value *V = convertNumber(B, CB->getArgOperand(a), Proto->getParamType(a)))
+                args.push_back(V);
+        if (args.size() != CB->arg_size())
+            continue;
+        if (!CB->getType()->isVoidTy() && !CB->getType()->isFloatingPointTy() &&
+            !CB->getType()->isIntegerTy())
+            continue;
+
+        CallInst *NewCI = B.CreateCall(NewF, args);
+        if (!CB->getType()->isVoidTy()) {
+            Value *R = convertNumber(B, NewCI, CB->getType());
+            R->takeName(CB);
+            CB->replaceAllUsesWith(R);
+        }
+        CB->eraseFromParent();
+        LibPrototypes++;
+    }
+
+    // Whatever is left (calls we could not convert, address uses) keeps
+    // working through a cast of the new declaration.
+    F->replaceAllUsesWith(ConstantExpr::getBitCast(NewF, F->getType()));
+    F->eraseFromParent();
+}
+
+static Value *powInteger(IRBuilder<> &B, Value *X, unsigned n)
+{
+    Value *R = nullptr;
+    Value *Sq = X;
+    // square and multiply, so x^3 takes two multiplies
+    for (; n; n >>= 1) {
+        if (n & 1)
+            R = R ? B.CreateFMul(R, Sq) : Sq;
+        if (n > 1)
+            Sq = B.CreateFMul(Sq, Sq);
+    }
+    return R;
+}
+
+//***********************Function powSqrt**********************************//
+// pow(x, 0.5): sqrt gives -0 for -0 and NaN for -inf where pow gives +0
+// and +inf, so take fabs and select +inf for -inf
+//*************************************************************************//
+
+static Value *powSqrt(IRBuilder<> &B, Module *M, Value *X)
+{
+    Type *Ty = X->getType();
+    Function *Sqrt = Intrinsic::getDeclaration(M, Intrinsic::sqrt, {Ty});
+    Function *Fabs = Intrinsic::getDeclaration(M, Intrinsic::fabs, {Ty});
+    Value *S = B.CreateCall(Fabs, {B.CreateCall(Sqrt, {X})});
+    Value *IsNegInf = B.CreateFCmpOEQ(X, ConstantFP::getInfinity(Ty, true));
+    return B.CreateSelect(IsNegInf, ConstantFP::getInfinity(Ty, false), S);
+}
+
+static Value *expandPow(IRBuilder<> &B, Module *M, Value *X, double e)
+{
+    Type *Ty = X->getType();
+    Function *Fabs = Intrinsic::getDeclaration(M, Intrinsic::fabs, {Ty});
+    double whole = (double)(long long)e;
+
+    if (e == 0.0)
+        return ConstantFP::get(Ty, 1.0);
+    if (e == -1.0)
+        return B.CreateFDiv(ConstantFP::get(Ty, 1.0), X);
+    if (e == whole && e > 0 && e <= LibcallPowMax)
+        return powInteger(B, X, (unsigned)e);
+    if (e == 0.25) {
+        Function *Sqrt = Intrinsic::getDeclaration(M, Intrinsic::sqrt, {Ty});
+        return B.CreateCall(Sqrt, {powSqrt(B, M, X)});
+    }
+    if (e - whole == 0.5 && e > 0 && whole <= LibcallPowMax) {
+        Value *S = powSqrt(B, M, X);
+        if (whole == 0)
+            return S;
+        // |x^n| keeps the sign right for -0 and -inf; negative x gives NaN
+        // through the square root either way.
+        return B.CreateFMul(B.CreateCall(Fabs, {powInteger(B, X, (unsigned)whole)}), S);
+    }
+    return nullptr;
+}
+
+static bool canUseSinCos(Module *M)
+{
+    Triple T(M->getTargetTriple());
+    return !T.isOSDarwin() && !T.isOSWindows();
+}
+
+//***********************Function mergeSinCos******************************//
+// one sincos for every argument that has both a sin and a cos call
+//*************************************************************************//
+
+static void mergeSinCos(Function &F, std::map<Value *, std::vector<CallInst *>> &sins,
+                        std::map<Value *, std::vector<CallInst *>> &coss)
+{
+    Module *M = F.getParent();
+    DominatorTree DT(F);
+
+    for (auto &s : sins) {
+        Value *X = s.first;
+        auto c = coss.find(X);
+        if (c == coss.end())
+            continue;
+
+        std::vector<CallInst *> all(s.second);
+        all.insert(all.end(), c->second.begin(), c->second.end());
+
+        BasicBlock *Dom = all[0]->getParent();
+        for (CallInst *CI : all)
+            Dom = DT.findNearestCommonDominator(Dom, CI->getParent());
+        Instruction *At = Dom->getTerminator();
+        for (CallInst *CI : all)
+            if (CI->getParent() == Dom && CI->comesBefore(At))
+                At = CI;
+
+        Type *Ty = X->getType();
+        Type *PtrTy = Ty->getPointerTo();
+        FunctionCallee SinCos = M->getOrInsertFunction(
+                Ty->isFloatTy() ? "sincosf" : "sincos", Type::getVoidTy(M->getContext()),
+                Ty, PtrTy, PtrTy);
+
+        IRBuilder<> E(&*F.getEntryBlock().getFirstInsertionPt());
+        AllocaInst *SinSlot = E.CreateAlloca(Ty, nullptr, "sin.slot");
+        AllocaInst *CosSlot = E.CreateAlloca(Ty, nullptr, "cos.slot");
+
+        IRBuilder<> B(At);
+        B.CreateCall(SinCos, {X, SinSlot, CosSlot});
+        Value *Sin = B.CreateLoad(Ty, SinSlot, "sin");
+        Value *Cos = B.CreateLoad(Ty, CosSlot, "cos");
+
+        for (CallInst *CI : s.second) {
+            CI->replaceAllUsesWith(Sin);
+            CI->eraseFromParent();
+        }
+        for (CallInst *CI : c->second) {
+            CI->replaceAllUsesWith(Cos);
+            CI->eraseFromParent();
+        }
+        LibSinCos += all.size();
+        LibReplaced += all.size();
+    }
+}
+
+static void simplifyFunction(Function &F, bool sincos)
+{
+    Module *M = F.getParent();
+    std::map<Value *, std::vector<CallInst *>> sins, coss;
+    std::vector<CallInst *> calls;
+
+    for (BasicBlock &BB : F)
+        for (Instruction &I : BB)
+            if (auto *CI = dyn_cast<CallInst>(&I)) {
+                Function *Callee = CI->getCalledFunction();
+                if (Callee && Callee->isDeclaration() &&
+                    Callee->getFunctionType() == prototypeOf(Callee->getName(), F.getContext()))
+                    calls.push_back(CI);
+            }
+
+    for (CallInst *CI : calls) {
+        StringRef name = CI->getCalledFunction()->getName();
+        StringRef base = name.endswith("f") ? name.drop_back() : name;
+        IRBuilder<> B(CI);
+        Value *R = nullptr;
+
+        if (base == "sqrt" || base == "fabs") {
+            Function *Intr = Intrinsic::getDeclaration(
+                    M, base == "sqrt" ? Intrinsic::sqrt : Intrinsic::fabs, {CI->getType()});
+            R = B.CreateCall(Intr, {CI->getArgOperand(0)});
+            LibIntrinsics++;
+        } else if (base == "pow") {
+            if (auto *E = dyn_cast<ConstantFP>(CI->getArgOperand(1))) {
+                bool lost;
+                APFloat e = E->getValueAPF();
+                e.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven, &lost);
+                R = expandPow(B, M, CI->getArgOperand(0), e.convertToDouble());
+                if (R)
+                    LibPow++;
+            }
+        } else if (base == "sin" && sincos) {
+            sins[CI->getArgOperand(0)].push_back(CI);
+        } else if (base == "cos" && sincos) {
+            coss[CI->getArgOperand(0)].push_back(CI);
+        }
+
+        if (R) {
+            R->takeName(CI);
+            CI->replaceAllUsesWith(R);
+            CI->eraseFromParent();
+            LibReplaced++;
+        }
+    }
+
+    mergeSinCos(F, sins, coss);
+}
+
+void SimplifyLibCalls(Module *M)
+{
+    std::vector<std::pair<Function *, FunctionType *>> fix;
+    for (auto f = M->begin(); f != M->end(); f++) {
+        if (!f->isDeclaration())
+            continue;
+        FunctionType *Proto = prototypeOf(f->getName(), M->getContext());
+        if (Proto && f->getFunctionType() != Proto)
+            fix.push_back(std::make_pair(&*f, Proto));
+    }
+    for (auto &p : fix)
+        fixPrototype(M, p.first, p.second);
+
+    bool sincos = canUseSinCos(M);
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration())
+            simplifyFunction(*f, sincos);
+}
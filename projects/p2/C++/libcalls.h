@@ -0,0 +1,11 @@
+#ifndef LIBCALLS_H
+#define LIBCALLS_H
+
+#include "llvm/IR/Module.h"
+
+/* Give prototype-less math calls their real signature, expand pow with
+   small constant exponents, turn sqrt/fabs into intrinsics and merge
+   sin/cos of one argument into sincos. */
+void SimplifyLibCalls(llvm::Module *M);
+
+#endif
@@ -25,6 +25,22 @@
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Analysis/InstructionSimplify.h"
 
+#include "coalesce.h"
+#include "cse.h"
+#include "globals.h"
+#include "heap2stack.h"
+#include "inline.h"
+#include "jumpthread.h"
+#include "libcalls.h"
+#include "poolalloc.h"
+#include "pre.h"
+#include "ptrcompress.h"
+#include "sink.h"
+#include "specialize.h"
+#include "strength.h"
+#include "structlayout.h"
+#include "tailrec.h"
+
 using namespace llvm;
 
 bool dce;
@@ -52,6 +68,76 @@ static cl::opt<bool>
                 cl::desc("Perform memory to register promotion before CSE."),
                 cl::init(false));
 
+static cl::opt<bool>
+        PromoteGlobals("promote-globals",
+                       cl::desc("Fold constant globals and promote single-function globals to locals."),
+                       cl::init(false));
+
+static cl::opt<bool>
+        StructLayoutOpt("structlayout",
+                        cl::desc("Reorder struct fields by access frequency and split off cold fields."),
+                        cl::init(false));
+
+static cl::opt<bool>
+        Heap2Stack("heap2stack",
+                   cl::desc("Move small non-escaping mallocs to the stack."),
+                   cl::init(false));
+
+static cl::opt<bool>
+        Specialize("specialize",
+                   cl::desc("Clone functions for constant call arguments before CSE."),
+                   cl::init(false));
+
+static cl::opt<bool>
+        Inline("inline",
+               cl::desc("Inline small functions bottom-up before CSE."),
+               cl::init(false));
+
+static cl::opt<bool>
+        TailRec("tailrec",
+                cl::desc("Turn self tail calls into loops and trailing self calls into an explicit stack."),
+                cl::init(false));
+
+static cl::opt<bool>
+        LibCalls("libcalls",
+                 cl::desc("Simplify math library calls (pow, sqrt, fabs, sin/cos) before CSE."),
+                 cl::init(false));
+
+static cl::opt<bool>
+        PoolAlloc("poolalloc",
+                  cl::desc("Allocate each linked data structure from its own pool (link with libp2rt)."),
+                  cl::init(false));
+
+static cl::opt<bool>
+        PtrCompress("ptrcompress",
+                    cl::desc("Store pointer fields of linked structures as 32-bit indices (link with libp2rt)."),
+                    cl::init(false));
+
+static cl::opt<bool>
+        Coalesce("coalesce",
+                 cl::desc("Merge adjacent narrow loads and stores into wide ones."),
+                 cl::init(false));
+
+static cl::opt<bool>
+        Strength("strength",
+                 cl::desc("Turn division, remainder and multiplication by constants into shifts and multiply-high before CSE."),
+                 cl::init(false));
+
+static cl::opt<bool>
+        JumpThread("jumpthread",
+                   cl::desc("Fold compares decided by dominating branches and thread edges through small blocks before PRE and CSE."),
+                   cl::init(false));
+
+static cl::opt<bool>
+        PRE("pre",
+            cl::desc("Remove partially redundant expressions by lazy code motion before CSE."),
+            cl::init(false));
+
+static cl::opt<bool>
+        Sink("sink",
+             cl::desc("Sink instructions and loads into the paths that use them, after CSE."),
+             cl::init(false));
+
 static cl::opt<bool>
         NoCSE("no-cse",
               cl::desc("Do not perform CSE Optimization."),
@@ -111,10 +197,66 @@ int main(int argc, char **argv) {
         Passes.run(*M.get());
     }
 
+    if (PromoteGlobals) {
+        GlobalPromotion(M.get());
+    }
+
+    if (Specialize) {
+        FunctionSpecialization(M.get());
+    }
+
+    if (Inline) {
+        FunctionInlining(M.get());
+    }
+
+    if (TailRec) {
+        EliminateTailRecursion(M.get());
+    }
+
+    if (LibCalls) {
+        SimplifyLibCalls(M.get());
+    }
+
+    if (StructLayoutOpt) {
+        ReorderStructFields(M.get());
+    }
+
+    if (Heap2Stack) {
+        HeapToStack(M.get());
+    }
+
+    if (PoolAlloc) {
+        PoolAllocation(M.get());
+    }
+
+    if (PtrCompress) {
+        PointerCompression(M.get());
+    }
+
+    if (Coalesce) {
+        CoalesceMemoryAccesses(M.get());
+    }
+
+    if (Strength) {
+        ReduceStrength(M.get());
+    }
+
+    if (JumpThread) {
+        JumpThreading(M.get());
+    }
+
+    if (PRE) {
+        PartialRedundancyElimination(M.get());
+    }
+
     if (!NoCSE) {
         CommonSubexpressionElimination(M.get());
     }
 
+    if (Sink) {
+        SinkInstructions(M.get());
+    }
+
     // Collect statistics on Module
     summarize(M.get());
     print_csv_file(OutputFilename);
@@ -250,52 +392,64 @@ static void CommonSubexpressionElimination(Module *M) {
     for(auto f = M->begin(); f!=M->end(); f++)
     {
         // loop over functions
-        for(auto bb= f->begin(); bb!=f->end(); bb++)
-        {
-            // loop over basic blocks
-            for(auto i = bb->begin(); i != bb->end(); )
-            {
+        CommonSubexpressionElimination(&*f);
+    }
+}
 
-                Instruction *ExtractedI = &*i; // extract a pointer to an instr using the iterator i(deref it anf then take its address)
-                if( isDead(*ExtractedI) ) 
-                {
-                    i++;
-                    //ExtractedI->print(errs(), true);
-                    ExtractedI->eraseFromParent();
-                    CSEDead++;
-                    continue;
-                }      
+//***********************Function CommonSubexpressionElimination*****************//
+// runs the CSE scan over a single function
+// used by the module driver above and by later passes (e.g. the inliner)
+// that want to clean up a function they have just changed
+//*******************************************************************************//
 
-                auto simplyInstr = SimplifyInstruction(ExtractedI, M->getDataLayout());
-                if(simplyInstr)
-                {
-                    i++;
-                    //ExtractedI->print(errs(), true);
-                    ExtractedI->replaceAllUsesWith(simplyInstr);
-                    ExtractedI->eraseFromParent();
-                    CSESimplify++;
-                    continue;
-                    
-                }
+void CommonSubexpressionElimination(Function *f)
+{
+    const DataLayout &DL = f->getParent()->getDataLayout();
+    for(auto bb= f->begin(); bb!=f->end(); bb++)
+    {
+        // loop over basic blocks
+        for(auto i = bb->begin(); i != bb->end(); )
+        {
 
-                if(isValidForCSE(*ExtractedI))
-                {
-                    sameBBScan(i);
-                    
-                    domBBScan(i);
-                }
+            Instruction *ExtractedI = &*i; // extract a pointer to an instr using the iterator i(deref it anf then take its address)
+            if( isDead(*ExtractedI) ) 
+            {
+                i++;
+                //ExtractedI->print(errs(), true);
+                ExtractedI->eraseFromParent();
+                CSEDead++;
+                continue;
+            }      
+
+            auto simplyInstr = SimplifyInstruction(ExtractedI, DL);
+            if(simplyInstr)
+            {
+                i++;
+                //ExtractedI->print(errs(), true);
+                ExtractedI->replaceAllUsesWith(simplyInstr);
+                ExtractedI->eraseFromParent();
+                CSESimplify++;
+                continue;
+                
+            }
 
-                if(ExtractedI->getOpcode() == Instruction::Load){
-                    eliminateLoad(i);
-                }
+            if(isValidForCSE(*ExtractedI))
+            {
+                sameBBScan(i);
+                
+                domBBScan(i);
+            }
 
-                if(ExtractedI->getOpcode() == Instruction::Store){
-                    eliminateStore(i);
-                    if(inc_flag) continue;
-                }
+            if(ExtractedI->getOpcode() == Instruction::Load){
+                eliminateLoad(i);
+            }
 
-                i++;
+            if(ExtractedI->getOpcode() == Instruction::Store){
+                eliminateStore(i);
+                if(inc_flag) continue;
             }
+
+            i++;
         }
     }
 }
@@ -0,0 +1,395 @@
+/*
+ * File: pointsto.cpp
+ *
+ * Description:
+ *   Flow- and field-insensitive, unification-based points-to analysis
+ *   used by pool allocation. It gives each pointer one class of
+ *   objects, so a linked structure whose nodes point to each other ends up
+ *   as one class containing the malloc sites that build it.
+ */
+#include <set>
+
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+#include "pointsto.h"
+
+using namespace llvm;
+
+bool isPointerish(Type *T)
+{
+    if (T->isPointerTy())
+        return true;
+    if (auto *ST = dyn_cast<StructType>(T)) {
+        for (Type *E : ST->elements())
+            if (isPointerish(E))
+                return true;
+        return false;
+    }
+    if (auto *AT = dyn_cast<ArrayType>(T))
+        return isPointerish(AT->getElementType());
+    if (auto *VT = dyn_cast<VectorType>(T))
+        return isPointerish(VT->getElementType());
+    return false;
+}
+
+//***********************Function isHarmlessExternal***********************//
+// library calls that may read or write the bytes behind a pointer but
+// never keep the pointer; the exceptions are handled in visitCall: some
+// return their first argument, and strto* store a pointer into it
+// through the second
+//*************************************************************************//
+
+static bool isHarmlessExternal(StringRef name)
+{
+    static const StringSet<> harmless = {
+        "printf", "fprintf", "sprintf", "snprintf", "puts", "fputs", "putchar",
+        "fputc", "putc", "scanf", "fscanf", "sscanf", "fgets", "fread", "fwrite",
+        "strlen", "strcmp", "strncmp", "strcpy", "strncpy", "strcat", "memcmp",
+        "atoi", "atol", "atof", "strtol", "strtoul", "strtod", "perror", "exit",
+        "abort", "free"};
+    return harmless.count(name) != 0;
+}
+
+// harmless externals whose pointer result is their first argument
+static bool returnsFirstArg(StringRef name)
+{
+    return name == "strcpy" || name == "strncpy" || name == "strcat" || name == "fgets";
+}
+
+// harmless externals that store a pointer into their first argument
+// through their second (the end pointer)
+static bool storesEndPointer(StringRef name)
+{
+    return name == "strtol" || name == "strtoul" || name == "strtod";
+}
+
+PointsToGraph::PointsToGraph(Module *M) : M(M)
+{
+    for (auto g = M->global_begin(); g != M->global_end(); g++) {
+        int n = nodeFor(&*g);
+        if (!g->hasDefinitiveInitializer())
+            markExternal(n);
+        else
+            visitGlobalInit(n, g->getInitializer());
+    }
+
+    // A module that defines main is a whole program (wolfbench links every
+    // source file first), so only main and address-taken functions can be
+    // called from code we cannot see.
+    Function *Main = M->getFunction("main");
+    bool wholeProgram = Main && !Main->isDeclaration();
+
+    for (auto f = M->begin(); f != M->end(); f++) {
+        bool entry = f->hasAddressTaken() || &*f == Main ||
+                     (!wholeProgram && !f->hasLocalLinkage());
+        for (Argument &A : f->args())
+            if (entry && isPointerish(A.getType()))
+                markExternal(nodeFor(&A));
+        for (BasicBlock &BB : *f)
+            for (Instruction &I : BB)
+                visitInstruction(I);
+    }
+}
+
+int PointsToGraph::newNode()
+{
+    Node n;
+    n.parent = nodes.size();
+    n.pointee = -1;
+    n.external = n.global = n.stack = false;
+    nodes.push_back(n);
+    return n.parent;
+}
+
+int PointsToGraph::find(int n)
+{
+    while (nodes[n].parent != n) {
+        nodes[n].parent = nodes[nodes[n].parent].parent;
+        n = nodes[n].parent;
+    }
+    return n;
+}
+
+int PointsToGraph::unify(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a == b)
+        return a;
+
+    nodes[b].parent = a;
+    nodes[a].external |= nodes[b].external;
+    nodes[a].global |= nodes[b].global;
+    nodes[a].stack |= nodes[b].stack;
+    nodes[a].heapSites.insert(nodes[a].heapSites.end(),
+                              nodes[b].heapSites.begin(), nodes[b].heapSites.end());
+    nodes[b].heapSites.clear();
+
+    int pa = nodes[a].pointee, pb = nodes[b].pointee;
+    if (pa < 0)
+        nodes[a].pointee = pb;
+    else if (pb >= 0)
+        unify(pa, pb);
+    return find(a);
+}
+
+int PointsToGraph::pointee(int n)
+{
+    n = find(n);
+    if (nodes[n].pointee < 0) {
+        int p = newNode();
+        nodes[n].pointee = p;
+    }
+    return find(nodes[n].pointee);
+}
+
+void PointsToGraph::markExternal(int n)
+{
+    // Classes reached from here are external too; reachableFromExternal()
+    // follows the pointees when asked, since they may be unified later.
+    node(n).external = true;
+}
+
+int PointsToGraph::nodeFor(Value *V)
+{
+    if (auto *CE = dyn_cast<ConstantExpr>(V)) {
+        if (CE->getOpcode() == Instruction::BitCast ||
+            CE->getOpcode() == Instruction::GetElementPtr ||
+            CE->getOpcode() == Instruction::AddrSpaceCast)
+            return nodeFor(CE->getOperand(0));
+        int n = newNode();
+        markExternal(n);
+        return n;
+    }
+    // Every null gets its own class so that null checks do not merge
+    // unrelated structures.
+    if (isa<ConstantPointerNull>(V) || isa<UndefValue>(V) ||
+        isa<ConstantAggregateZero>(V))
+        return newNode();
+
+    auto it = valueNode.find(V);
+    if (it != valueNode.end())
+        return find(it->second);
+
+    int n = newNode();
+    valueNode[V] = n;
+    if (isa<GlobalVariable>(V))
+        nodes[n].global = true;
+    else if (isa<AllocaInst>(V))
+        nodes[n].stack = true;
+    return n;
+}
+
+int PointsToGraph::returnFor(Function *F)
+{
+    auto it = retNode.find(F);
+    if (it != retNode.end())
+        return find(it->second);
+    int n = newNode();
+    retNode[F] = n;
+    return n;
+}
+
+void PointsToGraph::visitGlobalInit(int n, Constant *C)
+{
+    if (isa<GlobalValue>(C) || isa<ConstantExpr>(C)) {
+        if (C->getType()->isPointerTy())
+            unify(pointee(n), nodeFor(C));
+        return;
+    }
+    for (unsigned i = 0; i < C->getNumOperands(); i++)
+        if (auto *Op = dyn_cast<Constant>(C->getOperand(i)))
+            visitGlobalInit(n, Op);
+}
+
+void PointsToGraph::visitCall(CallBase *CB)
+{
+    Function *Callee = CB->getCalledFunction();
+    bool pointerResult = isPointerish(CB->getType());
+
+    if (auto *MI = dyn_cast<MemTransferInst>(CB)) {
+        unify(pointee(nodeFor(MI->getRawDest())), pointee(nodeFor(MI->getRawSource())));
+        return;
+    }
+    if (isa<IntrinsicInst>(CB))
+        return;
+
+    if (Callee && Callee->getName() == "malloc" && Callee->isDeclaration() &&
+        isa<CallInst>(CB)) {
+        int n = nodeFor(CB);
+        node(n).heapSites.push_back(cast<CallInst>(CB));
+        return;
+    }
+
+    if (Callee && !Callee->isDeclaration()) {
+        unsigned a = 0;
+        for (Argument &Formal : Callee->args()) {
+            if (a >= CB->arg_size())
+                break;
+            if (isPointerish(Formal.getType()))
+                unify(nodeFor(&Formal), nodeFor(CB->getArgOperand(a)));
+            a++;
+        }
+        for (; a < CB->arg_size(); a++)
+            if (isPointerish(CB->getArgOperand(a)->getType()))
+                markExternal(nodeFor(CB->getArgOperand(a)));
+        if (pointerResult)
+            unify(nodeFor(CB), returnFor(Callee));
+        return;
+    }
+
+    bool harmless = Callee && isHarmlessExternal(Callee->getName());
+    for (unsigned a = 0; a < CB->arg_size(); a++)
+        if (isPointerish(CB->getArgOperand(a)->getType()) && !harmless)
+            markExternal(nodeFor(CB->getArgOperand(a)));
+    if (harmless && storesEndPointer(Callee->getName()) && CB->arg_size() >= 2)
+        unify(pointee(nodeFor(CB->getArgOperand(1))), nodeFor(CB->getArgOperand(0)));
+    if (harmless && returnsFirstArg(Callee->getName()) && CB->arg_size() >= 1 && pointerResult)
+        unify(nodeFor(CB), nodeFor(CB->getArgOperand(0)));
+    else if (pointerResult)
+        markExternal(nodeFor(CB));
+}
+
+void PointsToGraph::visitInstruction(Instruction &I)
+{
+    if (auto *CB = dyn_cast<CallBase>(&I)) {
+        visitCall(CB);
+        return;
+    }
+
+    switch (I.getOpcode()) {
+    case Instruction::Alloca:
+        nodeFor(&I);
+        break;
+    case Instruction::Load:
+        if (isPointerish(I.getType()))
+            unify(nodeFor(&I), pointee(nodeFor(I.getOperand(0))));
+        else
+            nodeFor(I.getOperand(0));
+        break;
+    case Instruction::Store: {
+        auto *SI = cast<StoreInst>(&I);
+        if (isPointerish(SI->getValueOperand()->getType()))
+            unify(nodeFor(SI->getValueOperand()), pointee(nodeFor(SI->getPointerOperand())));
+        else
+            nodeFor(SI->getPointerOperand());
+        break;
+    }
+    case Instruction::BitCast:
+    case Instruction::AddrSpaceCast:
+    case Instruction::GetElementPtr:
+        if (isPointerish(I.getType()))
+            unify(nodeFor(&I), nodeFor(I.getOperand(0)));
+        break;
+    case Instruction::PHI:
+    case Instruction::Select:
+        if (isPointerish(I.getType()))
+            for (Value *Op : I.operands())
+                if (Op->getType() == I.getType())
+                    unify(nodeFor(&I), nodeFor(Op));
+        break;
+    case Instruction::ExtractValue:
+    case Instruction::InsertValue:
+        if (isPointerish(I.getType()))
+            for (Value *Op : I.operands())
+                if (isPointerish(Op->getType()))
+                    unify(nodeFor(&I), nodeFor(Op));
+        break;
+    case Instruction::Ret:
+        if (I.getNumOperands() == 1 && isPointerish(I.getOperand(0)->getType()))
+            unify(returnFor(I.getFunction()), nodeFor(I.getOperand(0)));
+        break;
+    case Instruction::PtrToInt:
+        markExternal(nodeFor(I.getOperand(0)));
+        break;
+    case Instruction::IntToPtr:
+        markExternal(nodeFor(&I));
+        break;
+    default:
+        // Anything else that produces a pointer comes from somewhere we do
+        // not model.
+        if (isPointerish(I.getType()))
+            markExternal(nodeFor(&I));
+        break;
+    }
+}
+
+int PointsToGraph::classOf(Value *V)
+{
+    if (auto *CE = dyn_cast<ConstantExpr>(V))
+        return classOf(CE->getOperand(0));
+    auto it = valueNode.find(V);
+    if (it == valueNode.end())
+        return -1;
+    return find(it->second);
+}
+
+int PointsToGraph::pointeeOf(int n)
+{
+    n = find(n);
+    return nodes[n].pointee < 0 ? -1 : find(nodes[n].pointee);
+}
+
+std::vector<int> PointsToGraph::classes()
+{
+    std::vector<int> reps;
+    for (unsigned n = 0; n < nodes.size(); n++)
+        if (find(n) == (int)n)
+            reps.push_back(n);
+    return reps;
+}
+
+bool PointsToGraph::isPointedToBy(int from, int n)
+{
+    std::set<int> seen;
+    n = find(n);
+    for (int p = pointeeOf(from); p >= 0 && seen.insert(p).second; p = pointeeOf(p))
+        if (p == n)
+            return true;
+    return false;
+}
+
+bool PointsToGraph::reachableFromGlobals(int n)
+{
+    n = find(n);
+    for (int c : classes())
+        if (nodes[c].global && (c == n || isPointedToBy(c, n)))
+            return true;
+    return false;
+}
+
+bool PointsToGraph::reachableFromExternal(int n)
+{
+    n = find(n);
+    for (int c : classes())
+        if (nodes[c].external && (c == n || isPointedToBy(c, n)))
+            return true;
+    return false;
+}
+
+std::vector<Function *> PointsToGraph::touchingFunctions(int n)
+{
+    n = find(n);
+    std::set<Function *> touching;
+    for (auto &p : valueNode) {
+        if (find(p.second) != n)
+            continue;
+        if (auto *I = dyn_cast<Instruction>(p.first))
+            touching.insert(I->getFunction());
+        else if (auto *A = dyn_cast<Argument>(p.first))
+            touching.insert(A->getParent());
+    }
+    // Uses of pointers we did not record (e.g. a GEP on a global that only
+    // appears as an operand) still count.
+    for (auto f = M->begin(); f != M->end(); f++)
+        for (BasicBlock &BB : *f)
+            for (Instruction &I : BB)
+                for (Value *Op : I.operands())
+                    if (isa<GlobalVariable>(Op->stripPointerCasts()) &&
+                        classOf(Op->stripPointerCasts()) == n)
+                        touching.insert(&*f);
+    return std::vector<Function *>(touching.begin(), touching.end());
+}
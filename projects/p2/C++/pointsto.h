@@ -0,0 +1,70 @@
+#ifndef POINTSTO_H
+#define POINTSTO_H
+
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+/* Whole-module, unification-based (Steensgaard style) points-to graph.
+   Each node stands for a class of memory objects; every pointer value
+   points into exactly one class, and every class has at most one pointee
+   class (fields are not distinguished). Nodes are plain indices, call
+   find() before comparing them. */
+class PointsToGraph {
+public:
+    struct Node {
+        int parent;
+        int pointee;
+        bool external;  // reachable by code we cannot see
+        bool global;    // holds a global variable
+        bool stack;     // holds an alloca
+        std::vector<llvm::CallInst *> heapSites;  // mallocs in this class
+    };
+
+    explicit PointsToGraph(llvm::Module *M);
+
+    int find(int n);
+    Node &node(int n) { return nodes[find(n)]; }
+
+    /* Class V points into, or -1 if V is not a pointer we saw. */
+    int classOf(llvm::Value *V);
+
+    /* Pointee class of n, or -1 if nothing is stored in n's objects. */
+    int pointeeOf(int n);
+
+    /* All class representatives. */
+    std::vector<int> classes();
+
+    /* True if class n is reachable from a global or from external code. */
+    bool reachableFromGlobals(int n);
+    bool reachableFromExternal(int n);
+
+    /* Functions with an instruction or argument that points into n. */
+    std::vector<llvm::Function *> touchingFunctions(int n);
+
+    /* True if a pointer into a class other than n points to n. */
+    bool isPointedToBy(int from, int n);
+
+private:
+    std::vector<Node> nodes;
+    llvm::DenseMap<llvm::Value *, int> valueNode;
+    llvm::DenseMap<llvm::Function *, int> retNode;
+    llvm::Module *M;
+
+    int newNode();
+    int unify(int a, int b);
+    int pointee(int n);
+    int nodeFor(llvm::Value *V);
+    int returnFor(llvm::Function *F);
+    void markExternal(int n);
+    void visitGlobalInit(int n, llvm::Constant *C);
+    void visitCall(llvm::CallBase *CB);
+    void visitInstruction(llvm::Instruction &I);
+};
+
+/* True if T is a pointer or an aggregate that holds one. */
+bool isPointerish(llvm::Type *T);
+
+#endif
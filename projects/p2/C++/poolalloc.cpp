@@ -0,0 +1,199 @@
+/*
+ * File: poolalloc.cpp
+ *
+ * Description:
+ *   Automatic pool allocation. The points-to graph groups the malloc sites
+ *   that build one data structure into a single class. Each heap class
+ *   that is invisible to external code gets its own pool. Its mallocs
+ *   become pool_alloc and the frees of its pointers become pool_free, so
+ *   nodes that are traversed together are allocated next to each other.
+ *
+ *   A pool lives as long as the function that owns it. If every function
+ *   touching the class (and every class pointing to it) is one
+ *   non-recursive function, the descriptor is a local of that function:
+ *   created at entry and destroyed at each return. Otherwise the pool is a
+ *   global, created at the top of main and destroyed when main returns.
+ */
+#include <algorithm>
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "pointsto.h"
+#include "poolalloc.h"
+
+using namespace llvm;
+
+static llvm::Statistic PoolsCreated = {"", "PoolsCreated", "Pool allocation pools created"};
+static llvm::Statistic PoolsLocal = {"", "PoolsLocal", "Pool allocation pools owned by a single function"};
+static llvm::Statistic PoolAllocs = {"", "PoolAllocs", "Pool allocation mallocs redirected"};
+static llvm::Statistic PoolFrees = {"", "PoolFrees", "Pool allocation frees redirected"};
+
+// runtime/poolalloc.c checks that its descriptor fits in this many words
+static const unsigned PoolDescriptorWords = 8;
+
+struct PoolRuntime {
+    FunctionCallee init, alloc, free, destroy;
+    Type *descriptorTy;
+};
+
+static PoolRuntime getRuntime(Module *M)
+{
+    LLVMContext &C = M->getContext();
+    Type *VoidTy = Type::getVoidTy(C);
+    Type *I8PtrTy = Type::getInt8PtrTy(C);
+    Type *SizeTy = M->getDataLayout().getIntPtrType(C);
+
+    PoolRuntime rt;
+    rt.init = M->getOrInsertFunction("pool_init", VoidTy, I8PtrTy);
+    rt.alloc = M->getOrInsertFunction("pool_alloc", I8PtrTy, I8PtrTy, SizeTy);
+    rt.free = M->getOrInsertFunction("pool_free", VoidTy, I8PtrTy, I8PtrTy);
+    rt.destroy = M->getOrInsertFunction("pool_destroy", VoidTy, I8PtrTy);
+    rt.descriptorTy = ArrayType::get(Type::getInt64Ty(C), PoolDescriptorWords);
+    return rt;
+}
+
+static bool isRecursive(Function *F)
+{
+    for (User *U : F->users())
+        if (auto *CB = dyn_cast<CallBase>(U))
+            if (CB->getFunction() == F)
+                return true;
+    return false;
+}
+
+//***********************Function owningFunction***************************//
+// the single function that sees every pointer into class n (directly or
+// through another class that points to n), or null if the pool has to
+// live for the whole program
+//*************************************************************************//
+
+static Function *owningFunction(PointsToGraph &PT, int n)
+{
+    if (PT.reachableFromGlobals(n))
+        return nullptr;
+
+    std::vector<Function *> touching = PT.touchingFunctions(n);
+    if (touching.size() != 1 || isRecursive(touching[0]))
+        return nullptr;
+    Function *F = touching[0];
+
+    for (int c : PT.classes()) {
+        if (c == PT.find(n) || !PT.isPointedToBy(c, n))
+            continue;
+        std::vector<Function *> others = PT.touchingFunctions(c);
+        if (others.size() > 1 || (others.size() == 1 && others[0] != F))
+            return nullptr;
+    }
+    return F;
+}
+
+//***********************Function createPool*******************************//
+// materialize a descriptor (a local of Owner, or a global when Owner is
+// main and the pool must outlive every other function) and bracket the
+// owner's body with pool_init / pool_destroy
+//*************************************************************************//
+
+static Value *createPool(Module *M, PoolRuntime &rt, Function *Owner, bool local)
+{
+    Type *I8PtrTy = Type::getInt8PtrTy(M->getContext());
+    BasicBlock &Entry = Owner->getEntryBlock();
+    IRBuilder<> B(&*Entry.getFirstInsertionPt());
+
+    Value *pool;
+    if (local) {
+        AllocaInst *AI = B.CreateAlloca(rt.descriptorTy, nullptr, "pool");
+        pool = B.CreateBitCast(AI, I8PtrTy);
+    } else {
+        auto *G = new GlobalVariable(*M, rt.descriptorTy, false,
+                                     GlobalValue::InternalLinkage,
+                                     Constant::getNullValue(rt.descriptorTy), "pool");
+        pool = ConstantExpr::getBitCast(G, I8PtrTy);
+    }
+    B.CreateCall(rt.init, {pool});
+
+    for (BasicBlock &BB : *Owner)
+        if (auto *RI = dyn_cast<ReturnInst>(BB.getTerminator())) {
+            IRBuilder<> R(RI);
+            R.CreateCall(rt.destroy, {pool});
+        }
+    return pool;
+}
+
+static void redirectMalloc(CallInst *CI, Value *pool, PoolRuntime &rt)
+{
+    IRBuilder<> B(CI);
+    Type *SizeTy = rt.alloc.getFunctionType()->getParamType(1);
+    Value *size = B.CreateZExtOrTrunc(CI->getArgOperand(0), SizeTy);
+    CallInst *NewCI = B.CreateCall(rt.alloc, {pool, size});
+    NewCI->takeName(CI);
+    Value *result = B.CreateBitCast(NewCI, CI->getType());
+    CI->replaceAllUsesWith(result);
+    CI->eraseFromParent();
+    PoolAllocs++;
+}
+
+static void redirectFree(CallInst *CI, Value *pool, PoolRuntime &rt)
+{
+    IRBuilder<> B(CI);
+    Value *ptr = B.CreateBitCast(CI->getArgOperand(0), Type::getInt8PtrTy(CI->getContext()));
+    B.CreateCall(rt.free, {pool, ptr});
+    CI->eraseFromParent();
+    PoolFrees++;
+}
+
+void PoolAllocation(Module *M)
+{
+    Function *Main = M->getFunction("main");
+    if (Main && Main->isDeclaration())
+        Main = nullptr;
+
+    PointsToGraph PT(M);
+
+    // Decide everything before changing the IR: the graph refers to the
+    // original malloc and free calls.
+    std::vector<std::pair<int, Function *>> pools;
+    for (int c : PT.classes()) {
+        if (PT.node(c).heapSites.empty() || PT.reachableFromExternal(c))
+            continue;
+        Function *Owner = owningFunction(PT, c);
+        if (!Owner && !Main)
+            continue;
+        pools.push_back(std::make_pair(c, Owner));
+    }
+    if (pools.empty())
+        return;
+
+    std::vector<std::pair<CallInst *, int>> frees;
+    for (auto f = M->begin(); f != M->end(); f++)
+        for (BasicBlock &BB : *f)
+            for (Instruction &I : BB)
+                if (auto *CI = dyn_cast<CallInst>(&I)) {
+                    Function *Callee = CI->getCalledFunction();
+                    if (Callee && Callee->isDeclaration() && Callee->getName() == "free" &&
+                        CI->arg_size() == 1)
+                        frees.push_back(std::make_pair(CI, PT.classOf(CI->getArgOperand(0))));
+                }
+
+    PoolRuntime rt = getRuntime(M);
+    for (auto &p : pools) {
+        int c = p.first;
+        bool local = p.second != nullptr;
+        Value *pool = createPool(M, rt, local ? p.second : Main, local);
+        PoolsCreated++;
+        if (local)
+            PoolsLocal++;
+
+        for (CallInst *CI : PT.node(c).heapSites)
+            redirectMalloc(CI, pool, rt);
+        for (auto &fr : frees)
+            if (fr.first && fr.second >= 0 && PT.find(fr.second) == PT.find(c)) {
+                redirectFree(fr.first, pool, rt);
+                fr.first = nullptr;
+            }
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef POOLALLOC_H
+#define POOLALLOC_H
+
+#include "llvm/IR/Module.h"
+
+/* Give every disjoint heap data structure its own bump-pointer pool.
+   Transformed programs must be linked with runtime/poolalloc.c (libp2rt). */
+void PoolAllocation(llvm::Module *M);
+
+#endif
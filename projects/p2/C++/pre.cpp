@@ -0,0 +1,350 @@
+/*
+ * File: pre.cpp
+ *
+ * Description:
+ *   Partial redundancy elimination by lazy code motion (Knoop, Ruthing
+ *   and Steffen, "Lazy Code Motion", PLDI 1992; edge placement as in
+ *   Drechsler and Stadel). CSE only removes an expression that an
+ *   identical one dominates. This pass also removes those that are
+ *   computed on some of the paths into a block, by computing them on the
+ *   other paths as well.
+ *
+ *   Expressions are pure, non-trapping instructions (binary operators,
+ *   icmp, casts, GEPs, selects) with the same operands. In SSA the only
+ *   "kill" of an expression is the definition of one of its operands.
+ *   Only expressions that occur in two or more blocks are tracked.
+ *
+ *   Per block, with one bit per expression:
+ *     ANTLOC   computed in the block, with no operand defined there
+ *     COMP     computed in the block
+ *     TRANSP   no operand defined in the block
+ *     AVIN/AVOUT    available (forward, all paths)
+ *     ANTIN/ANTOUT  anticipated (backward, all paths)
+ *     EARLIEST(i,j) = ANTIN(j) & ~AVOUT(i) & (~TRANSP(i) | ~ANTOUT(i))
+ *     LATER(i,j)    = EARLIEST(i,j) | (LATERIN(i) & ~ANTLOC(i))
+ *     LATERIN(j)    = AND of LATER(i,j) over the predecessors i
+ *     INSERT(i,j)   = LATER(i,j) & ~LATERIN(j)
+ *     DELETE(j)     = ANTLOC(j) & ~LATERIN(j)
+ *
+ *   Computations are inserted on the INSERT edges:
+ *   - at the end of the source if it has one successor;
+ *   - otherwise at the start of the target if it has one predecessor;
+ *   - otherwise in a new block that splits the critical edge.
+ *   The first occurrence in each DELETE block is replaced by the value
+ *   that reaches it, with SSAUpdater adding the phis. Placement is as
+ *   late as possible, so no path computes an expression more often than
+ *   before and temporaries live no longer than needed.
+ */
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+#include "pre.h"
+
+using namespace llvm;
+
+static llvm::Statistic PREInserted = {"", "PREInserted", "PRE computations inserted on edges"};
+static llvm::Statistic PREDeleted = {"", "PREDeleted", "PRE redundant computations removed"};
+static llvm::Statistic PRESplit = {"", "PRESplit", "PRE critical edges split"};
+
+// functions whose bit vectors would need more bits than this are skipped
+static const uint64_t MaxPREBits = 1 << 26;
+
+static bool isCandidate(Instruction &I)
+{
+    return (isa<BinaryOperator>(&I) || isa<ICmpInst>(&I) || isa<CastInst>(&I) ||
+            isa<GetElementPtrInst>(&I) || isa<SelectInst>(&I)) &&
+           isSafeToSpeculativelyExecute(&I);
+}
+
+struct Expression {
+    Instruction *rep;
+    // occurrences per block, in block order
+    std::map<unsigned, std::vector<Instruction *>> occ;
+};
+
+struct Edge {
+    unsigned from, to;
+};
+
+struct LCM {
+    std::vector<BasicBlock *> blocks;
+    DenseMap<BasicBlock *, unsigned> index;
+    std::vector<std::vector<unsigned>> preds, succs;
+    std::vector<Expression> exprs;
+    std::vector<BitVector> antloc, comp, transp, avout, antin, antout, laterin;
+    std::vector<Edge> edges;
+
+    explicit LCM(Function &F)
+    {
+        ReversePostOrderTraversal<Function *> RPOT(&F);
+        for (BasicBlock *BB : RPOT) {
+            index[BB] = blocks.size();
+            blocks.push_back(BB);
+        }
+        preds.resize(blocks.size());
+        succs.resize(blocks.size());
+        for (unsigned b = 0; b < blocks.size(); b++)
+            for (BasicBlock *S : successors(blocks[b])) {
+                unsigned s = index.lookup(S);
+                if (is_contained(succs[b], s))
+                    continue;
+                succs[b].push_back(s);
+                preds[s].push_back(b);
+                edges.push_back({b, s});
+            }
+    }
+
+    //***********************Function collect******************************//
+    // group identical candidates; keep those that occur in two or more
+    // blocks
+    //*********************************************************************//
+
+    void collect()
+    {
+        std::map<std::pair<unsigned, std::vector<Value *>>, std::vector<unsigned>> buckets;
+        std::vector<Expression> all;
+        for (unsigned b = 0; b < blocks.size(); b++)
+            for (Instruction &I : *blocks[b]) {
+                if (!isCandidate(I))
+                    continue;
+                std::vector<Value *> ops(I.op_begin(), I.op_end());
+                auto &bucket = buckets[std::make_pair(I.getOpcode(), ops)];
+                unsigned e = all.size();
+                for (unsigned c : bucket)
+                    if (all[c].rep->isIdenticalTo(&I)) {
+                        e = c;
+                        break;
+                    }
+                if (e == all.size()) {
+                    bucket.push_back(e);
+                    all.push_back(Expression{&I, {}});
+                }
+                all[e].occ[b].push_back(&I);
+            }
+        for (Expression &E : all)
+            if (E.occ.size() > 1)
+                exprs.push_back(E);
+    }
+
+    void localProperties()
+    {
+        unsigned n = exprs.size();
+        antloc.assign(blocks.size(), BitVector(n));
+        comp.assign(blocks.size(), BitVector(n));
+        transp.assign(blocks.size(), BitVector(n, true));
+        for (unsigned e = 0; e < n; e++) {
+            for (Value *Op : exprs[e].rep->operands())
+                if (auto *OpI = dyn_cast<Instruction>(Op)) {
+                    auto it = index.find(OpI->getParent());
+                    if (it != index.end())
+                        transp[it->second].reset(e);
+                }
+            for (auto &o : exprs[e].occ) {
+                comp[o.first].set(e);
+                if (transp[o.first].test(e))
+                    antloc[o.first].set(e);
+            }
+        }
+    }
+
+    BitVector earliest(const Edge &E)
+    {
+        BitVector r = antin[E.to], notAv = avout[E.from], kill = transp[E.from];
+        notAv.flip();
+        kill &= antout[E.from];
+        kill.flip();
+        r &= notAv;
+        r &= kill;
+        return r;
+    }
+
+    BitVector later(const Edge &E)
+    {
+        BitVector r = laterin[E.from], notLoc = antloc[E.from];
+        notLoc.flip();
+        r &= notLoc;
+        r |= earliest(E);
+        return r;
+    }
+
+    void solve()
+    {
+        unsigned n = exprs.size(), N = blocks.size();
+        bool changed;
+
+        // availability, forward; the entry is block 0 in reverse post order
+        avout.assign(N, BitVector(n, true));
+        do {
+            changed = false;
+            for (unsigned b = 0; b < N; b++) {
+                BitVector in(n, b != 0);
+                for (unsigned p : preds[b])
+                    in &= avout[p];
+                in &= transp[b];
+                in |= comp[b];
+                if (in != avout[b]) {
+                    avout[b] = in;
+                    changed = true;
+                }
+            }
+        } while (changed);
+
+        // anticipability, backward
+        antin.assign(N, BitVector(n, true));
+        antout.assign(N, BitVector(n));
+        do {
+            changed = false;
+            for (unsigned b = N; b-- > 0;) {
+                BitVector out(n, !succs[b].empty());
+                for (unsigned s : succs[b])
+                    out &= antin[s];
+                antout[b] = out;
+                out &= transp[b];
+                out |= antloc[b];
+                if (out != antin[b]) {
+                    antin[b] = out;
+                    changed = true;
+                }
+            }
+        } while (changed);
+
+        // the virtual edge into the entry is the earliest point of all
+        // that the entry anticipates
+        laterin.assign(N, BitVector(n, true));
+        laterin[0] = antin[0];
+        do {
+            changed = false;
+            for (unsigned b = 1; b < N; b++) {
+                BitVector in(n, true);
+                for (unsigned p : preds[b])
+                    in &= later(Edge{p, b});
+                if (in != laterin[b]) {
+                    laterin[b] = in;
+                    changed = true;
+                }
+            }
+        } while (changed);
+    }
+};
+
+//***********************Function insertionPoint*****************************//
+// where a computation on the edge From->To goes, splitting the edge if it
+// is critical; null if it cannot be split
+//***************************************************************************//
+
+static Instruction *insertionPoint(BasicBlock *From, BasicBlock *To)
+{
+    Instruction *TI = From->getTerminator();
+    if (TI->getNumSuccessors() == 1)
+        return TI;
+    if (To->getUniquePredecessor() && !To->isEHPad())
+        return &*To->getFirstInsertionPt();
+    if (isa<IndirectBrInst>(TI) || isa<CallBrInst>(TI) || To->isEHPad())
+        return nullptr;
+    BasicBlock *Mid = SplitCriticalEdge(TI, GetSuccessorNumber(From, To),
+                                        CriticalEdgeSplittingOptions().setMergeIdenticalEdges());
+    if (!Mid)
+        return nullptr;
+    PRESplit++;
+    return Mid->getTerminator();
+}
+
+static void preFunction(Function &F)
+{
+    LCM L(F);
+    L.collect();
+    unsigned n = L.exprs.size();
+    if (n == 0 || (uint64_t)n * L.blocks.size() > MaxPREBits)
+        return;
+    L.localProperties();
+    L.solve();
+
+    std::vector<BitVector> insert;
+    BitVector any(n);
+    for (const Edge &E : L.edges) {
+        BitVector notIn = L.laterin[E.to];
+        notIn.flip();
+        BitVector ins = L.later(E);
+        ins &= notIn;
+        insert.push_back(ins);
+        any |= ins;
+    }
+    std::vector<BitVector> del(L.blocks.size());
+    for (unsigned b = 0; b < L.blocks.size(); b++) {
+        BitVector notIn = L.laterin[b];
+        notIn.flip();
+        del[b] = L.antloc[b];
+        del[b] &= notIn;
+        any |= del[b];
+    }
+    if (any.none())
+        return;
+
+    // find (and split) the insertion points before changing any expression;
+    // an expression with an edge that cannot take it is left alone
+    std::vector<Instruction *> at(L.edges.size(), nullptr);
+    BitVector skip(n);
+    for (unsigned k = 0; k < L.edges.size(); k++) {
+        if (insert[k].none())
+            continue;
+        at[k] = insertionPoint(L.blocks[L.edges[k].from], L.blocks[L.edges[k].to]);
+        if (!at[k])
+            skip |= insert[k];
+    }
+
+    for (unsigned e = 0; e < n; e++) {
+        if (skip.test(e) || !any.test(e))
+            continue;
+        Expression &X = L.exprs[e];
+        std::string name = X.rep->getName().str();
+        SSAUpdater SSA;
+        SSA.Initialize(X.rep->getType(), name.empty() ? name : name + ".pre.phi");
+
+        for (unsigned k = 0; k < L.edges.size(); k++) {
+            if (!insert[k].test(e))
+                continue;
+            Instruction *C = X.rep->clone();
+            C->insertBefore(at[k]);
+            if (!name.empty())
+                C->setName(name + ".pre");
+            SSA.AddAvailableValue(C->getParent(), C);
+            PREInserted++;
+        }
+        for (auto &o : X.occ)
+            if (!del[o.first].test(e))
+                SSA.AddAvailableValue(L.blocks[o.first], o.second.front());
+
+        for (auto &o : X.occ) {
+            if (!del[o.first].test(e))
+                continue;
+            Value *V = SSA.GetValueInMiddleOfBlock(L.blocks[o.first]);
+            if (isa<UndefValue>(V))
+                continue;
+            for (Instruction *I : o.second) {
+                I->replaceAllUsesWith(V);
+                I->eraseFromParent();
+            }
+            PREDeleted++;
+        }
+    }
+}
+
+void PartialRedundancyElimination(Module *M)
+{
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration())
+            preFunction(*f);
+}
@@ -0,0 +1,11 @@
+#ifndef PRE_H
+#define PRE_H
+
+#include "llvm/IR/Module.h"
+
+/* Lazy code motion: insert computations on the edges where an expression
+   is missing so that its partially redundant occurrences can be removed,
+   without lengthening any path. */
+void PartialRedundancyElimination(llvm::Module *M);
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * File: ptrcompress.cpp
+ *
+ * Description:
+ *   Pointer compression for linked data structures. Take a type-safe
+ *   struct S (see typesafe.h) with a field of type T*, where T is type-safe
+ *   too. The field becomes an i32 that holds the object's offset, in 8-byte
+ *   units, from the start of one region that runtime/ptrcompress.c
+ *   reserves. S is replaced by a new type S.pc, so a node such as
+ *   { i32, node* } shrinks from 16 to 8 bytes. Every malloc of the affected
+ *   types becomes pc_alloc with the new size. Pointer registers keep their
+ *   type. Only the field loads and stores pay for decompression (base plus
+ *   index) and compression (pointer minus base).
+ *
+ *   The region holds 4 GB. Once it is full, pc_alloc falls back to malloc.
+ *   Pointers to those objects are stored as handles with the top bit set,
+ *   which the runtime maps back to the pointer. The inline fast path only
+ *   tests for that bit.
+ */
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include "ptrcompress.h"
+#include "typesafe.h"
+
+using namespace llvm;
+
+static llvm::Statistic PCTypes = {"", "PCTypes", "Pointer compression struct types shrunk"};
+static llvm::Statistic PCFields = {"", "PCFields", "Pointer compression fields compressed"};
+static llvm::Statistic PCLoads = {"", "PCLoads", "Pointer compression field loads decompressed"};
+static llvm::Statistic PCStores = {"", "PCStores", "Pointer compression field stores compressed"};
+static llvm::Statistic PCAllocs = {"", "PCAllocs", "Pointer compression mallocs moved to the region"};
+
+// runtime/ptrcompress.c hands out 8-byte aligned objects
+static const unsigned PCIndexShift = 3;
+
+struct PCRuntime {
+    FunctionCallee alloc, free, farIndex, farPointer;
+    GlobalVariable *base, *used;
+};
+
+static PCRuntime getRuntime(Module *M)
+{
+    LLVMContext &C = M->getContext();
+    Type *VoidTy = Type::getVoidTy(C);
+    Type *I8PtrTy = Type::getInt8PtrTy(C);
+    Type *I32Ty = Type::getInt32Ty(C);
+    Type *SizeTy = M->getDataLayout().getIntPtrType(C);
+
+    PCRuntime rt;
+    rt.alloc = M->getOrInsertFunction("pc_alloc", I8PtrTy, SizeTy);
+    rt.free = M->getOrInsertFunction("pc_free", VoidTy, I8PtrTy, SizeTy);
+    rt.farIndex = M->getOrInsertFunction("pc_far_index", I32Ty, I8PtrTy);
+    rt.farPointer = M->getOrInsertFunction("pc_far_pointer", I8PtrTy, I32Ty);
+    rt.base = cast<GlobalVariable>(M->getOrInsertGlobal("pc_region_base", I8PtrTy));
+    rt.used = cast<GlobalVariable>(M->getOrInsertGlobal("pc_region_used", SizeTy));
+    return rt;
+}
+
+static StructType *pointeeStruct(Type *T)
+{
+    auto *PT = dyn_cast<PointerType>(T);
+    if (!PT || PT->isOpaque())
+        return nullptr;
+    return dyn_cast<StructType>(PT->getPointerElementType());
+}
+
+//***********************Function onlyLoadedAndStored**********************//
+// a compressed field's address may only be used to load or store a
+// pointer of its own type; anything else would see the i32
+//*************************************************************************//
+
+static bool onlyLoadedAndStored(GetElementPtrInst *GEP)
+{
+    for (User *U : GEP->users()) {
+        if (auto *LI = dyn_cast<LoadInst>(U)) {
+            if (!LI->isSimple() || LI->getType() != GEP->getResultElementType())
+                return false;
+        } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+            if (!SI->isSimple() || SI->getPointerOperand() != GEP ||
+                SI->getValueOperand()->getType() != GEP->getResultElementType())
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+//***********************Function decompress*******************************//
+// load an index and turn it back into a pointer:
+//   0 -> null, top bit set -> pc_far_pointer(idx), else base + idx*8
+//*************************************************************************//
+
+static void decompress(LoadInst *LI, Value *Field, PCRuntime &rt)
+{
+    LLVMContext &C = LI->getContext();
+    Type *I8PtrTy = Type::getInt8PtrTy(C);
+    Type *SizeTy = rt.used->getValueType();
+    IRBuilder<> B(LI);
+
+    LoadInst *Idx = B.CreateAlignedLoad(B.getInt32Ty(), Field, Align(4), LI->getName() + ".idx");
+    Value *Base = B.CreateLoad(I8PtrTy, rt.base);
+    Value *Off = B.CreateShl(B.CreateZExt(Idx, SizeTy), PCIndexShift);
+    Value *Near = B.CreateSelect(B.CreateICmpEQ(Idx, B.getInt32(0)),
+                                 ConstantPointerNull::get(cast<PointerType>(I8PtrTy)),
+                                 B.CreateInBoundsGEP(B.getInt8Ty(), Base, Off));
+    Value *IsFar = B.CreateICmpSLT(Idx, B.getInt32(0));
+
+    MDNode *Unlikely = MDBuilder(C).createBranchWeights(1, 1 << 20);
+    Instruction *Then = SplitBlockAndInsertIfThen(IsFar, LI, false, Unlikely);
+    IRBuilder<> S(Then);
+    Value *FarPtr = S.CreateCall(rt.farPointer, {Idx});
+
+    B.SetInsertPoint(LI);
+    PHINode *Ptr = B.CreatePHI(I8PtrTy, 2);
+    Ptr->addIncoming(Near, Then->getParent()->getSinglePredecessor());
+    Ptr->addIncoming(FarPtr, Then->getParent());
+    Value *Result = B.CreateBitCast(Ptr, LI->getType());
+    Result->takeName(LI);
+    LI->replaceAllUsesWith(Result);
+    LI->eraseFromParent();
+    PCLoads++;
+}
+
+//***********************Function compress*********************************//
+// store a pointer as an index: null and pointers inside the used part of
+// the region are computed inline, anything else asks pc_far_index
+//*************************************************************************//
+
+static void compress(StoreInst *SI, Value *Field, PCRuntime &rt)
+{
+    LLVMContext &C = SI->getContext();
+    Type *I8PtrTy = Type::getInt8PtrTy(C);
+    Type *SizeTy = rt.used->getValueType();
+    IRBuilder<> B(SI);
+    Value *V = SI->getValueOperand();
+
+    if (isa<ConstantPointerNull>(V)) {
+        B.CreateAlignedStore(B.getInt32(0), Field, Align(4));
+        SI->eraseFromParent();
+        PCStores++;
+        return;
+    }
+
+    Value *Base = B.CreateLoad(I8PtrTy, rt.base);
+    Value *Used = B.CreateLoad(SizeTy, rt.used);
+    Value *Diff = B.CreateSub(B.CreatePtrToInt(V, SizeTy), B.CreatePtrToInt(Base, SizeTy));
+    Value *IsNull = B.CreateICmpEQ(V, Constant::getNullValue(V->getType()));
+    Value *Inside = B.CreateICmpULT(Diff, Used);
+    Value *Near = B.CreateSelect(IsNull, B.getInt32(0),
+                                 B.CreateTrunc(B.CreateLShr(Diff, PCIndexShift), B.getInt32Ty()));
+    Value *IsFar = B.CreateNot(B.CreateOr(IsNull, Inside));
+
+    MDNode *Unlikely = MDBuilder(C).createBranchWeights(1, 1 << 20);
+    Instruction *Then = SplitBlockAndInsertIfThen(IsFar, SI, false, Unlikely);
+    IRBuilder<> S(Then);
+    Value *FarIdx = S.CreateCall(rt.farIndex, {S.CreateBitCast(V, I8PtrTy)});
+
+    B.SetInsertPoint(SI);
+    PHINode *Idx = B.CreatePHI(B.getInt32Ty(), 2);
+    Idx->addIncoming(Near, Then->getParent()->getSinglePredecessor());
+    Idx->addIncoming(FarIdx, Then->getParent());
+    B.CreateAlignedStore(Idx, Field, Align(4));
+    SI->eraseFromParent();
+    PCStores++;
+}
+
+//***********************Function rewriteGEP*******************************//
+// redo a GEP on S as the same GEP on S.pc; fields that kept their type
+// only need their alignment checked, compressed ones are expanded
+//*************************************************************************//
+
+static void rewriteGEP(GetElementPtrInst *GEP, StructType *NewTy, bool compressed,
+                       PCRuntime &rt, const DataLayout &DL)
+{
+    IRBuilder<> B(GEP);
+    Value *Ptr = B.CreateBitCast(GEP->getPointerOperand(), NewTy->getPointerTo());
+    SmallVector<Value *, 4> Idx(GEP->idx_begin(), GEP->idx_end());
+    Value *NewGEP = GEP->isInBounds() ? B.CreateInBoundsGEP(NewTy, Ptr, Idx)
+                                      : B.CreateGEP(NewTy, Ptr, Idx);
+    NewGEP->takeName(GEP);
+
+    if (compressed) {
+        std::vector<User *> users(GEP->user_begin(), GEP->user_end());
+        for (User *U : users) {
+            if (auto *LI = dyn_cast<LoadInst>(U))
+                decompress(LI, NewGEP, rt);
+            else
+                compress(cast<StoreInst>(U), NewGEP, rt);
+        }
+        GEP->eraseFromParent();
+        return;
+    }
+
+    // Fields moved, so an alignment that held in S may not hold in S.pc.
+    ClampAccessAlignment(GEP, DL);
+    GEP->replaceAllUsesWith(B.CreateBitCast(NewGEP, GEP->getType()));
+    GEP->eraseFromParent();
+}
+
+void PointerCompression(Module *M)
+{
+    const DataLayout &DL = M->getDataLayout();
+    if (DL.getPointerSizeInBits() <= 32)
+        return;
+
+    TypeSafeStructs TS(M);
+
+    // Pick the fields: pointers to a safe type whose address is only used
+    // to load or store the pointer.
+    std::map<StructType *, std::set<unsigned>> fields;
+    for (StructType *S : TS.types()) {
+        for (unsigned i = 0; i < S->getNumElements(); i++) {
+            StructType *T = pointeeStruct(S->getElementType(i));
+            if (T && TS.isSafe(T))
+                fields[S].insert(i);
+        }
+        for (GetElementPtrInst *GEP : TS.geps(S)) {
+            int f = AccessedField(GEP);
+            if (f >= 0 && fields[S].count(f) && !onlyLoadedAndStored(GEP))
+                fields[S].erase(f);
+        }
+    }
+
+    // Objects of every type a compressed field points to, and of every
+    // type that is laid out again, must come from the region.
+    std::vector<StructType *> shrunk, region;
+    std::set<StructType *> inRegion;
+    for (StructType *S : TS.types()) {
+        if (fields[S].empty())
+            continue;
+        shrunk.push_back(S);
+        inRegion.insert(S);
+        for (unsigned i : fields[S])
+            inRegion.insert(pointeeStruct(S->getElementType(i)));
+    }
+    if (shrunk.empty())
+        return;
+    for (StructType *S : TS.types())
+        if (inRegion.count(S))
+            region.push_back(S);
+
+    PCRuntime rt = getRuntime(M);
+    Type *I32Ty = Type::getInt32Ty(M->getContext());
+
+    std::map<StructType *, StructType *> newType;
+    for (StructType *S : shrunk) {
+        std::vector<Type *> elems(S->element_begin(), S->element_end());
+        for (unsigned i : fields[S])
+            elems[i] = I32Ty;
+        newType[S] = StructType::create(M->getContext(), elems,
+                                        (S->getName() + ".pc").str(), S->isPacked());
+        PCTypes++;
+        PCFields += fields[S].size();
+    }
+
+    for (StructType *S : region) {
+        StructType *NewTy = newType.count(S) ? newType[S] : S;
+        uint64_t OldSize = DL.getTypeAllocSize(S);
+        uint64_t NewSize = DL.getTypeAllocSize(NewTy);
+
+        for (CallInst *CI : TS.mallocs(S)) {
+            IRBuilder<> B(CI);
+            Value *Size = CI->getArgOperand(0);
+            if (NewSize != OldSize)
+                Size = RescaleAllocationSize(Size, OldSize, NewSize, CI);
+            Size = B.CreateZExtOrTrunc(Size, rt.used->getValueType());
+            CallInst *NewCI = B.CreateCall(rt.alloc, {Size});
+            NewCI->takeName(CI);
+            CI->replaceAllUsesWith(NewCI);
+            CI->eraseFromParent();
+            PCAllocs++;
+        }
+        for (CallInst *CI : TS.frees(S)) {
+            IRBuilder<> B(CI);
+            B.CreateCall(rt.free, {CI->getArgOperand(0),
+                                   ConstantInt::get(rt.used->getValueType(), NewSize)});
+            CI->eraseFromParent();
+        }
+    }
+
+    for (StructType *S : shrunk)
+        for (GetElementPtrInst *GEP : TS.geps(S)) {
+            int f = AccessedField(GEP);
+            rewriteGEP(GEP, newType[S], f >= 0 && fields[S].count(f), rt, DL);
+        }
+}
@@ -0,0 +1,11 @@
+#ifndef PTRCOMPRESS_H
+#define PTRCOMPRESS_H
+
+#include "llvm/IR/Module.h"
+
+/* Store the pointer fields of type-safe linked structures as 32-bit
+   indices into one memory region. Transformed programs must be linked
+   with runtime/ptrcompress.c (libp2rt). */
+void PointerCompression(llvm::Module *M);
+
+#endif
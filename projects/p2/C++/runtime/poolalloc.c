@@ -0,0 +1,100 @@
+/*
+ * File: poolalloc.c
+ *
+ * Description:
+ *   Runtime for the p2 -poolalloc transformation. A pool hands out memory
+ *   from large chunks with a bump pointer. While every allocation has the
+ *   same size, freed objects go on a free list and are reused. Other frees
+ *   are ignored, and all memory is released when the pool is destroyed.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_CHUNK_SIZE (64 * 1024)
+/* what malloc guarantees on x86-64; long double and vector members of
+   malloc'd structs are accessed with 16-byte alignment */
+#define POOL_ALIGN 16
+
+typedef struct PoolChunk {
+  struct PoolChunk *next;
+  void *pad; /* keeps the objects after the header POOL_ALIGN aligned */
+} PoolChunk;
+
+typedef struct Pool {
+  char *cur;
+  char *end;
+  PoolChunk *chunks;
+  void *freelist;
+  size_t elemsize;
+  int uniform;
+} Pool;
+
+/* poolalloc.cpp reserves 8 words for each descriptor */
+typedef char pool_descriptor_fits[sizeof(Pool) <= 8 * sizeof(long long) ? 1 : -1];
+
+void pool_init(void *desc)
+{
+  Pool *p = (Pool *) desc;
+  memset(p, 0, sizeof(*p));
+  p->uniform = 1;
+}
+
+void *pool_alloc(void *desc, size_t n)
+{
+  Pool *p = (Pool *) desc;
+  char *obj;
+
+  n = (n + POOL_ALIGN - 1) & ~(size_t) (POOL_ALIGN - 1);
+  if (n < sizeof(void *))
+    n = sizeof(void *);
+
+  if (p->elemsize == 0)
+    p->elemsize = n;
+  else if (p->elemsize != n)
+    p->uniform = 0;
+
+  if (p->uniform && p->freelist) {
+    obj = (char *) p->freelist;
+    p->freelist = *(void **) obj;
+    return obj;
+  }
+
+  if (p->cur == NULL || (size_t) (p->end - p->cur) < n) {
+    size_t size = sizeof(PoolChunk) + n;
+    PoolChunk *c;
+    if (size < POOL_CHUNK_SIZE)
+      size = POOL_CHUNK_SIZE;
+    c = (PoolChunk *) malloc(size);
+    if (!c)
+      return NULL;
+    c->next = p->chunks;
+    p->chunks = c;
+    p->cur = (char *) (c + 1);
+    p->end = (char *) c + size;
+  }
+
+  obj = p->cur;
+  p->cur += n;
+  return obj;
+}
+
+void pool_free(void *desc, void *obj)
+{
+  Pool *p = (Pool *) desc;
+  if (!obj || !p->uniform)
+    return;
+  *(void **) obj = p->freelist;
+  p->freelist = obj;
+}
+
+void pool_destroy(void *desc)
+{
+  Pool *p = (Pool *) desc;
+  PoolChunk *c = p->chunks;
+  while (c) {
+    PoolChunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  pool_init(p);
+}
@@ -0,0 +1,158 @@
+/*
+ * File: ptrcompress.c
+ *
+ * Description:
+ *   Runtime for the p2 -ptrcompress transformation. A compressed pointer
+ *   field holds a 32-bit index: 0 is null, and otherwise it is the
+ *   object's offset from pc_region_base in 8-byte units. Objects are
+ *   handed out from one 4 GB region reserved at startup (the kernel only
+ *   commits the pages that are touched).
+ *
+ *   When the region is full, or could not be reserved at all, pc_alloc
+ *   falls back to malloc. Such an object cannot be named by an offset, so
+ *   storing a pointer to it records the pointer in a table and stores the
+ *   table slot with the top bit set. The compiled code only takes that
+ *   path when the top bit is set or the pointer is outside the region.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define PC_REGION_SIZE ((size_t) 4 << 30)
+#define PC_ALIGN 8
+#define PC_FAR_BIT 0x80000000u
+#define PC_SIZE_CLASSES 64
+
+/* read by the compiled code */
+char *pc_region_base;
+size_t pc_region_used;
+
+/* one free list per object size, in PC_ALIGN steps */
+static void *pc_freelist[PC_SIZE_CLASSES];
+
+static void **far_ptrs;      /* slot -> pointer */
+static uint32_t *far_hash;   /* open addressing on the pointer, holds slot + 1 */
+static size_t far_count, far_cap, far_hash_size;
+
+__attribute__((constructor)) static void pc_init(void)
+{
+  void *p = mmap(NULL, PC_REGION_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+    return;
+  pc_region_base = (char *) p;
+  /* offset 0 is the null index */
+  pc_region_used = PC_ALIGN;
+}
+
+void *pc_alloc(size_t n)
+{
+  static int warned;
+  size_t cls;
+  void *obj;
+
+  n = (n + PC_ALIGN - 1) & ~(size_t) (PC_ALIGN - 1);
+  if (n == 0)
+    n = PC_ALIGN;
+
+  cls = n / PC_ALIGN;
+  if (cls < PC_SIZE_CLASSES && pc_freelist[cls]) {
+    obj = pc_freelist[cls];
+    pc_freelist[cls] = *(void **) obj;
+    return obj;
+  }
+
+  if (pc_region_base && PC_REGION_SIZE - pc_region_used >= n) {
+    obj = pc_region_base + pc_region_used;
+    pc_region_used += n;
+    return obj;
+  }
+
+  if (!warned) {
+    fprintf(stderr, "ptrcompress: region full, using far pointers\n");
+    warned = 1;
+  }
+  return malloc(n);
+}
+
+/* size is the size of one object of the freed type; the rest of an array
+   allocation stays in the region until exit */
+void pc_free(void *obj, size_t n)
+{
+  size_t cls;
+
+  if (!obj)
+    return;
+  if ((size_t) ((char *) obj - pc_region_base) >= pc_region_used) {
+    free(obj);
+    return;
+  }
+
+  n = (n + PC_ALIGN - 1) & ~(size_t) (PC_ALIGN - 1);
+  cls = n / PC_ALIGN;
+  if (cls == 0 || cls >= PC_SIZE_CLASSES)
+    return;
+  *(void **) obj = pc_freelist[cls];
+  pc_freelist[cls] = obj;
+}
+
+static size_t far_slot(void *p)
+{
+  return ((uintptr_t) p >> 4) * 2654435761u & (far_hash_size - 1);
+}
+
+static void far_grow(void)
+{
+  size_t i;
+
+  far_cap = far_cap ? far_cap * 2 : 1024;
+  far_ptrs = (void **) realloc(far_ptrs, far_cap * sizeof(void *));
+
+  free(far_hash);
+  far_hash_size = far_cap * 2;
+  far_hash = (uint32_t *) calloc(far_hash_size, sizeof(uint32_t));
+  if (!far_ptrs || !far_hash) {
+    fprintf(stderr, "ptrcompress: out of memory\n");
+    abort();
+  }
+  for (i = 0; i < far_count; i++) {
+    size_t h = far_slot(far_ptrs[i]);
+    while (far_hash[h])
+      h = (h + 1) & (far_hash_size - 1);
+    far_hash[h] = (uint32_t) (i + 1);
+  }
+}
+
+uint32_t pc_far_index(void *p)
+{
+  size_t h;
+
+  if (!p)
+    return 0;
+  if ((size_t) ((char *) p - pc_region_base) < pc_region_used)
+    return (uint32_t) (((char *) p - pc_region_base) / PC_ALIGN);
+
+  if (far_hash_size) {
+    for (h = far_slot(p); far_hash[h]; h = (h + 1) & (far_hash_size - 1))
+      if (far_ptrs[far_hash[h] - 1] == p)
+        return PC_FAR_BIT | (far_hash[h] - 1);
+  }
+
+  if (far_count + 1 >= PC_FAR_BIT) {
+    fprintf(stderr, "ptrcompress: too many far pointers\n");
+    abort();
+  }
+  if (far_count == far_cap)
+    far_grow();
+  far_ptrs[far_count] = p;
+  for (h = far_slot(p); far_hash[h]; h = (h + 1) & (far_hash_size - 1))
+    ;
+  far_hash[h] = (uint32_t) (far_count + 1);
+  return PC_FAR_BIT | (uint32_t) far_count++;
+}
+
+void *pc_far_pointer(uint32_t idx)
+{
+  return far_ptrs[idx & ~PC_FAR_BIT];
+}
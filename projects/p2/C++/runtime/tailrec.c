@@ -0,0 +1,17 @@
+/*
+ * File: tailrec.c
+ *
+ * Description:
+ *   Runtime for p2 -tailrec-depth. At exit the converted program reports,
+ *   for each function -tailrec turned into a loop, the deepest recursion
+ *   it reached. Without the conversion each level would have been a stack
+ *   frame, so depth - 1 frames were saved.
+ */
+#include <stdio.h>
+
+void tailrec_report(const char *name, long long depth)
+{
+  if (depth > 1)
+    fprintf(stderr, "tailrec: %s reached depth %lld, %lld frames saved\n",
+            name, depth, depth - 1);
+}
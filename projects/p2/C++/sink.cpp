@@ -0,0 +1,167 @@
+/*
+ * File: sink.cpp
+ *
+ * Description:
+ *   Partial dead code sinking. A value computed before a branch but used
+ *   on one side only is wasted work on the other side; moving it to the
+ *   nearest common dominator of its uses (phi uses count at the end of
+ *   their incoming block) computes it only on the paths that need it.
+ *
+ *   An instruction moves when:
+ *   - it has no side effects: instructions that neither touch memory
+ *     nor throw, or simple loads with no instruction that may write
+ *     memory on any path from the load to the target (searched backwards
+ *     from the target, at most MaxSearch blocks). The target is
+ *     dominated by the old place, so a division that could trap there
+ *     only ever runs on paths that ran it before;
+ *   - the target is not entered on every path from its block (it does
+ *     not post-dominate it), or is outside a loop the block is in; the
+ *     target is raised along the dominator tree until it is not inside a
+ *     loop the block is not in and is not an EH pad.
+ *
+ *   Blocks are visited in post order and instructions bottom-up, so the
+ *   users of an instruction have moved before it is considered, and the
+ *   whole function is repeated until nothing moves.
+ */
+#include <vector>
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "sink.h"
+
+using namespace llvm;
+
+static llvm::Statistic SinkInsts = {"", "SinkInsts", "Sink instructions moved to the paths that use them"};
+static llvm::Statistic SinkLoads = {"", "SinkLoads", "Sink loads moved to the paths that use them"};
+
+// loads are not moved past a region of more blocks than this
+static const unsigned MaxSearch = 64;
+
+static bool isSinkable(Instruction &I)
+{
+    if (isa<PHINode>(&I) || I.isTerminator() || I.isEHPad() || isa<AllocaInst>(&I) ||
+        I.getType()->isTokenTy() || I.use_empty())
+        return false;
+    if (auto *LI = dyn_cast<LoadInst>(&I))
+        return LI->isSimple();
+    if (auto *CB = dyn_cast<CallBase>(&I))
+        if (CB->isConvergent())
+            return false;
+    return !I.mayReadOrWriteMemory() && !I.mayHaveSideEffects();
+}
+
+// the block in which each use of I needs its value
+static BasicBlock *useBlock(Use &U)
+{
+    auto *User = cast<Instruction>(U.getUser());
+    if (auto *PN = dyn_cast<PHINode>(User))
+        return PN->getIncomingBlock(U);
+    return User->getParent();
+}
+
+//***********************Function clobberFree******************************//
+// true if nothing may write memory after L in its block or in the blocks
+// between it and the start of Target; BB dominates Target, so walking
+// back from Target always stops at BB
+//*************************************************************************//
+
+static bool clobberFree(LoadInst *L, BasicBlock *Target)
+{
+    BasicBlock *BB = L->getParent();
+    for (auto i = std::next(L->getIterator()); i != BB->end(); i++)
+        if (i->mayWriteToMemory())
+            return false;
+
+    SmallPtrSet<BasicBlock *, 16> seen{BB, Target};
+    std::vector<BasicBlock *> work(pred_begin(Target), pred_end(Target));
+    while (!work.empty()) {
+        BasicBlock *X = work.back();
+        work.pop_back();
+        if (!seen.insert(X).second)
+            continue;
+        if (seen.size() > MaxSearch)
+            return false;
+        for (Instruction &I : *X)
+            if (I.mayWriteToMemory())
+                return false;
+        work.insert(work.end(), pred_begin(X), pred_end(X));
+    }
+    return true;
+}
+
+//***********************Function sinkTarget*******************************//
+// where I should move to, or null if it should stay
+//*************************************************************************//
+
+static BasicBlock *sinkTarget(Instruction &I, DominatorTree &DT, PostDominatorTree &PDT, LoopInfo &LI)
+{
+    BasicBlock *BB = I.getParent();
+    BasicBlock *Target = nullptr;
+    for (Use &U : I.uses()) {
+        BasicBlock *UB = useBlock(U);
+        if (!DT.isReachableFromEntry(UB))
+            continue;
+        Target = Target ? DT.findNearestCommonDominator(Target, UB) : UB;
+        if (Target == BB)
+            return nullptr;
+    }
+    if (!Target)
+        return nullptr;
+
+    // never into a loop that BB is not in, nor to the start of an EH pad
+    for (;;) {
+        Loop *L = LI.getLoopFor(Target);
+        if ((!L || L->contains(BB)) && !Target->isEHPad())
+            break;
+        Target = DT.getNode(Target)->getIDom()->getBlock();
+        if (Target == BB)
+            return nullptr;
+    }
+
+    if (PDT.dominates(Target, BB) && LI.getLoopDepth(Target) >= LI.getLoopDepth(BB))
+        return nullptr;
+    return Target;
+}
+
+static bool sinkFunction(Function &F)
+{
+    DominatorTree DT(F);
+    PostDominatorTree PDT(F);
+    LoopInfo LI(DT);
+    bool changed = false;
+
+    for (BasicBlock *BB : post_order(&F.getEntryBlock()))
+        for (auto i = BB->rbegin(); i != BB->rend();) {
+            Instruction &I = *i++;
+            if (!isSinkable(I))
+                continue;
+            BasicBlock *Target = sinkTarget(I, DT, PDT, LI);
+            if (!Target)
+                continue;
+            auto *L = dyn_cast<LoadInst>(&I);
+            if (L && !clobberFree(L, Target))
+                continue;
+            I.moveBefore(&*Target->getFirstInsertionPt());
+            if (L)
+                SinkLoads++;
+            SinkInsts++;
+            changed = true;
+        }
+    return changed;
+}
+
+void SinkInstructions(Module *M)
+{
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration())
+            while (sinkFunction(*f))
+                ;
+}
@@ -0,0 +1,10 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include "llvm/IR/Module.h"
+
+/* Partial dead code elimination: move side-effect-free instructions and
+   unclobbered loads down to the paths that use them. */
+void SinkInstructions(llvm::Module *M);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * File: specialize.cpp
+ *
+ * Description:
+ *   Interprocedural function specialization. Direct call sites that pass
+ *   constants or global addresses are grouped by the constants they pass.
+ *   When the size estimate from the inliner's cost model says a group
+ *   saves at least -specialize-min-saving instructions per call, a clone
+ *   with those arguments bound is made, the constants are folded through
+ *   it, and the group's calls are pointed at the clone. At most
+ *   -specialize-max clones are made per function.
+ */
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include "cse.h"
+#include "inline.h"
+#include "specialize.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+        SpecializeMax("specialize-max",
+                      cl::desc("Maximum number of specialized clones per function."),
+                      cl::init(3));
+
+static cl::opt<unsigned>
+        SpecializeMinSaving("specialize-min-saving",
+                            cl::desc("Instructions a clone must save per call to be created."),
+                            cl::init(4));
+
+static llvm::Statistic SpecClones = {"", "SpecClones", "Specialization clones created"};
+static llvm::Statistic SpecCalls = {"", "SpecCalls", "Specialization call sites redirected"};
+static llvm::Statistic SpecArgs = {"", "SpecArgs", "Specialization constant arguments bound"};
+
+typedef std::vector<Constant *> ArgSignature;
+
+struct SpecGroup {
+    ArgSignature args;
+    std::vector<CallInst *> calls;
+    unsigned saving;
+};
+
+//***********************Function specializableArg*************************//
+// constants we are willing to bake into a clone: integers, floats, null
+// and the addresses of globals/functions (undef is left alone)
+//*************************************************************************//
+
+static Constant *specializableArg(Value *V)
+{
+    Constant *C = dyn_cast<Constant>(V);
+    if (!C || isa<UndefValue>(C))
+        return nullptr;
+    if (isa<ConstantInt>(C) || isa<ConstantFP>(C) ||
+        isa<ConstantPointerNull>(C) || isa<GlobalValue>(C->stripPointerCasts()))
+        return C;
+    return nullptr;
+}
+
+static bool isSpecializationCandidate(Function *F)
+{
+    return !F->isDeclaration() && !F->isVarArg() &&
+           !F->hasFnAttribute(Attribute::NoInline) &&
+           !F->hasFnAttribute(Attribute::OptimizeNone);
+}
+
+//***********************Function foldClone********************************//
+// propagate the bound constants: CSE simplifies the instructions that use
+// them, branches that became constant are folded, blocks that can no longer
+// be reached are dropped and straight-line block pairs are merged
+//*************************************************************************//
+
+static void foldClone(Function *Clone)
+{
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        CommonSubexpressionElimination(Clone);
+        for (auto bb = Clone->begin(); bb != Clone->end(); bb++)
+            changed |= ConstantFoldTerminator(&*bb, true);
+        changed |= removeUnreachableBlocks(*Clone);
+        for (auto bb = Clone->begin(); bb != Clone->end(); ) {
+            BasicBlock *BB = &*bb;
+            bb++;
+            changed |= MergeBlockIntoPredecessor(BB);
+        }
+    }
+}
+
+static Function *makeClone(Function *F, const ArgSignature &sig)
+{
+    ValueToValueMapTy VMap;
+    for (unsigned a = 0; a < sig.size(); a++)
+        if (sig[a])
+            VMap[F->getArg(a)] = sig[a];
+
+    // Arguments with an entry in VMap are dropped from the clone's signature.
+    Function *Clone = CloneFunction(F, VMap);
+    Clone->setName(F->getName() + ".spec");
+    Clone->setLinkage(GlobalValue::InternalLinkage);
+    Clone->setVisibility(GlobalValue::DefaultVisibility);
+    Clone->setComdat(nullptr);
+    foldClone(Clone);
+    return Clone;
+}
+
+static void redirectCall(CallInst *CI, Function *Clone, const ArgSignature &sig)
+{
+    std::vector<Value *> args;
+    for (unsigned a = 0; a < sig.size(); a++)
+        if (!sig[a])
+            args.push_back(CI->getArgOperand(a));
+
+    CallInst *NewCI = CallInst::Create(Clone->getFunctionType(), Clone, args, "", CI);
+    NewCI->setCallingConv(CI->getCallingConv());
+    NewCI->setTailCallKind(CI->getTailCallKind());
+    NewCI->setDebugLoc(CI->getDebugLoc());
+    NewCI->takeName(CI);
+    CI->replaceAllUsesWith(NewCI);
+    CI->eraseFromParent();
+}
+
+static void specializeFunction(Function *F, std::vector<CallInst *> &calls)
+{
+    // Groups in the order their first call appears, so ties in the sort
+    // below and the clones' names do not depend on pointer values.
+    MapVector<ArgSignature, SpecGroup, std::map<ArgSignature, unsigned>> groups;
+    for (CallInst *CI : calls) {
+        ArgSignature sig;
+        bool any = false;
+        for (unsigned a = 0; a < CI->arg_size(); a++) {
+            Constant *C = specializableArg(CI->getArgOperand(a));
+            any |= (C != nullptr);
+            sig.push_back(C);
+        }
+        if (!any)
+            continue;
+        SpecGroup &g = groups[sig];
+        g.args = sig;
+        g.calls.push_back(CI);
+    }
+    if (groups.empty())
+        return;
+
+    unsigned base = EstimateSizeWithConstants(F, ArgSignature(F->arg_size(), nullptr));
+    std::vector<SpecGroup *> worthwhile;
+    for (auto &p : groups) {
+        SpecGroup &g = p.second;
+        unsigned size = EstimateSizeWithConstants(F, g.args);
+        g.saving = base > size ? base - size : 0;
+        if (g.saving >= SpecializeMinSaving)
+            worthwhile.push_back(&g);
+    }
+
+    // Prefer the groups that remove the most work across all their calls.
+    std::stable_sort(worthwhile.begin(), worthwhile.end(),
+                     [](SpecGroup *a, SpecGroup *b) {
+                         return a->saving * a->calls.size() > b->saving * b->calls.size();
+                     });
+    if (worthwhile.size() > SpecializeMax)
+        worthwhile.resize(SpecializeMax);
+
+    for (SpecGroup *g : worthwhile) {
+        Function *Clone = makeClone(F, g->args);
+        SpecClones++;
+        for (Constant *C : g->args)
+            if (C)
+                SpecArgs++;
+        for (CallInst *CI : g->calls) {
+            redirectCall(CI, Clone, g->args);
+            SpecCalls++;
+        }
+    }
+}
+
+void FunctionSpecialization(Module *M)
+{
+    // Collect candidates up front: clones are appended to the module and
+    // must not be specialized again.
+    std::vector<Function *> funcs;
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (isSpecializationCandidate(&*f))
+            funcs.push_back(&*f);
+
+    for (Function *F : funcs) {
+        std::vector<CallInst *> calls;
+        for (User *U : F->users())
+            if (auto *CI = dyn_cast<CallInst>(U))
+                if (CI->getCalledFunction() == F &&
+                    CI->getFunctionType() == F->getFunctionType())
+                    calls.push_back(CI);
+        specializeFunction(F, calls);
+
+        // Every call went to a clone; a local original is now dead.
+        if (F->hasLocalLinkage() && F->use_empty())
+            F->eraseFromParent();
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef SPECIALIZE_H
+#define SPECIALIZE_H
+
+#include "llvm/IR/Module.h"
+
+/* Clone functions for call sites that pass constants (or global addresses)
+   and fold those constants through the clone. */
+void FunctionSpecialization(llvm::Module *M);
+
+#endif
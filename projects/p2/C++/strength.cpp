@@ -0,0 +1,310 @@
+/*
+ * File: strength.cpp
+ *
+ * Description:
+ *   Strength reduction of division, remainder and multiplication by
+ *   constants, so that the -O0 code generator (and CUSTOMCODEGEN) does
+ *   not emit idiv/div and imul for them. Runs before CSE so the shifts
+ *   and multiplies it creates can be shared.
+ *
+ *   1. udiv/sdiv by a constant d (not 0 or +-1, at most 64 bits wide):
+ *      - powers of two become shifts, with a bias for negative
+ *        dividends in the signed case;
+ *      - udiv by d >= 2^(N-1) becomes a compare, and sdiv by INT_MIN
+ *        does too;
+ *      - everything else becomes a multiply-high by a magic number
+ *        followed by shifts (Granlund and Montgomery, "Division by
+ *        Invariant Integers using Multiplication", PLDI 1994), with
+ *        the magic numbers of Hacker's Delight figures 10-1 and 10-2.
+ *        The multiply-high is done at twice the width. Even unsigned
+ *        divisors that would need the extra add shift the dividend
+ *        first instead.
+ *   2. urem by a power of two becomes an and. Any other urem or srem
+ *      x % d becomes x - (x / d) * d, using the quotient from 1.
+ *   3. mul by c becomes shifts with at most one add or sub when c is
+ *      2^a, 2^a +- 1, 2^a + 2^b or 2^a - 2^b, and -2^a or -(2^a - 1)
+ *      when c is negative. This includes the multiplies made by 2.
+ */
+#include <vector>
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "strength.h"
+
+using namespace llvm;
+
+static llvm::Statistic StrengthDiv = {"", "StrengthDiv", "Strength divisions by constants rewritten"};
+static llvm::Statistic StrengthRem = {"", "StrengthRem", "Strength remainders by constants rewritten"};
+static llvm::Statistic StrengthMul = {"", "StrengthMul", "Strength multiplies by constants rewritten"};
+
+struct SignedMagic {
+    APInt m;
+    unsigned s;
+};
+
+struct UnsignedMagic {
+    APInt m;
+    bool add;
+    unsigned s;
+};
+
+//***********************Function signedMagic******************************//
+// Hacker's Delight 10-1: multiplier and shift for signed division by d,
+// 2 <= |d| < 2^(W-1)
+//*************************************************************************//
+
+static SignedMagic signedMagic(const APInt &d)
+{
+    unsigned W = d.getBitWidth();
+    APInt signedMin = APInt::getSignedMinValue(W);
+    APInt ad = d.abs();
+    APInt t = signedMin + d.lshr(W - 1);
+    APInt anc = t - 1 - t.urem(ad);
+    unsigned p = W - 1;
+    APInt q1 = signedMin.udiv(anc), r1 = signedMin - q1 * anc;
+    APInt q2 = signedMin.udiv(ad), r2 = signedMin - q2 * ad;
+    APInt delta(W, 0);
+    do {
+        p++;
+        q1 <<= 1;
+        r1 <<= 1;
+        if (r1.uge(anc)) {
+            q1 += 1;
+            r1 -= anc;
+        }
+        q2 <<= 1;
+        r2 <<= 1;
+        if (r2.uge(ad)) {
+            q2 += 1;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1.ult(delta) || (q1 == delta && r1 == 0));
+
+    SignedMagic mag = {q2 + 1, p - W};
+    if (d.isNegative())
+        mag.m = -mag.m;
+    return mag;
+}
+
+//***********************Function unsignedMagic****************************//
+// Hacker's Delight 10-2: multiplier, add indicator and shift for unsigned
+// division by d, 2 <= d < 2^(W-1), of dividends with the top zeros bits
+// clear
+//*************************************************************************//
+
+static UnsignedMagic unsignedMagic(const APInt &d, unsigned zeros = 0)
+{
+    unsigned W = d.getBitWidth();
+    APInt allOnes = APInt::getMaxValue(W).lshr(zeros);
+    APInt signedMin = APInt::getSignedMinValue(W);
+    APInt signedMax = APInt::getSignedMaxValue(W);
+    APInt nc = allOnes - (allOnes - d).urem(d);
+    unsigned p = W - 1;
+    APInt q1 = signedMin.udiv(nc), r1 = signedMin - q1 * nc;
+    APInt q2 = signedMax.udiv(d), r2 = signedMax - q2 * d;
+    APInt delta(W, 0);
+    bool add = false;
+    do {
+        p++;
+        if (r1.uge(nc - r1)) {
+            q1 = q1 + q1 + 1;
+            r1 = r1 + r1 - nc;
+        } else {
+            q1 = q1 + q1;
+            r1 = r1 + r1;
+        }
+        if ((r2 + 1).uge(d - r2)) {
+            if (q2.uge(signedMax))
+                add = true;
+            q2 = q2 + q2 + 1;
+            r2 = r2 + r2 + 1 - d;
+        } else {
+            if (q2.uge(signedMin))
+                add = true;
+            q2 = q2 + q2;
+            r2 = r2 + r2 + 1;
+        }
+        delta = d - 1 - r2;
+    } while (p < W * 2 && (q1.ult(delta) || (q1 == delta && r1 == 0)));
+
+    return UnsignedMagic{q2 + 1, add, p - W};
+}
+
+// high half of X * m, computed at twice the width
+static Value *mulHigh(IRBuilder<> &B, Value *X, const APInt &m, bool isSigned)
+{
+    unsigned W = m.getBitWidth();
+    Type *Wide = B.getIntNTy(2 * W);
+    Value *XW = isSigned ? B.CreateSExt(X, Wide) : B.CreateZExt(X, Wide);
+    Value *MW = ConstantInt::get(Wide, isSigned ? m.sext(2 * W) : m.zext(2 * W));
+    Value *P = B.CreateMul(XW, MW, "mul.wide");
+    return B.CreateTrunc(B.CreateLShr(P, W), X->getType(), "mulhi");
+}
+
+static Value *unsignedQuotient(IRBuilder<> &B, Value *X, const APInt &d)
+{
+    if (d.isPowerOf2())
+        return B.CreateLShr(X, d.logBase2());
+    if (d.isNegative())
+        return B.CreateZExt(B.CreateICmpUGE(X, B.getInt(d)), X->getType());
+
+    UnsignedMagic mag = unsignedMagic(d);
+    if (mag.add && !d[0]) {
+        // x / (e * 2^z) == (x >> z) / e, and with z top bits clear the
+        // magic number for e needs no add
+        unsigned z = d.countTrailingZeros();
+        X = B.CreateLShr(X, z);
+        mag = unsignedMagic(d.lshr(z), z);
+    }
+    Value *Q = mulHigh(B, X, mag.m, false);
+    if (!mag.add)
+        return mag.s ? B.CreateLShr(Q, mag.s) : Q;
+    Value *T = B.CreateLShr(B.CreateSub(X, Q), 1);
+    return B.CreateLShr(B.CreateAdd(T, Q), mag.s - 1);
+}
+
+static Value *signedQuotient(IRBuilder<> &B, Value *X, const APInt &d)
+{
+    unsigned W = d.getBitWidth();
+    if (d.isMinSignedValue())
+        return B.CreateZExt(B.CreateICmpEQ(X, B.getInt(d)), X->getType());
+
+    APInt ad = d.abs();
+    if (ad.isPowerOf2()) {
+        // round towards zero: add 2^k - 1 to negative dividends
+        unsigned k = ad.logBase2();
+        Value *Sign = k > 1 ? B.CreateAShr(X, k - 1) : X;
+        Value *Bias = B.CreateLShr(Sign, W - k);
+        Value *Q = B.CreateAShr(B.CreateAdd(X, Bias), k);
+        return d.isNegative() ? B.CreateNeg(Q) : Q;
+    }
+
+    SignedMagic mag = signedMagic(d);
+    Value *Q = mulHigh(B, X, mag.m, true);
+    if (d.isStrictlyPositive() && mag.m.isNegative())
+        Q = B.CreateAdd(Q, X);
+    else if (d.isNegative() && mag.m.isStrictlyPositive())
+        Q = B.CreateSub(Q, X);
+    if (mag.s)
+        Q = B.CreateAShr(Q, mag.s);
+    return B.CreateAdd(Q, B.CreateLShr(Q, W - 1));
+}
+
+//***********************Function shiftAdd*********************************//
+// X * c as shifts and at most one add or sub, or null
+//*************************************************************************//
+
+static Value *shiftAdd(IRBuilder<> &B, Value *X, const APInt &c)
+{
+    unsigned W = c.getBitWidth();
+    auto shl = [&](unsigned a) { return a ? B.CreateShl(X, a) : X; };
+
+    if (c.isPowerOf2())
+        return shl(c.logBase2());
+    if (c.isNegative()) {
+        APInt n = -c;
+        if (n.isPowerOf2())
+            return B.CreateNeg(shl(n.logBase2()));
+        if ((n + 1).isPowerOf2())
+            return B.CreateSub(X, shl((n + 1).logBase2()));
+        return nullptr;
+    }
+    if ((c - 1).isPowerOf2())
+        return B.CreateAdd(shl((c - 1).logBase2()), X);
+    if ((c + 1).isPowerOf2())
+        return B.CreateSub(shl((c + 1).logBase2()), X);
+
+    unsigned b = c.countTrailingZeros();
+    if (c.countPopulation() == 2)
+        return B.CreateAdd(shl(c.logBase2()), shl(b));
+    APInt top = c + APInt::getOneBitSet(W, b);
+    if (top.isPowerOf2())
+        return B.CreateSub(shl(top.logBase2()), shl(b));
+    return nullptr;
+}
+
+static void replace(Instruction *I, Value *V)
+{
+    V->takeName(I);
+    I->replaceAllUsesWith(V);
+    I->eraseFromParent();
+}
+
+static void reduceFunction(Function &F)
+{
+    std::vector<BinaryOperator *> divs, muls;
+    for (BasicBlock &BB : F)
+        for (Instruction &I : BB) {
+            auto *BO = dyn_cast<BinaryOperator>(&I);
+            if (!BO || !BO->getType()->isIntegerTy())
+                continue;
+            switch (BO->getOpcode()) {
+            case Instruction::UDiv:
+            case Instruction::SDiv:
+            case Instruction::URem:
+            case Instruction::SRem:
+                if (isa<ConstantInt>(BO->getOperand(1)) && BO->getType()->getIntegerBitWidth() <= 64)
+                    divs.push_back(BO);
+                break;
+            case Instruction::Mul:
+                if (isa<ConstantInt>(BO->getOperand(0)) || isa<ConstantInt>(BO->getOperand(1)))
+                    muls.push_back(BO);
+                break;
+            default:
+                break;
+            }
+        }
+
+    for (BinaryOperator *I : divs) {
+        const APInt &d = cast<ConstantInt>(I->getOperand(1))->getValue();
+        bool isSigned = I->getOpcode() == Instruction::SDiv || I->getOpcode() == Instruction::SRem;
+        bool isRem = I->getOpcode() == Instruction::URem || I->getOpcode() == Instruction::SRem;
+        Value *X = I->getOperand(0);
+        // 0 traps, +-1 and constant dividends are left to CSE's simplification
+        if (d == 0 || d == 1 || (isSigned && d.isMaxValue()) || isa<Constant>(X))
+            continue;
+
+        IRBuilder<> B(I);
+        if (isRem && !isSigned && d.isPowerOf2()) {
+            replace(I, B.CreateAnd(X, B.getInt(d - 1)));
+            StrengthRem++;
+            continue;
+        }
+        Value *Q = isSigned ? signedQuotient(B, X, d) : unsignedQuotient(B, X, d);
+        if (!isRem) {
+            replace(I, Q);
+            StrengthDiv++;
+            continue;
+        }
+        auto *QD = cast<BinaryOperator>(B.CreateMul(Q, B.getInt(d)));
+        muls.push_back(QD);
+        replace(I, B.CreateSub(X, QD));
+        StrengthRem++;
+    }
+
+    for (BinaryOperator *I : muls) {
+        bool lhs = isa<ConstantInt>(I->getOperand(0));
+        Value *X = I->getOperand(lhs ? 1 : 0);
+        const APInt &c = cast<ConstantInt>(I->getOperand(lhs ? 0 : 1))->getValue();
+        if (c == 0 || c == 1 || isa<Constant>(X))
+            continue;
+        IRBuilder<> B(I);
+        if (Value *V = shiftAdd(B, X, c)) {
+            replace(I, V);
+            StrengthMul++;
+        }
+    }
+}
+
+void ReduceStrength(Module *M)
+{
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration())
+            reduceFunction(*f);
+}
@@ -0,0 +1,10 @@
+#ifndef STRENGTH_H
+#define STRENGTH_H
+
+#include "llvm/IR/Module.h"
+
+/* Replace division and remainder by constants with multiply-high and
+   shifts, and multiplies by small constants with shifts and adds. */
+void ReduceStrength(llvm::Module *M);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * File: structlayout.cpp
+ *
+ * Description:
+ *   Profile-guided structure layout for type-safe structs (see typesafe.h).
+ *   Each field is weighted by how often the loads and stores through its
+ *   GEPs execute, based on BlockFrequencyInfo. With !prof branch weights
+ *   and function entry counts (from an edge profile) those are measured
+ *   counts. Without them they are the static loop and branch estimates.
+ *
+ *   Fields used at least -structlayout-hot percent as often as the hottest
+ *   field go first, so one cache line holds what a traversal needs. Fields
+ *   used less than -structlayout-cold percent as often are moved to S.cold.
+ *   The main object then points to S.cold, and each malloc of S also
+ *   allocates the cold part. Splitting is only done for structs that are
+ *   allocated one at a time and whose cold fields take more room than the
+ *   extra pointer.
+ */
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include "structlayout.h"
+#include "typesafe.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+        StructHot("structlayout-hot",
+                  cl::desc("Percent of the hottest field's accesses that makes a field hot."),
+                  cl::init(10));
+
+static cl::opt<unsigned>
+        StructCold("structlayout-cold",
+                   cl::desc("Fields below this percent of the hottest field's accesses are split out."),
+                   cl::init(1));
+
+static llvm::Statistic SLReordered = {"", "SLReordered", "Structure layout types given a new layout"};
+static llvm::Statistic SLSplit = {"", "SLSplit", "Structure layout types split into hot and cold parts"};
+static llvm::Statistic SLColdFields = {"", "SLColdFields", "Structure layout fields moved to a cold part"};
+static llvm::Statistic SLAccesses = {"", "SLAccesses", "Structure layout field accesses rewritten"};
+
+//***********************Function blockWeights*****************************//
+// execution estimate of every block: its frequency relative to the entry
+// block, times the function's entry count when a profile supplied one
+//*************************************************************************//
+
+static void blockWeights(Function &F, DenseMap<BasicBlock *, double> &weight)
+{
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    BranchProbabilityInfo BPI(F, LI);
+    BlockFrequencyInfo BFI(F, BPI, LI);
+
+    double calls = 1.0;
+    if (auto EC = F.getEntryCount())
+        calls = EC->getCount();
+    double entry = BFI.getEntryFreq();
+    for (BasicBlock &BB : F)
+        weight[&BB] = BFI.getBlockFreq(&BB).getFrequency() / entry * calls;
+}
+
+struct Layout {
+    StructType *NewTy = nullptr;
+    StructType *ColdTy = nullptr;
+    std::vector<int> newIndex;   // position in NewTy, -1 if cold
+    std::vector<int> coldIndex;  // position in ColdTy, -1 if not
+    unsigned coldSlot = 0;       // field of NewTy holding the ColdTy*
+};
+
+//***********************Function isSplittable*****************************//
+// each object must be its own malloc, so every allocation gets exactly
+// one cold part, and nothing may index past the first object
+//*************************************************************************//
+
+static bool isSplittable(StructType *S, TypeSafeStructs &TS, const DataLayout &DL)
+{
+    for (CallInst *CI : TS.mallocs(S)) {
+        auto *Size = dyn_cast<ConstantInt>(CI->getArgOperand(0));
+        if (!Size || Size->getZExtValue() != DL.getTypeAllocSize(S))
+            return false;
+    }
+    for (GetElementPtrInst *GEP : TS.geps(S)) {
+        auto *First = dyn_cast<ConstantInt>(GEP->getOperand(1));
+        if (!First || !First->isZero())
+            return false;
+    }
+    return true;
+}
+
+static bool planLayout(StructType *S, std::vector<double> &heat, bool splittable,
+                       const DataLayout &DL, Layout &L)
+{
+    unsigned n = S->getNumElements();
+    double hottest = *std::max_element(heat.begin(), heat.end());
+    if (n < 2 || hottest <= 0)
+        return false;
+
+    std::vector<unsigned> kept, cold;
+    uint64_t coldBytes = 0;
+    for (unsigned i = 0; i < n; i++) {
+        if (splittable && heat[i] * 100 < hottest * StructCold) {
+            cold.push_back(i);
+            coldBytes += DL.getTypeAllocSize(S->getElementType(i));
+        } else {
+            kept.push_back(i);
+        }
+    }
+    // The cold part costs a pointer in every object and a second malloc.
+    if (cold.empty() || kept.empty() || coldBytes < 2 * DL.getPointerSize()) {
+        kept.clear();
+        cold.clear();
+        for (unsigned i = 0; i < n; i++)
+            kept.push_back(i);
+    }
+
+    // Hot fields first; within each group larger alignments first so the
+    // reordering does not add padding.
+    auto isHot = [&](unsigned i) { return heat[i] * 100 >= hottest * StructHot; };
+    std::stable_sort(kept.begin(), kept.end(), [&](unsigned a, unsigned b) {
+        if (isHot(a) != isHot(b))
+            return isHot(a);
+        Align aa = DL.getABITypeAlign(S->getElementType(a));
+        Align ab = DL.getABITypeAlign(S->getElementType(b));
+        if (aa != ab)
+            return aa > ab;
+        return heat[a] > heat[b];
+    });
+
+    bool reordered = false;
+    for (unsigned i = 0; i < kept.size(); i++)
+        if (kept[i] != i)
+            reordered = true;
+    if (!reordered && cold.empty())
+        return false;
+
+    LLVMContext &C = S->getContext();
+    L.newIndex.assign(n, -1);
+    L.coldIndex.assign(n, -1);
+    std::vector<Type *> elems, coldElems;
+    for (unsigned i : kept) {
+        L.newIndex[i] = elems.size();
+        elems.push_back(S->getElementType(i));
+    }
+    if (!cold.empty()) {
+        for (unsigned i : cold) {
+            L.coldIndex[i] = coldElems.size();
+            coldElems.push_back(S->getElementType(i));
+        }
+        L.ColdTy = StructType::create(C, coldElems, (S->getName() + ".cold").str(), S->isPacked());
+        L.coldSlot = elems.size();
+        elems.push_back(L.ColdTy->getPointerTo());
+    }
+    L.NewTy = StructType::create(C, elems, (S->getName() + ".layout").str(), S->isPacked());
+    return true;
+}
+
+//***********************Function rewriteGEP*******************************//
+// the same GEP on the new layout; a cold field is reached through the
+// pointer to the cold part
+//*************************************************************************//
+
+static void rewriteGEP(GetElementPtrInst *GEP, Layout &L, const DataLayout &DL)
+{
+    IRBuilder<> B(GEP);
+    Type *I32Ty = B.getInt32Ty();
+    Value *Ptr = B.CreateBitCast(GEP->getPointerOperand(), L.NewTy->getPointerTo());
+    SmallVector<Value *, 4> Idx(GEP->idx_begin(), GEP->idx_end());
+    int f = AccessedField(GEP);
+
+    Value *NewGEP;
+    if (f >= 0 && L.newIndex[f] < 0) {
+        Value *Slot = B.CreateInBoundsGEP(L.NewTy, Ptr, {Idx[0], ConstantInt::get(I32Ty, L.coldSlot)});
+        Value *Cold = B.CreateLoad(L.ColdTy->getPointerTo(), Slot, GEP->getName() + ".cold");
+        Idx[0] = ConstantInt::get(Idx[0]->getType(), 0);
+        Idx[1] = ConstantInt::get(I32Ty, L.coldIndex[f]);
+        NewGEP = B.CreateGEP(L.ColdTy, Cold, Idx);
+    } else {
+        if (f >= 0)
+            Idx[1] = ConstantInt::get(I32Ty, L.newIndex[f]);
+        NewGEP = B.CreateGEP(L.NewTy, Ptr, Idx);
+    }
+    if (auto *G = dyn_cast<GetElementPtrInst>(NewGEP))
+        G->setIsInBounds(GEP->isInBounds());
+    NewGEP->takeName(GEP);
+
+    ClampAccessAlignment(GEP, DL);
+    GEP->replaceAllUsesWith(B.CreateBitCast(NewGEP, GEP->getType()));
+    GEP->eraseFromParent();
+    SLAccesses++;
+}
+
+//***********************Function allocateColdPart*************************//
+// every malloc of S also mallocs the cold part and links it in; if the
+// cold malloc fails the hot part is freed and the result is null, as if
+// the original malloc had failed
+//*************************************************************************//
+
+static void allocateColdPart(CallInst *Malloc, Layout &L, const DataLayout &DL)
+{
+    std::vector<Use *> uses;
+    for (Use &U : Malloc->uses())
+        uses.push_back(&U);
+
+    Instruction *Next = Malloc->getNextNode();
+    IRBuilder<> B(Next);
+    Value *Null = Constant::getNullValue(Malloc->getType());
+    Value *NonNull = B.CreateICmpNE(Malloc, Null);
+    Instruction *Then = SplitBlockAndInsertIfThen(NonNull, Next, false);
+
+    IRBuilder<> T(Then);
+    Type *SizeTy = Malloc->getArgOperand(0)->getType();
+    CallInst *Cold = T.CreateCall(Malloc->getFunctionType(), Malloc->getCalledOperand(),
+                                  {ConstantInt::get(SizeTy, DL.getTypeAllocSize(L.ColdTy))},
+                                  Malloc->getName() + ".cold");
+    Value *Obj = T.CreateBitCast(Malloc, L.NewTy->getPointerTo());
+    Value *Slot = T.CreateInBoundsGEP(L.NewTy, Obj, {T.getInt32(0), T.getInt32(L.coldSlot)});
+    T.CreateStore(T.CreateBitCast(Cold, L.ColdTy->getPointerTo()), Slot);
+    Value *ColdNull = T.CreateICmpEQ(Cold, Constant::getNullValue(Cold->getType()));
+    Instruction *Fail = SplitBlockAndInsertIfThen(ColdNull, Then, false);
+    Module *M = Malloc->getModule();
+    FunctionCallee Free = M->getOrInsertFunction("free", Type::getVoidTy(M->getContext()),
+                                                 Malloc->getType());
+    IRBuilder<>(Fail).CreateCall(Free, {Malloc});
+    T.SetInsertPoint(Then);
+    Value *Sel = T.CreateSelect(ColdNull, Null, Malloc);
+
+    PHINode *Result = PHINode::Create(Malloc->getType(), 2, "", &Next->getParent()->front());
+    Result->addIncoming(Null, Malloc->getParent());
+    Result->addIncoming(Sel, Then->getParent());
+    Result->takeName(Malloc);
+    Malloc->setName(Result->getName() + ".hot");
+    for (Use *U : uses)
+        U->set(Result);
+}
+
+static void freeColdPart(CallInst *Free, Layout &L)
+{
+    Value *Obj = Free->getArgOperand(0);
+    IRBuilder<> B(Free);
+    Value *NonNull = B.CreateICmpNE(Obj, Constant::getNullValue(Obj->getType()));
+    Instruction *Then = SplitBlockAndInsertIfThen(NonNull, Free, false);
+
+    IRBuilder<> T(Then);
+    Value *Slot = T.CreateInBoundsGEP(L.NewTy, T.CreateBitCast(Obj, L.NewTy->getPointerTo()),
+                                      {T.getInt32(0), T.getInt32(L.coldSlot)});
+    Value *Cold = T.CreateLoad(L.ColdTy->getPointerTo(), Slot);
+    T.CreateCall(Free->getFunctionType(), Free->getCalledOperand(),
+                 {T.CreateBitCast(Cold, Obj->getType())});
+}
+
+void ReorderStructFields(Module *M)
+{
+    const DataLayout &DL = M->getDataLayout();
+    TypeSafeStructs TS(M);
+    std::vector<StructType *> types = TS.types();
+    if (types.empty())
+        return;
+
+    DenseMap<BasicBlock *, double> weight;
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration())
+            blockWeights(*f, weight);
+
+    for (StructType *S : types) {
+        std::vector<double> heat(S->getNumElements(), 0.0);
+        for (GetElementPtrInst *GEP : TS.geps(S)) {
+            int f = AccessedField(GEP);
+            if (f < 0)
+                continue;
+            bool other = false;
+            for (User *U : GEP->users()) {
+                if (isa<LoadInst>(U) || isa<StoreInst>(U))
+                    heat[f] += weight[cast<Instruction>(U)->getParent()];
+                else
+                    other = true;
+            }
+            if (other)
+                heat[f] += weight[GEP->getParent()];
+        }
+
+        Layout L;
+        if (!planLayout(S, heat, isSplittable(S, TS, DL), DL, L))
+            continue;
+
+        uint64_t OldSize = DL.getTypeAllocSize(S);
+        uint64_t NewSize = DL.getTypeAllocSize(L.NewTy);
+        for (CallInst *CI : TS.mallocs(S)) {
+            if (NewSize != OldSize)
+                CI->setArgOperand(0, RescaleAllocationSize(CI->getArgOperand(0),
+                                                           OldSize, NewSize, CI));
+            if (L.ColdTy)
+                allocateColdPart(CI, L, DL);
+        }
+        if (L.ColdTy)
+            for (CallInst *CI : TS.frees(S))
+                freeColdPart(CI, L);
+        for (GetElementPtrInst *GEP : TS.geps(S))
+            rewriteGEP(GEP, L, DL);
+
+        SLReordered++;
+        if (L.ColdTy) {
+            SLSplit++;
+            SLColdFields += L.ColdTy->getNumElements();
+        }
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef STRUCTLAYOUT_H
+#define STRUCTLAYOUT_H
+
+#include "llvm/IR/Module.h"
+
+/* Reorder the fields of type-safe structs by access frequency and move
+   rarely used fields into a separately allocated cold structure. */
+void ReorderStructFields(llvm::Module *M);
+
+#endif
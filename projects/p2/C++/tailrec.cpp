@@ -0,0 +1,574 @@
+/*
+ * File: tailrec.cpp
+ *
+ * Description:
+ *   Recursion-to-loop conversion. The entry block of a converted function
+ *   becomes a loop header with one phi per argument, and the recursive
+ *   calls below become branches back to it.
+ *
+ *   1. A self call whose result is returned directly (or nothing follows
+ *      it in a void function) is a tail call.
+ *   2. "return x op f(...)" with an integer add, mul, and, or or xor is a
+ *      tail call through an accumulator: the header carries "acc", the
+ *      call site folds x into it, and every other return yields acc op v.
+ *   3. A void function ending a block with a run of self calls, such as
+ *      hanoi's three calls to mov, pushes the arguments of all but the
+ *      first call onto an explicit heap stack and branches with the first.
+ *      The returns pop the next pending call, and the real return happens
+ *      once the stack is empty. Only done when no instruction in the run
+ *      reads memory or has side effects (the pushed arguments are the
+ *      values the later calls would have seen) and the function cannot
+ *      unwind (the stack would leak).
+ *
+ *   Stack slots are reused across iterations, so no alloca may have its
+ *   address taken. Run after -mem2reg; in -O0 code only the last call of
+ *   a run is converted.
+ *
+ *   With -tailrec-depth each converted function keeps the deepest
+ *   recursion it would have reached, and the program prints it to stderr
+ *   on exit (link with libp2rt).
+ */
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "tailrec.h"
+
+using namespace llvm;
+
+static cl::opt<bool>
+        TailRecDepth("tailrec-depth",
+                     cl::desc("Record the recursion depth -tailrec saved and print it at exit (link with libp2rt)."),
+                     cl::init(false));
+
+static llvm::Statistic TailRecFunctions = {"", "TailRecFunctions", "Tail recursion functions converted to loops"};
+static llvm::Statistic TailRecCalls = {"", "TailRecCalls", "Tail recursion self tail calls turned into branches"};
+static llvm::Statistic TailRecAccum = {"", "TailRecAccum", "Tail recursion calls folded into an accumulator"};
+static llvm::Statistic TailRecStack = {"", "TailRecStack", "Tail recursion calls moved onto an explicit stack"};
+
+struct TailSite {
+    CallInst *call;
+    BinaryOperator *acc;   // "x op call", or null
+};
+
+struct StackSite {
+    std::vector<CallInst *> calls;   // in program order, all self calls
+};
+
+struct LoopState {
+    BasicBlock *header;
+    std::vector<PHINode *> args;
+    PHINode *acc;
+    Instruction::BinaryOps accOp;
+    PHINode *depth;
+    // explicit stack
+    StructType *frameTy;
+    AllocaInst *bufSlot, *spSlot, *capSlot;
+};
+
+static bool isSelfCall(Instruction *I, Function &F)
+{
+    auto *CI = dyn_cast_or_null<CallInst>(I);
+    return CI && CI->getCalledFunction() == &F && !CI->isMustTailCall() &&
+           CI->arg_size() == F.arg_size();
+}
+
+//***********************Function onlyLoadedOrStored***********************//
+// true if the address V is only used to load or store through it, maybe
+// after GEPs and casts
+//*************************************************************************//
+
+static bool onlyLoadedOrStored(Value *V)
+{
+    for (User *U : V->users()) {
+        if (isa<LoadInst>(U))
+            continue;
+        if (auto *SI = dyn_cast<StoreInst>(U)) {
+            if (SI->getValueOperand() == V)
+                return false;
+            continue;
+        }
+        if (auto *II = dyn_cast<IntrinsicInst>(U))
+            if (II->isLifetimeStartOrEnd() || isa<DbgInfoIntrinsic>(II))
+                continue;
+        if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U)) {
+            if (!onlyLoadedOrStored(U))
+                return false;
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+static bool isConvertible(Function &F)
+{
+    if (F.isDeclaration() || F.isVarArg() || F.callsFunctionThatReturnsTwice() ||
+        F.hasFnAttribute(Attribute::Naked))
+        return false;
+    for (Argument &A : F.args())
+        if (A.hasByValAttr() || A.hasInAllocaAttr() || A.hasPreallocatedAttr())
+            return false;
+    for (BasicBlock &BB : F)
+        for (Instruction &I : BB)
+            if (isa<AllocaInst>(&I) && !onlyLoadedOrStored(&I))
+                return false;
+    return true;
+}
+
+//***********************Function endsInSelfCall***************************//
+// true if P ends "call F; br" or "call F; v = x op call; br" and V is
+// what it hands to the return block
+//*************************************************************************//
+
+static bool endsInSelfCall(BasicBlock *P, Value *V, Function &F)
+{
+    Instruction *Prev = P->getTerminator()->getPrevNonDebugInstruction();
+    if (isSelfCall(Prev, F))
+        return !V || V == Prev;
+    if (auto *BO = dyn_cast_or_null<BinaryOperator>(Prev))
+        return V == BO && isSelfCall(BO->getPrevNonDebugInstruction(), F);
+    return false;
+}
+
+//***********************Function foldReturnBlocks*************************//
+// clang sends every return through one block ("ret phi"). Give the
+// predecessors that end in a self call their own return so the call is
+// next to it.
+//*************************************************************************//
+
+static void foldReturnBlocks(Function &F)
+{
+    std::vector<BasicBlock *> rets;
+    for (BasicBlock &BB : F)
+        if (isa<ReturnInst>(BB.getTerminator()) && &BB != &F.getEntryBlock())
+            rets.push_back(&BB);
+
+    for (BasicBlock *R : rets) {
+        auto *RI = cast<ReturnInst>(R->getTerminator());
+        PHINode *PN = nullptr;
+        if (R->size() == 2) {
+            PN = dyn_cast<PHINode>(&R->front());
+            if (!PN || RI->getReturnValue() != PN)
+                continue;
+        } else if (R->size() != 1) {
+            continue;
+        }
+
+        std::vector<BasicBlock *> preds(pred_begin(R), pred_end(R));
+        for (BasicBlock *P : preds) {
+            // removePredecessor drops the phi once it has one value left
+            PN = dyn_cast<PHINode>(&R->front());
+            auto *Br = dyn_cast<BranchInst>(P->getTerminator());
+            if (!Br || Br->isConditional())
+                continue;
+            Value *V = PN ? PN->getIncomingValueForBlock(P) : RI->getReturnValue();
+            if (!endsInSelfCall(P, V, F))
+                continue;
+            ReturnInst::Create(F.getContext(), V, Br);
+            Br->eraseFromParent();
+            R->removePredecessor(P);
+        }
+        if (pred_empty(R))
+            DeleteDeadBlock(R);
+    }
+}
+
+static bool isHoistable(Instruction *I)
+{
+    return !isa<PHINode>(I) && !isa<CallBase>(I) && !isa<AllocaInst>(I) &&
+           !I->mayReadOrWriteMemory() && !I->mayHaveSideEffects() &&
+           isSafeToSpeculativelyExecute(I);
+}
+
+//***********************Function findVoidSite*****************************//
+// the run of self calls (with hoistable instructions between them) that
+// ends BB before its "ret void". The hoistable instructions are moved
+// above the first call, so the calls end up next to each other.
+//*************************************************************************//
+
+static std::vector<CallInst *> findVoidSite(BasicBlock &BB, Function &F, bool stack)
+{
+    std::vector<CallInst *> calls;
+    std::vector<Instruction *> between;
+    Instruction *I = BB.getTerminator()->getPrevNonDebugInstruction();
+    for (; I; I = I->getPrevNonDebugInstruction()) {
+        if (isSelfCall(I, F)) {
+            calls.insert(calls.begin(), cast<CallInst>(I));
+            if (!stack)
+                break;
+        } else if (isHoistable(I)) {
+            between.insert(between.begin(), I);
+        } else {
+            break;
+        }
+    }
+    if (calls.empty())
+        return calls;
+    for (Instruction *H : between)
+        if (calls[0]->comesBefore(H))
+            H->moveBefore(calls[0]);
+    return calls;
+}
+
+static void findSites(Function &F, std::vector<TailSite> &tails, std::vector<StackSite> &stacks)
+{
+    bool isVoid = F.getReturnType()->isVoidTy();
+    bool stack = isVoid && F.doesNotThrow();
+    Instruction::BinaryOps accOp = Instruction::BinaryOpsEnd;
+
+    for (BasicBlock &BB : F) {
+        auto *RI = dyn_cast<ReturnInst>(BB.getTerminator());
+        if (!RI)
+            continue;
+
+        if (isVoid) {
+            std::vector<CallInst *> calls = findVoidSite(BB, F, stack);
+            if (calls.size() == 1)
+                tails.push_back({calls[0], nullptr});
+            else if (calls.size() > 1)
+                stacks.push_back({calls});
+            continue;
+        }
+
+        Value *RV = RI->getReturnValue();
+        Instruction *Prev = RI->getPrevNonDebugInstruction();
+        if (isSelfCall(Prev, F) && RV == Prev) {
+            tails.push_back({cast<CallInst>(Prev), nullptr});
+            continue;
+        }
+
+        auto *BO = dyn_cast_or_null<BinaryOperator>(Prev);
+        if (!BO || RV != BO || !BO->getType()->isIntegerTy() ||
+            !BO->isAssociative() || !BO->isCommutative())
+            continue;
+        Instruction *CallI = BO->getPrevNonDebugInstruction();
+        if (!isSelfCall(CallI, F) || !CallI->hasOneUse())
+            continue;
+        Value *X = BO->getOperand(0) == CallI ? BO->getOperand(1) : BO->getOperand(0);
+        if (X == CallI)
+            continue;
+        // all accumulations in one function share the accumulator
+        if (accOp != Instruction::BinaryOpsEnd && BO->getOpcode() != accOp)
+            continue;
+        accOp = BO->getOpcode();
+        tails.push_back({cast<CallInst>(CallI), BO});
+    }
+}
+
+//***********************Function createHeader*****************************//
+// split a new entry block off for the allocas (and the explicit stack)
+// and turn the old entry into the loop header
+//*************************************************************************//
+
+static LoopState createHeader(Function &F, BinaryOperator *accExample, bool stack)
+{
+    LLVMContext &C = F.getContext();
+    Type *I64 = Type::getInt64Ty(C);
+    LoopState L = {};
+
+    BasicBlock *Header = &F.getEntryBlock();
+    BasicBlock *Entry = BasicBlock::Create(C, "", &F, Header);
+    Entry->takeName(Header);
+    Header->setName("tailrecurse");
+    BranchInst *Br = BranchInst::Create(Header, Entry);
+    L.header = Header;
+
+    std::vector<AllocaInst *> allocas;
+    for (Instruction &I : *Header)
+        if (auto *AI = dyn_cast<AllocaInst>(&I))
+            if (isa<Constant>(AI->getArraySize()))
+                allocas.push_back(AI);
+    for (AllocaInst *AI : allocas)
+        AI->moveBefore(Br);
+
+    Instruction *First = &Header->front();
+    for (Argument &A : F.args()) {
+        PHINode *PN = PHINode::Create(A.getType(), 2, A.getName() + ".tr", First);
+        A.replaceAllUsesWith(PN);
+        PN->addIncoming(&A, Entry);
+        L.args.push_back(PN);
+    }
+
+    if (accExample) {
+        Type *Ty = accExample->getType();
+        L.acc = PHINode::Create(Ty, 2, "accumulator.tr", First);
+        L.accOp = accExample->getOpcode();
+        L.acc->addIncoming(ConstantExpr::getBinOpIdentity(accExample->getOpcode(), Ty), Entry);
+    }
+
+    if (TailRecDepth) {
+        L.depth = PHINode::Create(I64, 2, "depth.tr", First);
+        L.depth->addIncoming(ConstantInt::get(I64, 1), Entry);
+    }
+
+    if (stack) {
+        std::vector<Type *> fields;
+        for (Argument &A : F.args())
+            fields.push_back(A.getType());
+        if (TailRecDepth)
+            fields.push_back(I64);
+        L.frameTy = StructType::create(C, fields, ("tailrec.frame." + F.getName()).str());
+
+        IRBuilder<> B(Br);
+        PointerType *FramePtrTy = L.frameTy->getPointerTo();
+        L.bufSlot = B.CreateAlloca(FramePtrTy, nullptr, "tailrec.buf");
+        L.spSlot = B.CreateAlloca(I64, nullptr, "tailrec.sp");
+        L.capSlot = B.CreateAlloca(I64, nullptr, "tailrec.cap");
+        B.CreateStore(ConstantPointerNull::get(FramePtrTy), L.bufSlot);
+        B.CreateStore(ConstantInt::get(I64, 0), L.spSlot);
+        B.CreateStore(ConstantInt::get(I64, 0), L.capSlot);
+    }
+    return L;
+}
+
+//***********************Function branchToHeader***************************//
+// end the block of B at the loop header, starting the next iteration
+// with args (and the given accumulator and depth)
+//*************************************************************************//
+
+static void branchToHeader(IRBuilder<> &B, LoopState &L, ArrayRef<Value *> args,
+                           Value *acc, Value *depth)
+{
+    BasicBlock *From = B.GetInsertBlock();
+    for (unsigned a = 0; a < args.size(); a++)
+        L.args[a]->addIncoming(args[a], From);
+    if (L.acc)
+        L.acc->addIncoming(acc, From);
+    if (L.depth)
+        L.depth->addIncoming(depth, From);
+    B.CreateBr(L.header);
+}
+
+static std::vector<Value *> callArgs(CallInst *CI)
+{
+    return std::vector<Value *>(CI->arg_begin(), CI->arg_end());
+}
+
+static void convertTail(TailSite &S, LoopState &L)
+{
+    Instruction *RI = S.call->getParent()->getTerminator();
+    IRBuilder<> B(RI);
+    Value *acc = L.acc;
+    if (S.acc) {
+        // read x only now: if it was an argument it is the header phi by now
+        Value *X = S.acc->getOperand(S.acc->getOperand(0) == S.call ? 1 : 0);
+        acc = B.CreateBinOp(S.acc->getOpcode(), L.acc, X, "accumulate.tr");
+    }
+    Value *depth = L.depth ? B.CreateAdd(L.depth, B.getInt64(1)) : nullptr;
+    branchToHeader(B, L, callArgs(S.call), acc, depth);
+
+    RI->eraseFromParent();
+    if (S.acc)
+        S.acc->eraseFromParent();
+    S.call->eraseFromParent();
+    TailRecCalls++;
+    if (S.acc)
+        TailRecAccum++;
+}
+
+//***********************Function convertStack*****************************//
+// push the arguments of calls 2..k (last first, so call 2 is popped
+// first) and continue with call 1, growing the stack with realloc
+// (aborting if it fails)
+//*************************************************************************//
+
+static void convertStack(StackSite &S, LoopState &L, Module *M)
+{
+    LLVMContext &C = M->getContext();
+    const DataLayout &DL = M->getDataLayout();
+    Type *I64 = Type::getInt64Ty(C);
+    Type *I8PtrTy = Type::getInt8PtrTy(C);
+    FunctionCallee Realloc = M->getOrInsertFunction("realloc", I8PtrTy, I8PtrTy, I64);
+    PointerType *FramePtrTy = L.frameTy->getPointerTo();
+    unsigned pushes = S.calls.size() - 1;
+
+    Instruction *RI = S.calls[0]->getParent()->getTerminator();
+    IRBuilder<> B(RI);
+    Value *sp = B.CreateLoad(I64, L.spSlot, "tailrec.sp");
+    Value *need = B.CreateAdd(sp, B.getInt64(pushes));
+    Value *cap = B.CreateLoad(I64, L.capSlot, "tailrec.cap");
+    Instruction *Grow = SplitBlockAndInsertIfThen(B.CreateICmpUGT(need, cap), RI, false);
+
+    IRBuilder<> G(Grow);
+    Value *newCap = G.CreateShl(need, 1);
+    Value *bytes = G.CreateMul(newCap, G.getInt64(DL.getTypeAllocSize(L.frameTy)));
+    Value *old = G.CreateBitCast(G.CreateLoad(FramePtrTy, L.bufSlot), I8PtrTy);
+    Value *grown = G.CreateCall(Realloc, {old, bytes});
+    // out of memory: stop here rather than push frames through null
+    Instruction *Fail = SplitBlockAndInsertIfThen(G.CreateIsNull(grown), Grow, true);
+    IRBuilder<>(Fail).CreateCall(M->getOrInsertFunction("abort", Type::getVoidTy(C)));
+    G.SetInsertPoint(Grow);
+    G.CreateStore(G.CreateBitCast(grown, FramePtrTy), L.bufSlot);
+    G.CreateStore(newCap, L.capSlot);
+
+    B.SetInsertPoint(RI);
+    Value *depth = L.depth ? B.CreateAdd(L.depth, B.getInt64(1)) : nullptr;
+    Value *buf = B.CreateLoad(FramePtrTy, L.bufSlot, "tailrec.buf");
+    for (unsigned p = 0; p < pushes; p++) {
+        CallInst *CI = S.calls[S.calls.size() - 1 - p];
+        Value *Frame = B.CreateInBoundsGEP(L.frameTy, buf, B.CreateAdd(sp, B.getInt64(p)));
+        for (unsigned a = 0; a < CI->arg_size(); a++)
+            B.CreateStore(CI->getArgOperand(a), B.CreateStructGEP(L.frameTy, Frame, a));
+        if (depth)
+            B.CreateStore(depth, B.CreateStructGEP(L.frameTy, Frame, CI->arg_size()));
+    }
+    B.CreateStore(need, L.spSlot);
+    branchToHeader(B, L, callArgs(S.calls[0]), nullptr, depth);
+
+    RI->eraseFromParent();
+    for (CallInst *CI : S.calls)
+        CI->eraseFromParent();
+    TailRecCalls++;
+    TailRecStack += pushes;
+}
+
+//***********************Function addStackReturns**************************//
+// every "ret void" first pops the next pending call; the function only
+// returns (and frees the stack) once there is none
+//*************************************************************************//
+
+static void addStackReturns(Function &F, LoopState &L)
+{
+    LLVMContext &C = F.getContext();
+    Module *M = F.getParent();
+    Type *I64 = Type::getInt64Ty(C);
+    Type *I8PtrTy = Type::getInt8PtrTy(C);
+    PointerType *FramePtrTy = L.frameTy->getPointerTo();
+    FunctionCallee Free = M->getOrInsertFunction("free", Type::getVoidTy(C), I8PtrTy);
+
+    std::vector<ReturnInst *> rets;
+    for (BasicBlock &BB : F)
+        if (auto *RI = dyn_cast<ReturnInst>(BB.getTerminator()))
+            rets.push_back(RI);
+
+    BasicBlock *Pop = BasicBlock::Create(C, "tailrec.pop", &F);
+    BasicBlock *Next = BasicBlock::Create(C, "tailrec.next", &F);
+    BasicBlock *Done = BasicBlock::Create(C, "tailrec.done", &F);
+    for (ReturnInst *RI : rets) {
+        BranchInst::Create(Pop, RI);
+        RI->eraseFromParent();
+    }
+
+    IRBuilder<> B(Pop);
+    Value *sp = B.CreateLoad(I64, L.spSlot, "tailrec.sp");
+    B.CreateCondBr(B.CreateICmpEQ(sp, B.getInt64(0)), Done, Next);
+
+    B.SetInsertPoint(Next);
+    Value *top = B.CreateSub(sp, B.getInt64(1));
+    B.CreateStore(top, L.spSlot);
+    Value *buf = B.CreateLoad(FramePtrTy, L.bufSlot, "tailrec.buf");
+    Value *Frame = B.CreateInBoundsGEP(L.frameTy, buf, top);
+    std::vector<Value *> args;
+    for (unsigned a = 0; a < F.arg_size(); a++)
+        args.push_back(B.CreateLoad(L.frameTy->getElementType(a),
+                                    B.CreateStructGEP(L.frameTy, Frame, a)));
+    Value *depth = nullptr;
+    if (L.depth)
+        depth = B.CreateLoad(I64, B.CreateStructGEP(L.frameTy, Frame, F.arg_size()));
+    branchToHeader(B, L, args, nullptr, depth);
+
+    B.SetInsertPoint(Done);
+    buf = B.CreateLoad(FramePtrTy, L.bufSlot, "tailrec.buf");
+    B.CreateCall(Free, {B.CreateBitCast(buf, I8PtrTy)});
+    B.CreateRetVoid();
+}
+
+//***********************Function recordDepth******************************//
+// keep the deepest depth.tr seen in a global, reported at exit
+//*************************************************************************//
+
+static GlobalVariable *recordDepth(Function &F, LoopState &L)
+{
+    Module *M = F.getParent();
+    Type *I64 = Type::getInt64Ty(M->getContext());
+    auto *Max = new GlobalVariable(*M, I64, false, GlobalValue::InternalLinkage,
+                                   ConstantInt::get(I64, 0), "tailrec.depth." + F.getName());
+
+    IRBuilder<> B(&*L.header->getFirstInsertionPt());
+    Value *old = B.CreateLoad(I64, Max);
+    Value *deeper = B.CreateICmpUGT(L.depth, old);
+    B.CreateStore(B.CreateSelect(deeper, L.depth, old), Max);
+    return Max;
+}
+
+static void addDepthReport(Module *M, std::vector<std::pair<Function *, GlobalVariable *>> &depths)
+{
+    LLVMContext &C = M->getContext();
+    Type *VoidTy = Type::getVoidTy(C);
+    Type *I64 = Type::getInt64Ty(C);
+    FunctionCallee Report = M->getOrInsertFunction("tailrec_report", VoidTy,
+                                                   Type::getInt8PtrTy(C), I64);
+
+    Function *Dtor = Function::Create(FunctionType::get(VoidTy, false),
+                                      GlobalValue::InternalLinkage, "tailrec.report", M);
+    IRBuilder<> B(BasicBlock::Create(C, "entry", Dtor));
+    for (auto &d : depths)
+        B.CreateCall(Report, {B.CreateGlobalStringPtr(d.first->getName()),
+                              B.CreateLoad(I64, d.second)});
+    B.CreateRetVoid();
+    appendToGlobalDtors(*M, Dtor, 0);
+}
+
+static bool convertFunction(Function &F, GlobalVariable *&depth)
+{
+    if (!isConvertible(F))
+        return false;
+
+    foldReturnBlocks(F);
+    std::vector<TailSite> tails;
+    std::vector<StackSite> stacks;
+    findSites(F, tails, stacks);
+    if (tails.empty() && stacks.empty())
+        return false;
+
+    BinaryOperator *accExample = nullptr;
+    for (TailSite &S : tails)
+        if (S.acc)
+            accExample = S.acc;
+
+    LoopState L = createHeader(F, accExample, !stacks.empty());
+    for (TailSite &S : tails)
+        convertTail(S, L);
+    for (StackSite &S : stacks)
+        convertStack(S, L, F.getParent());
+
+    // the calls that are left still return acc op v
+    if (L.acc)
+        for (BasicBlock &BB : F)
+            if (auto *RI = dyn_cast<ReturnInst>(BB.getTerminator())) {
+                IRBuilder<> B(RI);
+                RI->setOperand(0, B.CreateBinOp(L.accOp, L.acc,
+                                                RI->getReturnValue(), "accumulate.ret"));
+            }
+
+    if (!stacks.empty())
+        addStackReturns(F, L);
+    if (L.depth)
+        depth = recordDepth(F, L);
+
+    TailRecFunctions++;
+    return true;
+}
+
+void EliminateTailRecursion(Module *M)
+{
+    std::vector<std::pair<Function *, GlobalVariable *>> depths;
+    for (auto f = M->begin(); f != M->end(); f++) {
+        GlobalVariable *depth = nullptr;
+        if (convertFunction(*f, depth) && depth)
+            depths.push_back(std::make_pair(&*f, depth));
+    }
+    if (!depths.empty())
+        addDepthReport(M, depths);
+}
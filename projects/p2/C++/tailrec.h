@@ -0,0 +1,11 @@
+#ifndef TAILREC_H
+#define TAILREC_H
+
+#include "llvm/IR/Module.h"
+
+/* Turn self tail calls (and "return x op f(...)" accumulations) into
+   loops, and move trailing runs of void self calls onto an explicit
+   stack. */
+void EliminateTailRecursion(llvm::Module *M);
+
+#endif
@@ -0,0 +1,118 @@
+; ModuleID = 'coalesce0'
+; CHECK-LABEL: source_filename = "coalesce0"
+source_filename = "coalesce0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+
+%struct.state = type { i16, i8, i8, i32 }
+
+; Two bytes and a short tile four bytes: one i32 load.
+; CHECK-LABEL: define i32 @unpack(%struct.state* %s)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %vp = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 0
+; CHECK-NEXT: bitcast i16* %vp to i32*
+; CHECK-NEXT: %coalesced = load i32, i32* %{{[0-9]+}}, align 4
+; CHECK-NOT: load
+; CHECK: ret i32
+define i32 @unpack(%struct.state* %s) {
+entry:
+  %vp = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 0
+  %v = load i16, i16* %vp, align 4
+  %ip = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 1
+  %i = load i8, i8* %ip, align 2
+  %jp = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 2
+  %j = load i8, i8* %jp, align 1
+  %v32 = sext i16 %v to i32
+  %i32 = zext i8 %i to i32
+  %j32 = zext i8 %j to i32
+  %a = add i32 %v32, %i32
+  %b = add i32 %a, %j32
+  ret i32 %b
+}
+
+; The stores move down to the last one; the store to a local in between
+; cannot alias.
+; CHECK-LABEL: define void @update(%struct.state* %s, i16 %v, i8 %i)
+; CHECK: store i32 1, i32* %tmp
+; CHECK-NOT: store i8
+; CHECK: store i32 %{{[0-9]+}}, i32* %{{[0-9]+}}, align 4
+; CHECK-NEXT: ret void
+define void @update(%struct.state* %s, i16 %v, i8 %i) {
+entry:
+  %tmp = alloca i32, align 4
+  %vp = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 0
+  store i16 %v, i16* %vp, align 4
+  store i32 1, i32* %tmp, align 4
+  %ip = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 1
+  store i8 %i, i8* %ip, align 2
+  %jp = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 2
+  store i8 0, i8* %jp, align 1
+  ret void
+}
+
+; A call in between may read the bytes, so only the two byte stores after
+; it are merged.
+; CHECK-LABEL: define void @blocked(%struct.state* %s, i16 %v, i16 %w)
+; CHECK: store i16 %v
+; CHECK: call void @observe
+; CHECK: store i16 513, i16* %{{[0-9]+}}, align 2
+define void @blocked(%struct.state* %s, i16 %v, i16 %w) {
+entry:
+  %vp = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 0
+  store i16 %v, i16* %vp, align 4
+  call void @observe(%struct.state* %s)
+  %ip = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 1
+  store i8 1, i8* %ip, align 2
+  %jp = getelementptr inbounds %struct.state, %struct.state* %s, i32 0, i32 2
+  store i8 2, i8* %jp, align 1
+  ret void
+}
+
+declare void @observe(%struct.state*)
+
+; A pointer through a select or phi may be the uncaptured local itself, so
+; the load in between keeps the stores apart.
+; CHECK-LABEL: define i16 @viaselect(i1 %c)
+; CHECK: store i16 7, i16* %s.f0
+; CHECK-NEXT: %v = load i16, i16* %p.f0
+; CHECK-NEXT: bitcast i8* %s.f1 to i16*
+; CHECK-NEXT: store i16 513
+define i16 @viaselect(i1 %c) {
+entry:
+  %s = alloca [4 x i8], align 4
+  %t = alloca [4 x i8], align 4
+  %s.f0 = bitcast [4 x i8]* %s to i16*
+  %s.f1 = getelementptr [4 x i8], [4 x i8]* %s, i64 0, i64 2
+  %s.f2 = getelementptr [4 x i8], [4 x i8]* %s, i64 0, i64 3
+  %p = select i1 %c, [4 x i8]* %s, [4 x i8]* %t
+  %p.f0 = bitcast [4 x i8]* %p to i16*
+  store i16 7, i16* %s.f0, align 4
+  %v = load i16, i16* %p.f0, align 2
+  store i8 1, i8* %s.f1, align 2
+  store i8 2, i8* %s.f2, align 1
+  ret i16 %v
+}
+
+; CHECK-LABEL: define i16 @viaphi(i1 %c)
+; CHECK: store i16 7, i16* %s.f0
+; CHECK-NEXT: %v = load i16, i16* %p.f0
+; CHECK-NEXT: bitcast i8* %s.f1 to i16*
+; CHECK-NEXT: store i16 513
+define i16 @viaphi(i1 %c) {
+entry:
+  %s = alloca [4 x i8], align 4
+  %t = alloca [4 x i8], align 4
+  br i1 %c, label %join, label %other
+other:
+  br label %join
+join:
+  %p = phi [4 x i8]* [%s, %entry], [%t, %other]
+  %s.f0 = bitcast [4 x i8]* %s to i16*
+  %s.f1 = getelementptr [4 x i8], [4 x i8]* %s, i64 0, i64 2
+  %s.f2 = getelementptr [4 x i8], [4 x i8]* %s, i64 0, i64 3
+  %p.f0 = bitcast [4 x i8]* %p to i16*
+  store i16 7, i16* %s.f0, align 4
+  %v = load i16, i16* %p.f0, align 2
+  store i8 1, i8* %s.f1, align 2
+  store i8 2, i8* %s.f2, align 1
+  ret i16 %v
+}
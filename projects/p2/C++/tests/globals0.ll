@@ -0,0 +1,90 @@
+; ModuleID = 'globals0'
+; CHECK-LABEL: source_filename = "globals0"
+source_filename = "globals0"
+
+; CHECK-NOT: @size
+; CHECK: @table = constant [4 x i32] [i32 1, i32 2, i32 3, i32 4]
+; CHECK-NOT: @scale
+; CHECK-NOT: @acc
+; CHECK-NOT: @tmp
+; CHECK: @shared = global i32 0
+; CHECK: @depth = global i32 0
+@size = global i32 64, align 4
+@table = global [4 x i32] [i32 1, i32 2, i32 3, i32 4], align 16
+@scale = global i32 0, align 4
+@acc = global i32 0, align 4
+@tmp = global i32 0, align 4
+@shared = global i32 0, align 4
+@depth = global i32 0, align 4
+
+; CHECK-LABEL: define i32 @work(i32 %x, i32 %i)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: getelementptr
+; CHECK-NEXT: load i32, i32* %p
+; CHECK-NEXT: add i32 %x, 3
+; CHECK-NEXT: mul i32 %0, 3
+; CHECK-NEXT: add i32 %1, %v
+; CHECK-NEXT: store i32 %2, i32* @shared
+; CHECK-NEXT: ret i32 %2
+define i32 @work(i32 %x, i32 %i) {
+entry:
+  store i32 %x, i32* @tmp, align 4
+  %t = load i32, i32* @tmp, align 4
+  %e = load i32, i32* getelementptr inbounds ([4 x i32], [4 x i32]* @table, i32 0, i32 2), align 4
+  %p = getelementptr inbounds [4 x i32], [4 x i32]* @table, i32 0, i32 %i
+  %v = load i32, i32* %p, align 4
+  %s = load i32, i32* @scale, align 4
+  %0 = add i32 %t, %e
+  %1 = mul i32 %0, %s
+  %2 = add i32 %1, %v
+  store i32 %2, i32* @shared, align 4
+  ret i32 %2
+}
+
+; @descend is re-entered through %p, which the call graph sends to its
+; calls-external node, so each activation must still see the store made by
+; the inner ones.
+; CHECK-LABEL: define void @descend(i32 %n, void (i32)* %p)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: store i32 %n, i32* @depth
+; CHECK: call void %p(i32 %m)
+; CHECK-NEXT: load i32, i32* @depth
+define void @descend(i32 %n, void (i32)* %p) {
+entry:
+  store i32 %n, i32* @depth, align 4
+  %c = icmp sgt i32 %n, 0
+  br i1 %c, label %rec, label %done
+rec:
+  %m = sub i32 %n, 1
+  call void %p(i32 %m)
+  %d = load i32, i32* @depth, align 4
+  call void @report(i32 %d)
+  br label %done
+done:
+  ret void
+}
+
+define void @again(i32 %n) {
+entry:
+  call void @descend(i32 %n, void (i32)* @again)
+  ret void
+}
+
+declare void @report(i32)
+
+; CHECK-LABEL: define i32 @main()
+; CHECK-NEXT: entry:
+; CHECK-NEXT: call i32 @work(i32 64, i32 1)
+; CHECK-NEXT: load i32, i32* @shared
+define i32 @main() {
+entry:
+  store i32 3, i32* @scale, align 4
+  %sz = load i32, i32* @size, align 4
+  store i32 %sz, i32* @acc, align 4
+  %a = load i32, i32* @acc, align 4
+  %r = call i32 @work(i32 %a, i32 1)
+  %sh = load i32, i32* @shared, align 4
+  %sum = add i32 %r, %sh
+  call void @descend(i32 2, void (i32)* @again)
+  ret i32 %sum
+}
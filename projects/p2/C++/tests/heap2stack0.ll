@@ -0,0 +1,45 @@
+; ModuleID = 'heap2stack0'
+; CHECK-LABEL: source_filename = "heap2stack0"
+source_filename = "heap2stack0"
+
+%struct._QITEM = type { i32, i32, i32, %struct._QITEM* }
+
+declare i8* @malloc(i64)
+declare void @free(i8*)
+
+; CHECK-LABEL: define i32 @relax(i32 %n)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %q.stack = alloca i8, i64 24, align 16
+; CHECK-NOT: call i8* @malloc
+; CHECK-NOT: call void @free
+; CHECK: ret i32
+define i32 @relax(i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %loop ]
+  %sum = phi i32 [ 0, %entry ], [ %sum1, %loop ]
+  %q = call i8* @malloc(i64 24)
+  %item = bitcast i8* %q to %struct._QITEM*
+  %dist = getelementptr inbounds %struct._QITEM, %struct._QITEM* %item, i32 0, i32 1
+  store i32 %i, i32* %dist, align 4
+  %d = load i32, i32* %dist, align 4
+  %sum1 = add i32 %sum, %d
+  call void @free(i8* %q)
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %loop, label %exit
+
+exit:
+  ret i32 %sum1
+}
+
+; CHECK-LABEL: define %struct._QITEM* @keep(i32 %n)
+; CHECK: call i8* @malloc(i64 24)
+define %struct._QITEM* @keep(i32 %n) {
+entry:
+  %q = call i8* @malloc(i64 24)
+  %item = bitcast i8* %q to %struct._QITEM*
+  ret %struct._QITEM* %item
+}
@@ -0,0 +1,72 @@
+; ModuleID = 'inline0'
+; CHECK-LABEL: source_filename = "inline0"
+source_filename = "inline0"
+
+@num = global [4 x i32] zeroinitializer, align 16
+
+; CHECK-NOT: define internal void @bump
+define internal void @bump(i32 %f, i32 %t) {
+entry:
+  %pf = getelementptr [4 x i32], [4 x i32]* @num, i32 0, i32 %f
+  %a = load i32, i32* %pf, align 4
+  %a1 = sub i32 %a, 1
+  store i32 %a1, i32* %pf, align 4
+  %pt = getelementptr [4 x i32], [4 x i32]* @num, i32 0, i32 %t
+  %b = load i32, i32* %pt, align 4
+  %b1 = add i32 %b, 1
+  store i32 %b1, i32* %pt, align 4
+  ret void
+}
+
+; CHECK-LABEL: define i32 @pick(i32 %n, i32 %x)
+define i32 @pick(i32 %n, i32 %x) {
+entry:
+  %c = icmp eq i32 %n, 1
+  br i1 %c, label %small, label %big
+
+small:
+  %r = add i32 %x, 1
+  ret i32 %r
+
+big:
+  %m0 = mul i32 %x, %n
+  %m1 = mul i32 %m0, %n
+  %m2 = mul i32 %m1, %n
+  %m3 = mul i32 %m2, %n
+  %m4 = mul i32 %m3, %n
+  %m5 = mul i32 %m4, %n
+  %m6 = mul i32 %m5, %n
+  %m7 = mul i32 %m6, %n
+  ret i32 %m7
+}
+
+; CHECK-LABEL: define i32 @rec(i32 %n)
+; CHECK: call i32 @rec
+define i32 @rec(i32 %n) {
+entry:
+  %c = icmp sgt i32 %n, 0
+  br i1 %c, label %recurse, label %done
+
+recurse:
+  %n1 = sub i32 %n, 1
+  %r = call i32 @rec(i32 %n1)
+  %r1 = add i32 %r, %n
+  ret i32 %r1
+
+done:
+  ret i32 0
+}
+
+; CHECK-LABEL: define i32 @driver(i32 %x, i32 %y)
+; CHECK-NOT: call void @bump
+; CHECK-NOT: call i32 @pick(i32 1
+; CHECK: call i32 @pick(i32 %y, i32 %x)
+; CHECK: ret i32
+define i32 @driver(i32 %x, i32 %y) {
+entry:
+  call void @bump(i32 1, i32 3)
+  %a = call i32 @pick(i32 1, i32 %x)
+  %b = call i32 @pick(i32 %y, i32 %x)
+  %s = add i32 %a, %b
+  ret i32 %s
+}
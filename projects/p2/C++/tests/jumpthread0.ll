@@ -0,0 +1,151 @@
+; ModuleID = 'jumpthread0'
+; CHECK-LABEL: source_filename = "jumpthread0"
+source_filename = "jumpthread0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+declare void @f(i32)
+
+; x == 5 implies x > 3, so the inner branch always goes to %yes and %no
+; is removed.
+; CHECK-LABEL: define i32 @dominated(
+; CHECK: {{^}}then:
+; CHECK-NEXT: call void @f(i32 1)
+; CHECK-NOT: call void @f(i32 2)
+; CHECK: ret i32 0
+define i32 @dominated(i32 %x) {
+entry:
+  %c = icmp eq i32 %x, 5
+  br i1 %c, label %then, label %exit
+
+then:
+  %d = icmp sgt i32 %x, 3
+  br i1 %d, label %yes, label %no
+
+yes:
+  call void @f(i32 1)
+  br label %exit
+
+no:
+  call void @f(i32 2)
+  br label %exit
+
+exit:
+  ret i32 0
+}
+
+; x < 10 decides both compares in %small.
+; CHECK-LABEL: define i32 @range(
+; CHECK-NOT: icmp ult i32 %x, 20
+; CHECK-NOT: icmp ugt i32 %x, 30
+; CHECK: %z = zext i1 true to i32
+; CHECK: %w = zext i1 false to i32
+define i32 @range(i32 %x) {
+entry:
+  %c = icmp ult i32 %x, 10
+  br i1 %c, label %small, label %big
+
+small:
+  %d = icmp ult i32 %x, 20
+  %e = icmp ugt i32 %x, 30
+  %z = zext i1 %d to i32
+  %w = zext i1 %e to i32
+  %r = add i32 %z, %w
+  ret i32 %r
+
+big:
+  ret i32 -1
+}
+
+; The branch on %p is known on each edge into %merge: both edges are
+; threaded and %merge, duplicated into %left, disappears.
+; CHECK-LABEL: define i32 @flag(
+; CHECK: {{^}}left:
+; CHECK-NEXT: call void @f(i32 %a)
+; CHECK-NEXT: [[V:%.*]] = add i32 %a, 1
+; CHECK-NEXT: call void @f(i32 [[V]])
+; CHECK-NEXT: ret i32 [[V]]
+; CHECK: {{^}}right:
+; CHECK-NEXT: ret i32 0
+; CHECK-NOT: {{^}}merge:
+define i32 @flag(i1 %c, i32 %a) {
+entry:
+  br i1 %c, label %left, label %right
+
+left:
+  call void @f(i32 %a)
+  br label %merge
+
+right:
+  br label %merge
+
+merge:
+  %p = phi i1 [ true, %left ], [ false, %right ]
+  %v = add i32 %a, 1
+  br i1 %p, label %t, label %e
+
+t:
+  call void @f(i32 %v)
+  ret i32 %v
+
+e:
+  ret i32 0
+}
+
+; %p is null on the edge from %entry and not null on the others, so
+; each edge into %join goes straight to %load or %skip and the phi is
+; split between them.
+; CHECK-LABEL: define i32 @null(
+; CHECK: br i1 %isnull, label %[[SKIP:join.thread[0-9]*]], label %check
+; CHECK-NOT: icmp ne i32* %p, null
+; CHECK: {{^}}[[SKIP]]:
+; CHECK-NEXT: ret i32 0
+; CHECK: {{^}}load:
+; CHECK-NEXT: %n{{[0-9]+}} = phi i32 [ 2, %other ], [ 1, %join.thread{{[0-9]*}} ]
+define i32 @null(i32* %p, i1 %c) {
+entry:
+  %isnull = icmp eq i32* %p, null
+  br i1 %isnull, label %join, label %check
+
+check:
+  br i1 %c, label %join, label %other
+
+other:
+  call void @f(i32 3)
+  br label %join
+
+join:
+  %n = phi i32 [ 0, %entry ], [ 1, %check ], [ 2, %other ]
+  %again = icmp ne i32* %p, null
+  br i1 %again, label %load, label %skip
+
+load:
+  %v = load i32, i32* %p
+  %s = add i32 %v, %n
+  ret i32 %s
+
+skip:
+  ret i32 %n
+}
+
+; Loop headers are not duplicated.
+; CHECK-LABEL: define i32 @loop(
+; CHECK: {{^}}head:
+; CHECK-NEXT: %i = phi i32 [ 0, %entry ], [ %i1, %body ]
+; CHECK-NOT: .thread
+define i32 @loop(i32 %n) {
+entry:
+  br label %head
+
+head:
+  %i = phi i32 [ 0, %entry ], [ %i1, %body ]
+  %c = icmp slt i32 %i, %n
+  br i1 %c, label %body, label %exit
+
+body:
+  %i1 = add i32 %i, 1
+  br label %head
+
+exit:
+  ret i32 %i
+}
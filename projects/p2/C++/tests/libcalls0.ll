@@ -0,0 +1,120 @@
+; ModuleID = 'libcalls0'
+; CHECK-LABEL: source_filename = "libcalls0"
+source_filename = "libcalls0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; pow with small constant exponents becomes multiplies.
+; CHECK-LABEL: define double @square_cube(double %x)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %sq = fmul double %x, %x
+; CHECK-NEXT: [[X2:%[0-9]+]] = fmul double %x, %x
+; CHECK-NEXT: %cube = fmul double %x, [[X2]]
+; CHECK-NOT: call
+; CHECK: ret double
+define double @square_cube(double %x) {
+entry:
+  %sq = call double @pow(double %x, double 2.000000e+00)
+  %cube = call double @pow(double %x, double 3.000000e+00)
+  %one = call double @pow(double %x, double 0.000000e+00)
+  %a = fadd double %sq, %cube
+  %b = fadd double %a, %one
+  ret double %b
+}
+
+; pow(x, 0.5) keeps pow's answer for -0 and -inf.
+; CHECK-LABEL: define double @root(double %x)
+; CHECK: call double @llvm.sqrt.f64(double %x)
+; CHECK-NEXT: call double @llvm.fabs.f64
+; CHECK-NEXT: fcmp oeq double %x, 0xFFF0000000000000
+; CHECK-NEXT: %r = select i1 %{{[0-9]+}}, double 0x7FF0000000000000
+; CHECK-NOT: @pow
+define double @root(double %x) {
+entry:
+  %r = call double @pow(double %x, double 5.000000e-01)
+  ret double %r
+}
+
+; Exponents that are not small multiples of a half stay calls.
+; CHECK-LABEL: define double @other(double %x)
+; CHECK: call double @pow(double %x, double 7.000000e+00)
+define double @other(double %x) {
+entry:
+  %r = call double @pow(double %x, double 7.000000e+00)
+  ret double %r
+}
+
+; 1/x is one rounding like pow(x, -1); 1/(x*x) would round twice.
+; CHECK-LABEL: define double @inverse(double %x)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %inv = fdiv double 1.000000e+00, %x
+; CHECK-NEXT: %inv2 = call double @pow(double %x, double -2.000000e+00)
+define double @inverse(double %x) {
+entry:
+  %inv = call double @pow(double %x, double -1.000000e+00)
+  %inv2 = call double @pow(double %x, double -2.000000e+00)
+  %r = fadd double %inv, %inv2
+  ret double %r
+}
+
+; sqrt and fabs become intrinsics.
+; CHECK-LABEL: define float @intrinsics(float %x)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %s = call float @llvm.sqrt.f32(float %x)
+; CHECK-NEXT: %a = call float @llvm.fabs.f32(float %s)
+define float @intrinsics(float %x) {
+entry:
+  %s = call float @sqrtf(float %x)
+  %a = call float @fabsf(float %s)
+  ret float %a
+}
+
+; sin and cos of one argument on both sides of a branch share one sincos
+; in the block that dominates them.
+; CHECK-LABEL: define double @rotate(double %t, i1 %c)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %sin.slot = alloca double
+; CHECK-NEXT: %cos.slot = alloca double
+; CHECK-NEXT: call void @sincos(double %t, double* %sin.slot, double* %cos.slot)
+; CHECK-NEXT: %sin = load double, double* %sin.slot
+; CHECK-NEXT: %cos = load double, double* %cos.slot
+; CHECK-NEXT: br i1 %c
+; CHECK-NOT: @sin(
+; CHECK-NOT: @cos(
+; CHECK: ret double
+define double @rotate(double %t, i1 %c) {
+entry:
+  br i1 %c, label %left, label %right
+
+left:
+  %s = call double @sin(double %t)
+  br label %join
+
+right:
+  %k = call double @cos(double %t)
+  br label %join
+
+join:
+  %r = phi double [ %s, %left ], [ %k, %right ]
+  ret double %r
+}
+
+; A K&R "double sqrt();" call passing an int gets the real prototype, and
+; then the intrinsic.
+; CHECK-LABEL: define i32 @kr(i32 %n)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: [[D:%[0-9]+]] = sitofp i32 %n to double
+; CHECK-NEXT: [[R:%[0-9]+]] = call double @llvm.sqrt.f64(double [[D]])
+; CHECK-NEXT: %r = fptosi double [[R]] to i32
+define i32 @kr(i32 %n) {
+entry:
+  %r = call i32 bitcast (double (...)* @sqrt to i32 (i32)*)(i32 %n)
+  ret i32 %r
+}
+
+declare double @pow(double, double)
+declare double @sqrt(...)
+declare float @sqrtf(float)
+declare float @fabsf(float)
+declare double @sin(double)
+declare double @cos(double)
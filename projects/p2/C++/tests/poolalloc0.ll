@@ -0,0 +1,135 @@
+; ModuleID = 'poolalloc0'
+; CHECK-LABEL: source_filename = "poolalloc0"
+source_filename = "poolalloc0"
+
+%struct.node = type { i32, %struct.node* }
+
+; CHECK: @pool = internal global [8 x i64] zeroinitializer
+@head = global %struct.node* null, align 8
+@num = private constant [3 x i8] c"42\00"
+
+declare i8* @malloc(i64)
+declare void @free(i8*)
+declare void @ext_keep(i8*)
+declare i8* @strcpy(i8*, i8*)
+declare i64 @strtol(i8*, i8**, i32)
+
+; CHECK-LABEL: define void @push(i32 %v)
+; CHECK: call i8* @pool_alloc(i8* bitcast ([8 x i64]* @pool to i8*), i64 16)
+define void @push(i32 %v) {
+entry:
+  %m = call i8* @malloc(i64 16)
+  %n = bitcast i8* %m to %struct.node*
+  %val = getelementptr inbounds %struct.node, %struct.node* %n, i32 0, i32 0
+  store i32 %v, i32* %val, align 8
+  %old = load %struct.node*, %struct.node** @head, align 8
+  %next = getelementptr inbounds %struct.node, %struct.node* %n, i32 0, i32 1
+  store %struct.node* %old, %struct.node** %next, align 8
+  store %struct.node* %n, %struct.node** @head, align 8
+  ret void
+}
+
+; CHECK-LABEL: define void @pop()
+; CHECK: call void @pool_free(i8* bitcast ([8 x i64]* @pool to i8*)
+define void @pop() {
+entry:
+  %h = load %struct.node*, %struct.node** @head, align 8
+  %next = getelementptr inbounds %struct.node, %struct.node* %h, i32 0, i32 1
+  %n = load %struct.node*, %struct.node** %next, align 8
+  store %struct.node* %n, %struct.node** @head, align 8
+  %p = bitcast %struct.node* %h to i8*
+  call void @free(i8* %p)
+  ret void
+}
+
+; The pair node and the node it points to are separate classes, so each
+; gets a pool local to this function.
+; CHECK-LABEL: define i32 @local_pair(i32 %v)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %pool1 = alloca [8 x i64]
+; CHECK-NEXT: bitcast [8 x i64]* %pool1 to i8*
+; CHECK-NEXT: call void @pool_init(i8* %0)
+; CHECK-NEXT: %pool = alloca [8 x i64]
+; CHECK-NEXT: bitcast [8 x i64]* %pool to i8*
+; CHECK-NEXT: call void @pool_init(i8* %1)
+; CHECK-NEXT: %a = call i8* @pool_alloc(i8* %1, i64 16)
+; CHECK: %b = call i8* @pool_alloc(i8* %0, i64 16)
+; CHECK: call void @pool_free(i8* %1, i8* %a)
+; CHECK-NEXT: call void @pool_destroy(i8* %1)
+; CHECK-NEXT: call void @pool_destroy(i8* %0)
+; CHECK-NEXT: ret i32
+define i32 @local_pair(i32 %v) {
+entry:
+  %a = call i8* @malloc(i64 16)
+  %an = bitcast i8* %a to %struct.node*
+  %b = call i8* @malloc(i64 16)
+  %bn = bitcast i8* %b to %struct.node*
+  %anext = getelementptr inbounds %struct.node, %struct.node* %an, i32 0, i32 1
+  store %struct.node* %bn, %struct.node** %anext, align 8
+  %bval = getelementptr inbounds %struct.node, %struct.node* %bn, i32 0, i32 0
+  store i32 %v, i32* %bval, align 8
+  %l = load %struct.node*, %struct.node** %anext, align 8
+  %lval = getelementptr inbounds %struct.node, %struct.node* %l, i32 0, i32 0
+  %r = load i32, i32* %lval, align 8
+  call void @free(i8* %a)
+  ret i32 %r
+}
+
+; CHECK-LABEL: define void @escaping()
+; CHECK: call i8* @malloc(i64 32)
+define void @escaping() {
+entry:
+  %m = call i8* @malloc(i64 32)
+  call void @ext_keep(i8* %m)
+  ret void
+}
+
+; strcpy returns its destination, so the copy outlives @dup and its
+; allocation must not come from a pool local to @dup.
+; CHECK-LABEL: define internal i8* @dup(i8* %s)
+; CHECK-NOT: pool_destroy
+; CHECK: ret i8* %q
+define internal i8* @dup(i8* %s) {
+entry:
+  %p = call i8* @malloc(i64 64)
+  %q = call i8* @strcpy(i8* %p, i8* %s)
+  ret i8* %q
+}
+
+; strtol stores a pointer into the buffer through its end pointer, so the
+; buffer escapes with the returned end.
+; CHECK-LABEL: define internal i8* @skipnum(i8* %s)
+; CHECK-NOT: pool_destroy
+; CHECK: ret i8* %end
+define internal i8* @skipnum(i8* %s) {
+entry:
+  %endp = alloca i8*, align 8
+  %b = call i8* @malloc(i64 64)
+  %c = call i8* @strcpy(i8* %b, i8* %s)
+  %v = call i64 @strtol(i8* %b, i8** %endp, i32 10)
+  %end = load i8*, i8** %endp, align 8
+  ret i8* %end
+}
+
+; CHECK-LABEL: define i32 @main()
+; CHECK-NEXT: entry:
+; CHECK: call void @pool_init(i8* bitcast ([8 x i64]* @pool to i8*))
+; CHECK-NEXT: call void @push(i32 1)
+; CHECK: %d = call i8* @dup(i8* %s)
+; CHECK-NEXT: call void @pool_free(i8* bitcast ([8 x i64]* [[DUP:@pool.[0-9]+]] to i8*), i8* %d)
+; CHECK: call void @pool_destroy(i8* bitcast ([8 x i64]* @pool to i8*))
+; CHECK-NEXT: call void @pool_destroy(i8* bitcast ([8 x i64]* [[DUP]] to i8*))
+; CHECK: ret i32 0
+define i32 @main() {
+entry:
+  call void @push(i32 1)
+  call void @push(i32 2)
+  call void @pop()
+  %x = call i32 @local_pair(i32 3)
+  call void @escaping()
+  %s = getelementptr inbounds [3 x i8], [3 x i8]* @num, i64 0, i64 0
+  %d = call i8* @dup(i8* %s)
+  call void @free(i8* %d)
+  %e = call i8* @skipnum(i8* %s)
+  ret i32 0
+}
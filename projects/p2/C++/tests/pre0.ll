@@ -0,0 +1,124 @@
+; ModuleID = 'pre0'
+; CHECK-LABEL: source_filename = "pre0"
+source_filename = "pre0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; a+b is computed on one path into %merge and again in %merge: it is
+; inserted on the other path and %z becomes a phi.
+; CHECK-LABEL: define i32 @join(
+; CHECK: {{^}}else:
+; CHECK-NEXT: %y = mul i32 %a, 3
+; CHECK-NEXT: %x.pre = add i32 %a, %b
+; CHECK: {{^}}merge:
+; CHECK-NEXT: %x.pre.phi = phi i32 [ %x, %then ], [ %x.pre, %else ]
+; CHECK: %r = add i32 %p, %x.pre.phi
+define i32 @join(i32 %a, i32 %b, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %x = add i32 %a, %b
+  br label %merge
+
+else:
+  %y = mul i32 %a, 3
+  br label %merge
+
+merge:
+  %p = phi i32 [ %x, %then ], [ %y, %else ]
+  %z = add i32 %a, %b
+  %r = add i32 %p, %z
+  ret i32 %r
+}
+
+; The path without a+b is a critical edge, which gets split.
+; CHECK-LABEL: define i32 @critical(
+; CHECK: br i1 %c, label %then, label %entry.merge_crit_edge
+; CHECK: {{^}}entry.merge_crit_edge:
+; CHECK-NEXT: %x.pre = add i32 %a, %b
+; CHECK: %x.pre.phi = phi i32 [ %x, %then ], [ %x.pre, %entry.merge_crit_edge ]
+define i32 @critical(i32 %a, i32 %b, i1 %c) {
+entry:
+  br i1 %c, label %then, label %merge
+
+then:
+  %x = add i32 %a, %b
+  br label %merge
+
+merge:
+  %p = phi i32 [ %x, %then ], [ 0, %entry ]
+  %z = add i32 %a, %b
+  %r = add i32 %p, %z
+  ret i32 %r
+}
+
+; k<<2 in the loop is already available from %pre on every path.
+; CHECK-LABEL: define i32 @loop(
+; CHECK: {{^}}body:
+; CHECK-NOT: shl
+; CHECK: %acc1 = add i32 %acc, %s0
+define i32 @loop(i32* %v, i32 %n, i32 %k) {
+entry:
+  %first = icmp sgt i32 %n, 0
+  br i1 %first, label %pre, label %exit
+
+pre:
+  %s0 = shl i32 %k, 2
+  br label %body
+
+body:
+  %i = phi i32 [ 0, %pre ], [ %i1, %body ]
+  %acc = phi i32 [ %s0, %pre ], [ %acc1, %body ]
+  %s = shl i32 %k, 2
+  %acc1 = add i32 %acc, %s
+  %i1 = add i32 %i, 1
+  %more = icmp slt i32 %i1, %n
+  br i1 %more, label %body, label %exit
+
+exit:
+  %res = phi i32 [ 0, %entry ], [ %acc1, %body ]
+  ret i32 %res
+}
+
+; Computed on both paths and not after the join: hoisting would gain
+; nothing, so nothing moves.
+; CHECK-LABEL: define i32 @nogain(
+; CHECK: %x = sub i32 %a, %b
+; CHECK: %y = sub i32 %a, %b
+; CHECK-NOT: .pre
+define i32 @nogain(i32 %a, i32 %b, i1 %c) {
+entry:
+  br i1 %c, label %then, label %else
+
+then:
+  %x = sub i32 %a, %b
+  br label %merge
+
+else:
+  %y = sub i32 %a, %b
+  br label %merge
+
+merge:
+  %p = phi i32 [ %x, %then ], [ %y, %else ]
+  ret i32 %p
+}
+
+; sdiv can trap, so it is never inserted on a new path.
+; CHECK-LABEL: define i32 @guarded(
+; CHECK-NOT: .pre
+; CHECK: %q2 = sdiv i32 %a, %b
+define i32 @guarded(i32 %a, i32 %b, i1 %c) {
+entry:
+  br i1 %c, label %then, label %merge
+
+then:
+  %q = sdiv i32 %a, %b
+  br label %merge
+
+merge:
+  %p = phi i32 [ %q, %then ], [ 0, %entry ]
+  %q2 = sdiv i32 %a, %b
+  %r = add i32 %p, %q2
+  ret i32 %r
+}
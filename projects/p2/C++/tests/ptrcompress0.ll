@@ -0,0 +1,81 @@
+; ModuleID = 'ptrcompress0'
+; CHECK-LABEL: source_filename = "ptrcompress0"
+source_filename = "ptrcompress0"
+
+; The list node only ever points to list nodes, so its link shrinks to an
+; index. The escaping node is handed to a library and keeps its layout.
+; CHECK: %struct.node.pc = type { i32, i32 }
+; CHECK-NOT: %struct.leaky.pc
+%struct.node = type { i32, %struct.node* }
+%struct.leaky = type { i32, %struct.leaky* }
+
+declare i8* @malloc(i64)
+declare void @free(i8*)
+declare void @ext_keep(%struct.leaky*)
+
+; CHECK-LABEL: define %struct.node* @push(%struct.node* %head, i32 %v)
+; CHECK: %m = call i8* @pc_alloc(i64 8)
+; CHECK: getelementptr inbounds %struct.node.pc, %struct.node.pc* %{{[0-9]+}}, i32 0, i32 1
+; CHECK: call i32 @pc_far_index(
+; CHECK: store i32 %{{[0-9]+}}, i32* %next, align 4
+define %struct.node* @push(%struct.node* %head, i32 %v) {
+entry:
+  %m = call i8* @malloc(i64 16)
+  %n = bitcast i8* %m to %struct.node*
+  %val = getelementptr inbounds %struct.node, %struct.node* %n, i32 0, i32 0
+  store i32 %v, i32* %val, align 8
+  %next = getelementptr inbounds %struct.node, %struct.node* %n, i32 0, i32 1
+  store %struct.node* %head, %struct.node** %next, align 8
+  ret %struct.node* %n
+}
+
+; CHECK-LABEL: define i32 @sum(%struct.node* %l)
+; CHECK: %val = getelementptr inbounds %struct.node.pc
+; CHECK: %x = load i32, i32* %val, align 4
+; CHECK: %n.idx = load i32, i32* %next, align 4
+; CHECK: call i8* @pc_far_pointer(i32 %n.idx)
+; CHECK: %n = bitcast i8* %{{[0-9]+}} to %struct.node*
+define i32 @sum(%struct.node* %l) {
+entry:
+  br label %loop
+
+loop:
+  %p = phi %struct.node* [ %l, %entry ], [ %n, %body ]
+  %s = phi i32 [ 0, %entry ], [ %s1, %body ]
+  %done = icmp eq %struct.node* %p, null
+  br i1 %done, label %exit, label %body
+
+body:
+  %val = getelementptr inbounds %struct.node, %struct.node* %p, i32 0, i32 0
+  %x = load i32, i32* %val, align 8
+  %s1 = add i32 %s, %x
+  %next = getelementptr inbounds %struct.node, %struct.node* %p, i32 0, i32 1
+  %n = load %struct.node*, %struct.node** %next, align 8
+  br label %loop
+
+exit:
+  ret i32 %s
+}
+
+; CHECK-LABEL: define void @release(%struct.node* %p)
+; CHECK: call void @pc_free(i8* %b, i64 8)
+define void @release(%struct.node* %p) {
+entry:
+  %b = bitcast %struct.node* %p to i8*
+  call void @free(i8* %b)
+  ret void
+}
+
+; CHECK-LABEL: define void @leak()
+; CHECK: call i8* @malloc(i64 16)
+; CHECK: getelementptr inbounds %struct.leaky, %struct.leaky* %n, i32 0, i32 1
+; CHECK: store %struct.leaky* null
+define void @leak() {
+entry:
+  %m = call i8* @malloc(i64 16)
+  %n = bitcast i8* %m to %struct.leaky*
+  %next = getelementptr inbounds %struct.leaky, %struct.leaky* %n, i32 0, i32 1
+  store %struct.leaky* null, %struct.leaky** %next, align 8
+  call void @ext_keep(%struct.leaky* %n)
+  ret void
+}
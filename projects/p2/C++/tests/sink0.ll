@@ -0,0 +1,155 @@
+; ModuleID = 'sink0'
+; CHECK-LABEL: source_filename = "sink0"
+source_filename = "sink0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+declare void @g(i32)
+
+; %x and %y are only used in %then; %z is used in %join, which every path
+; reaches, so it stays.
+; CHECK-LABEL: define i32 @diamond(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %z = sub i32 %a, %b
+; CHECK-NEXT: br i1 %c
+; CHECK: {{^}}then:
+; CHECK-NEXT: %x = mul i32 %a, %b
+; CHECK-NEXT: %y = add i32 %x, 7
+; CHECK-NEXT: call void @g(i32 %y)
+define i32 @diamond(i32 %a, i32 %b, i1 %c) {
+entry:
+  %x = mul i32 %a, %b
+  %y = add i32 %x, 7
+  %z = sub i32 %a, %b
+  br i1 %c, label %then, label %else
+
+then:
+  call void @g(i32 %y)
+  br label %join
+
+else:
+  call void @g(i32 0)
+  br label %join
+
+join:
+  ret i32 %z
+}
+
+; The load and its use move past the threshold test.
+; CHECK-LABEL: define i32 @threshold(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %c = icmp sgt i32 %t, 100
+; CHECK: {{^}}use:
+; CHECK-NEXT: %v = load i32, i32* %p
+; CHECK-NEXT: %w = shl i32 %v, 2
+define i32 @threshold(i32* %p, i32 %t) {
+entry:
+  %v = load i32, i32* %p
+  %w = shl i32 %v, 2
+  %c = icmp sgt i32 %t, 100
+  br i1 %c, label %use, label %exit
+
+use:
+  ret i32 %w
+
+exit:
+  ret i32 0
+}
+
+; The call may write *%p, so the load stays above it.
+; CHECK-LABEL: define i32 @clobber(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %v = load i32, i32* %p
+; CHECK-NEXT: call void @g(i32 1)
+define i32 @clobber(i32* %p, i1 %c) {
+entry:
+  %v = load i32, i32* %p
+  call void @g(i32 1)
+  br i1 %c, label %use, label %exit
+
+use:
+  ret i32 %v
+
+exit:
+  ret i32 0
+}
+
+; A phi operand is needed at the end of its incoming block.
+; CHECK-LABEL: define i32 @phiuse(
+; CHECK: {{^}}then:
+; CHECK-NEXT: %x = add i32 %a, 1
+; CHECK-NEXT: br label %join
+define i32 @phiuse(i32 %a, i1 %c) {
+entry:
+  %x = add i32 %a, 1
+  br i1 %c, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %p = phi i32 [ %x, %then ], [ 0, %entry ]
+  ret i32 %p
+}
+
+; A division only runs on the paths that ran it before.
+; CHECK-LABEL: define i32 @div(
+; CHECK: {{^}}use:
+; CHECK-NEXT: %d = sdiv i32 %a, %b
+define i32 @div(i32 %a, i32 %b, i1 %c) {
+entry:
+  %d = sdiv i32 %a, %b
+  br i1 %c, label %use, label %exit
+
+use:
+  ret i32 %d
+
+exit:
+  ret i32 0
+}
+
+; A value used only after the loop is computed once, on the way out.
+; CHECK-LABEL: define i32 @outofloop(
+; CHECK: {{^}}head:
+; CHECK-NEXT: %i = phi
+; CHECK-NEXT: %c = icmp slt i32 %i, %n
+; CHECK: {{^}}exit:
+; CHECK-NEXT: %sq = mul i32 %i, %i
+; CHECK-NEXT: ret i32 %sq
+define i32 @outofloop(i32 %a, i32 %n) {
+entry:
+  br label %head
+
+head:
+  %i = phi i32 [ 0, %entry ], [ %i1, %body ]
+  %sq = mul i32 %i, %i
+  %c = icmp slt i32 %i, %n
+  br i1 %c, label %body, label %exit
+
+body:
+  %i1 = add i32 %i, 1
+  br label %head
+
+exit:
+  ret i32 %sq
+}
+
+; Sinking %x into the loop would compute it on every iteration.
+; CHECK-LABEL: define i32 @intoloop(
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %x = mul i32 %a, %a
+define i32 @intoloop(i32 %a, i32 %n, i1 %c) {
+entry:
+  %x = mul i32 %a, %a
+  br i1 %c, label %head, label %exit
+
+head:
+  %i = phi i32 [ 0, %entry ], [ %i1, %head ]
+  call void @g(i32 %x)
+  %i1 = add i32 %i, 1
+  %d = icmp slt i32 %i1, %n
+  br i1 %d, label %head, label %exit
+
+exit:
+  ret i32 0
+}
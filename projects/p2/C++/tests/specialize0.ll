@@ -0,0 +1,47 @@
+; ModuleID = 'specialize0'
+; CHECK-LABEL: source_filename = "specialize0"
+source_filename = "specialize0"
+
+; CHECK-LABEL: define i32 @bit(i32 %b, i32 %key)
+define i32 @bit(i32 %b, i32 %key) {
+entry:
+  %c = icmp eq i32 %b, 0
+  br i1 %c, label %low, label %shift
+
+low:
+  %r0 = and i32 %key, 1
+  ret i32 %r0
+
+shift:
+  %s = lshr i32 %key, %b
+  %m = and i32 %s, 1
+  %n = xor i32 %m, %b
+  %t = mul i32 %n, %b
+  %u = add i32 %t, %s
+  %v = and i32 %u, 1
+  ret i32 %v
+}
+
+; CHECK-LABEL: define i32 @caller1(i32 %key, i32 %b)
+; CHECK: call i32 @bit.spec(i32 %key)
+; CHECK: call i32 @bit(i32 %b, i32 %key)
+define i32 @caller1(i32 %key, i32 %b) {
+entry:
+  %x = call i32 @bit(i32 0, i32 %key)
+  %y = call i32 @bit(i32 %b, i32 %key)
+  %z = add i32 %x, %y
+  ret i32 %z
+}
+
+; CHECK-LABEL: define i32 @caller2(i32 %key)
+; CHECK: call i32 @bit.spec(i32 %key)
+define i32 @caller2(i32 %key) {
+entry:
+  %x = call i32 @bit(i32 0, i32 %key)
+  ret i32 %x
+}
+
+; CHECK-LABEL: define internal i32 @bit.spec(i32 %key)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: and i32 %key, 1
+; CHECK-NEXT: ret i32
@@ -0,0 +1,89 @@
+; ModuleID = 'strength0'
+; CHECK-LABEL: source_filename = "strength0"
+source_filename = "strength0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; t1/10 and t1%10 (test_03): one multiply-high, which CSE shares between
+; the quotient and the remainder; *10 becomes two shifts and an add.
+; CHECK-LABEL: define i32 @digits(i32 %t1)
+; CHECK: [[X:%[0-9]+]] = sext i32 %t1 to i64
+; CHECK-NEXT: %mul.wide = mul i64 [[X]], 1717986919
+; CHECK-NEXT: [[H:%[0-9]+]] = lshr i64 %mul.wide, 32
+; CHECK-NEXT: %mulhi = trunc i64 [[H]] to i32
+; CHECK-NEXT: [[S:%[0-9]+]] = ashr i32 %mulhi, 2
+; CHECK-NEXT: [[SIGN:%[0-9]+]] = lshr i32 [[S]], 31
+; CHECK-NEXT: %q = add i32 [[S]], [[SIGN]]
+; CHECK-NEXT: [[Q2:%[0-9]+]] = shl i32 %q, 1
+; CHECK-NEXT: [[Q8:%[0-9]+]] = shl i32 %q, 3
+; CHECK-NEXT: [[Q10:%[0-9]+]] = add i32 [[Q8]], [[Q2]]
+; CHECK-NEXT: %r = sub i32 %t1, [[Q10]]
+; CHECK-NOT: sdiv
+; CHECK-NOT: srem
+define i32 @digits(i32 %t1) {
+entry:
+  %q = sdiv i32 %t1, 10
+  %r = srem i32 %t1, 10
+  %s = add i32 %q, %r
+  ret i32 %s
+}
+
+; /7 needs the add form of the magic number; %8 is a mask and a divisor
+; above 2^31 is a compare.
+; CHECK-LABEL: define i32 @unsigned_ops(i32 %x)
+; CHECK: %mul.wide = mul i64 %{{[0-9]+}}, 613566757
+; CHECK: [[D:%[0-9]+]] = sub i32 %x, %mulhi
+; CHECK-NEXT: [[H:%[0-9]+]] = lshr i32 [[D]], 1
+; CHECK-NEXT: [[A:%[0-9]+]] = add i32 [[H]], %mulhi
+; CHECK-NEXT: %q = lshr i32 [[A]], 2
+; CHECK-NEXT: %m = and i32 %x, 7
+; CHECK-NEXT: [[C:%[0-9]+]] = icmp uge i32 %x, -1294967296
+; CHECK-NEXT: %big = zext i1 [[C]] to i32
+define i32 @unsigned_ops(i32 %x) {
+entry:
+  %q = udiv i32 %x, 7
+  %m = urem i32 %x, 8
+  %big = udiv i32 %x, 3000000000
+  %a = add i32 %q, %m
+  %b = add i32 %a, %big
+  ret i32 %b
+}
+
+; Signed division by +-2^k rounds negative dividends up with a bias.
+; CHECK-LABEL: define i32 @pow2(i32 %x)
+; CHECK: [[S:%[0-9]+]] = ashr i32 %x, 1
+; CHECK-NEXT: [[B:%[0-9]+]] = lshr i32 [[S]], 30
+; CHECK-NEXT: [[A:%[0-9]+]] = add i32 %x, [[B]]
+; CHECK-NEXT: %q = ashr i32 [[A]], 2
+; CHECK: %n = sub i32 0, %{{[0-9]+}}
+; CHECK-NOT: sdiv
+define i32 @pow2(i32 %x) {
+entry:
+  %q = sdiv i32 %x, 4
+  %n = sdiv i32 %x, -2
+  %s = add i32 %q, %n
+  ret i32 %s
+}
+
+; *9, 6* and *-8 become shifts; 12345 has too many bits and stays. /1000
+; shifts the dividend right by 3 first, so the magic number for 125 needs
+; no add.
+; CHECK-LABEL: define i64 @scale(i64 %x)
+; CHECK: [[X8:%[0-9]+]] = shl i64 %x, 3
+; CHECK-NEXT: %a = add i64 [[X8]], %x
+; CHECK: %b = add i64
+; CHECK: %c = sub i64 0,
+; CHECK-NEXT: %d = mul i64 %c, 12345
+; CHECK-NEXT: [[D:%[0-9]+]] = lshr i64 %d, 3
+; CHECK-NEXT: [[W:%[0-9]+]] = zext i64 [[D]] to i128
+; CHECK-NEXT: %mul.wide = mul i128 [[W]], 2361183241434822607
+; CHECK: %e = lshr i64 %mulhi, 4
+define i64 @scale(i64 %x) {
+entry:
+  %a = mul i64 %x, 9
+  %b = mul i64 6, %a
+  %c = mul i64 %b, -8
+  %d = mul i64 %c, 12345
+  %e = udiv i64 %d, 1000
+  ret i64 %e
+}
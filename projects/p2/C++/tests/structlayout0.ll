@@ -0,0 +1,80 @@
+; ModuleID = 'structlayout0'
+; CHECK-LABEL: source_filename = "structlayout0"
+source_filename = "structlayout0"
+
+; The traversal touches key and next in a loop, so they go first. id is
+; written once per node and stays, pad is never read or written and goes to
+; the cold part.
+; CHECK: %struct.node.layout = type { %struct.node*, i32, i64, %struct.node.cold* }
+; CHECK: %struct.node.cold = type { [6 x i64] }
+%struct.node = type { i64, i32, [6 x i64], %struct.node* }
+
+declare i8* @malloc(i64)
+declare void @free(i8*)
+
+; CHECK-LABEL: define %struct.node* @make(i32 %k, %struct.node* %n)
+; CHECK: %m.hot = call i8* @malloc(i64 32)
+; CHECK-NEXT: [[HOTOK:%[0-9]+]] = icmp ne i8* %m.hot, null
+; CHECK-NEXT: br i1 [[HOTOK]]
+; CHECK: %m.cold = call i8* @malloc(i64 48)
+; CHECK: store %struct.node.cold* %{{[0-9]+}}, %struct.node.cold** %{{[0-9]+}}
+; CHECK-NEXT: [[COLDFAIL:%[0-9]+]] = icmp eq i8* %m.cold, null
+; CHECK: call void @free(i8* %m.hot)
+; CHECK: [[SEL:%[0-9]+]] = select i1 [[COLDFAIL]], i8* null, i8* %m.hot
+; CHECK: %m = phi i8* [ null, %entry ], [ [[SEL]], %{{[0-9]+}} ]
+; CHECK: %pad.cold = load %struct.node.cold*, %struct.node.cold** %{{[0-9]+}}
+; CHECK-NEXT: %pad = getelementptr inbounds %struct.node.cold, %struct.node.cold* %pad.cold, i32 0, i32 0, i32 5
+; CHECK: %id = getelementptr inbounds %struct.node.layout, %struct.node.layout* %{{[0-9]+}}, i32 0, i32 2
+; CHECK-NEXT: store i64 0, i64* %id, align 4
+; CHECK: %key = getelementptr inbounds %struct.node.layout, %struct.node.layout* %{{[0-9]+}}, i32 0, i32 1
+; CHECK: store i32 %k, i32* %key, align 4
+define %struct.node* @make(i32 %k, %struct.node* %n) {
+entry:
+  %m = call i8* @malloc(i64 72)
+  %p = bitcast i8* %m to %struct.node*
+  %pad = getelementptr inbounds %struct.node, %struct.node* %p, i32 0, i32 2, i32 5
+  %id = getelementptr inbounds %struct.node, %struct.node* %p, i32 0, i32 0
+  store i64 0, i64* %id, align 8
+  %key = getelementptr inbounds %struct.node, %struct.node* %p, i32 0, i32 1
+  store i32 %k, i32* %key, align 8
+  %next = getelementptr inbounds %struct.node, %struct.node* %p, i32 0, i32 3
+  store %struct.node* %n, %struct.node** %next, align 8
+  ret %struct.node* %p
+}
+
+; CHECK-LABEL: define i32 @count(%struct.node* %l, i32 %k)
+; CHECK: getelementptr inbounds %struct.node.layout, %struct.node.layout* %{{[0-9]+}}, i32 0, i32 0
+define i32 @count(%struct.node* %l, i32 %k) {
+entry:
+  br label %loop
+
+loop:
+  %p = phi %struct.node* [ %l, %entry ], [ %n, %body ]
+  %c = phi i32 [ 0, %entry ], [ %c1, %body ]
+  %done = icmp eq %struct.node* %p, null
+  br i1 %done, label %exit, label %body
+
+body:
+  %key = getelementptr inbounds %struct.node, %struct.node* %p, i32 0, i32 1
+  %x = load i32, i32* %key, align 8
+  %eq = icmp eq i32 %x, %k
+  %inc = zext i1 %eq to i32
+  %c1 = add i32 %c, %inc
+  %next = getelementptr inbounds %struct.node, %struct.node* %p, i32 0, i32 3
+  %n = load %struct.node*, %struct.node** %next, align 8
+  br label %loop
+
+exit:
+  ret i32 %c
+}
+
+; CHECK-LABEL: define void @release(%struct.node* %p)
+; CHECK: icmp ne i8* %b, null
+; CHECK: call void @free(i8* %{{[0-9]+}})
+; CHECK: call void @free(i8* %b)
+define void @release(%struct.node* %p) {
+entry:
+  %b = bitcast %struct.node* %p to i8*
+  call void @free(i8* %b)
+  ret void
+}
@@ -0,0 +1,175 @@
+; ModuleID = 'tailrec0'
+; CHECK-LABEL: source_filename = "tailrec0"
+source_filename = "tailrec0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+@num = global [4 x i32] zeroinitializer
+
+; A returned self call becomes a branch back to the header.
+; CHECK-LABEL: define i32 @gcd(i32 %a, i32 %b)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: br label %tailrecurse
+; CHECK: tailrecurse:
+; CHECK-NEXT: %a.tr = phi i32 [ %a, %entry ], [ %b.tr, %rec ]
+; CHECK-NEXT: %b.tr = phi i32 [ %b, %entry ], [ %m, %rec ]
+; CHECK: rec:
+; CHECK-NEXT: %m = srem i32 %a.tr, %b.tr
+; CHECK-NEXT: br label %tailrecurse
+; CHECK-NOT: call
+; CHECK: }
+define i32 @gcd(i32 %a, i32 %b) {
+entry:
+  %z = icmp eq i32 %b, 0
+  br i1 %z, label %done, label %rec
+
+done:
+  ret i32 %a
+
+rec:
+  %m = srem i32 %a, %b
+  %r = call i32 @gcd(i32 %b, i32 %m)
+  ret i32 %r
+}
+
+; n + sum(n - 1) through the shared return block goes through an
+; accumulator, which the base case adds its value to.
+; CHECK-LABEL: define i32 @sum(i32 %n)
+; CHECK: tailrecurse:
+; CHECK-NEXT: %n.tr = phi i32 [ %n, %entry ], [ %m, %rec ]
+; CHECK-NEXT: %accumulator.tr = phi i32 [ 0, %entry ], [ %accumulate.tr, %rec ]
+; CHECK: rec:
+; CHECK-NEXT: %m = sub i32 %n.tr, 1
+; CHECK-NEXT: %accumulate.tr = add i32 %accumulator.tr, %n.tr
+; CHECK-NEXT: br label %tailrecurse
+; CHECK: return:
+; CHECK-NEXT: %accumulate.ret = add i32 %accumulator.tr, 0
+; CHECK-NEXT: ret i32 %accumulate.ret
+define i32 @sum(i32 %n) {
+entry:
+  %c = icmp sle i32 %n, 0
+  br i1 %c, label %base, label %rec
+
+base:
+  br label %return
+
+rec:
+  %m = sub i32 %n, 1
+  %r = call i32 @sum(i32 %m)
+  %s = add i32 %n, %r
+  br label %return
+
+return:
+  %p = phi i32 [ 0, %base ], [ %s, %rec ]
+  ret i32 %p
+}
+
+; hanoi's mov: the second and third calls are pushed (third first) and the
+; first continues the loop. Returns pop the next call before leaving.
+; CHECK-LABEL: define void @mov(i32 %n, i32 %f, i32 %t)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %tailrec.buf = alloca %tailrec.frame.mov*
+; CHECK-NEXT: %tailrec.sp = alloca i64
+; CHECK-NEXT: %tailrec.cap = alloca i64
+; CHECK: tailrecurse:
+; CHECK-NEXT: %n.tr = phi i32 [ %n, %entry ], [ %sub, %{{[0-9]+}} ], [ %{{[0-9]+}}, %tailrec.next ]
+; CHECK: if.else:
+; CHECK-NEXT: %call = call i32 @other(i32 %f.tr, i32 %t.tr)
+; CHECK-NEXT: %sub = sub i32 %n.tr, 1
+; CHECK-NEXT: %sub1 = sub i32 %n.tr, 1
+; CHECK: [[GROWN:%[0-9]+]] = call i8* @realloc
+; CHECK-NEXT: icmp eq i8* [[GROWN]], null
+; CHECK: call void @abort()
+; CHECK-NEXT: unreachable
+; CHECK: store i32 %sub1
+; CHECK-NEXT: getelementptr
+; CHECK-NEXT: store i32 %call
+; CHECK: store i32 1
+; CHECK-NOT: call void @mov
+; CHECK: br label %tailrecurse
+; CHECK: if.end:
+; CHECK-NEXT: br label %tailrec.pop
+; CHECK: tailrec.pop:
+; CHECK: br i1 %{{[0-9]+}}, label %tailrec.done, label %tailrec.next
+; CHECK: tailrec.done:
+; CHECK: call void @free
+; CHECK-NEXT: ret void
+define void @mov(i32 %n, i32 %f, i32 %t) nounwind {
+entry:
+  %cmp = icmp eq i32 %n, 1
+  br i1 %cmp, label %if.then, label %if.else
+
+if.then:
+  %pf = getelementptr [4 x i32], [4 x i32]* @num, i32 0, i32 %f
+  %v = load i32, i32* %pf
+  %d = sub i32 %v, 1
+  store i32 %d, i32* %pf
+  %pt = getelementptr [4 x i32], [4 x i32]* @num, i32 0, i32 %t
+  %w = load i32, i32* %pt
+  %i = add i32 %w, 1
+  store i32 %i, i32* %pt
+  br label %if.end
+
+if.else:
+  %call = call i32 @other(i32 %f, i32 %t)
+  %sub = sub i32 %n, 1
+  call void @mov(i32 %sub, i32 %f, i32 %call)
+  call void @mov(i32 1, i32 %f, i32 %t)
+  %sub1 = sub i32 %n, 1
+  call void @mov(i32 %sub1, i32 %call, i32 %t)
+  br label %if.end
+
+if.end:
+  ret void
+}
+
+; Without nounwind only the last call of the run is converted.
+; CHECK-LABEL: define void @walk(i32 %n)
+; CHECK: call void @walk(i32 %a)
+; CHECK-NEXT: %b = sub i32 %n.tr, 2
+; CHECK-NEXT: br label %tailrecurse
+define void @walk(i32 %n) {
+entry:
+  %z = icmp eq i32 %n, 0
+  br i1 %z, label %done, label %rec
+
+rec:
+  %a = sub i32 %n, 1
+  call void @walk(i32 %a)
+  %b = sub i32 %n, 2
+  call void @walk(i32 %b)
+  ret void
+
+done:
+  ret void
+}
+
+; The recursive call can see the caller's slot, so it stays a call.
+; CHECK-LABEL: define void @escapes(i32 %n)
+; CHECK-NOT: tailrecurse
+; CHECK: call void @escapes(i32 %m)
+define void @escapes(i32 %n) {
+entry:
+  %slot = alloca i32
+  store i32 %n, i32* %slot
+  call void @use(i32* %slot)
+  %z = icmp eq i32 %n, 0
+  br i1 %z, label %done, label %rec
+
+rec:
+  %m = sub i32 %n, 1
+  call void @escapes(i32 %m)
+  ret void
+
+done:
+  ret void
+}
+
+define i32 @other(i32 %f, i32 %t) {
+entry:
+  %a = sub i32 6, %f
+  %b = sub i32 %a, %t
+  ret i32 %b
+}
+
+declare void @use(i32*)
@@ -0,0 +1,260 @@
+/*
+ * File: typesafe.cpp
+ *
+ * Description:
+ *   Finds the struct types whose memory layout belongs to the program
+ *   alone, so the data-layout passes (pointer compression, field
+ *   reordering) can change it. The test is purely type based: one scan of
+ *   the module rejects every type that is used in a way that would depend
+ *   on its layout, such as an aggregate copy, a cast to another type, or a
+ *   pointer handed to a library.
+ */
+#include <algorithm>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+#include "typesafe.h"
+
+using namespace llvm;
+
+static bool isCallTo(CallBase *CB, StringRef name)
+{
+    Function *Callee = CB->getCalledFunction();
+    return Callee && Callee->isDeclaration() && Callee->getName() == name &&
+           CB->arg_size() == 1;
+}
+
+static bool isMultipleOf(Value *Size, uint64_t Elem)
+{
+    if (Elem == 0)
+        return false;
+    if (auto *C = dyn_cast<ConstantInt>(Size))
+        return !C->isZero() && C->getZExtValue() % Elem == 0;
+    if (auto *BO = dyn_cast<BinaryOperator>(Size))
+        if (BO->getOpcode() == Instruction::Mul)
+            for (Value *Op : BO->operands())
+                if (auto *C = dyn_cast<ConstantInt>(Op))
+                    if (!C->isZero() && C->getZExtValue() % Elem == 0)
+                        return true;
+    return false;
+}
+
+//***********************Function collectStructs***************************//
+// struct types that T holds by value, and with throughPointers also the
+// ones it can reach through pointer and function types
+//*************************************************************************//
+
+static void collectStructs(Type *T, bool throughPointers, std::set<Type *> &seen,
+                           std::vector<StructType *> &found)
+{
+    if (!seen.insert(T).second)
+        return;
+    if (auto *ST = dyn_cast<StructType>(T))
+        found.push_back(ST);
+    if (auto *PT = dyn_cast<PointerType>(T)) {
+        if (throughPointers && !PT->isOpaque())
+            collectStructs(PT->getPointerElementType(), true, seen, found);
+        return;
+    }
+    for (Type *Sub : T->subtypes())
+        collectStructs(Sub, throughPointers, seen, found);
+}
+
+void TypeSafeStructs::reject(Type *T, bool throughPointers)
+{
+    std::set<Type *> seen;
+    std::vector<StructType *> found;
+    collectStructs(T, throughPointers, seen, found);
+    for (StructType *S : found)
+        safe.erase(S);
+}
+
+TypeSafeStructs::TypeSafeStructs(Module *M) : DL(M->getDataLayout())
+{
+    for (StructType *S : M->getIdentifiedStructTypes())
+        if (!S->isOpaque() && S->isSized())
+            safe.insert(S);
+
+    // A struct nested in another one is laid out by its container.
+    for (StructType *S : M->getIdentifiedStructTypes())
+        for (Type *E : S->elements())
+            reject(E, false);
+
+    for (auto g = M->global_begin(); g != M->global_end(); g++) {
+        reject(g->getValueType(), false);
+        if (g->hasInitializer())
+            visitConstant(g->getInitializer());
+    }
+
+    for (auto f = M->begin(); f != M->end(); f++) {
+        // Library code was compiled against the original layout.
+        reject(f->getFunctionType(), f->isDeclaration());
+        for (Argument &A : f->args())
+            if (A.hasByValAttr() || A.hasStructRetAttr() || A.hasInAllocaAttr() ||
+                A.hasPreallocatedAttr())
+                reject(A.getType(), true);
+
+        for (BasicBlock &BB : *f)
+            for (Instruction &I : BB) {
+                for (Value *Op : I.operands())
+                    if (auto *C = dyn_cast<Constant>(Op))
+                        visitConstant(C);
+
+                if (auto *CI = dyn_cast<CastInst>(&I)) {
+                    visitCast(CI);
+                    continue;
+                }
+                if (auto *CB = dyn_cast<CallBase>(&I)) {
+                    visitCall(CB);
+                    continue;
+                }
+                if (auto *AI = dyn_cast<AllocaInst>(&I))
+                    reject(AI->getAllocatedType(), false);
+                if (auto *GEP = dyn_cast<GetElementPtrInst>(&I)) {
+                    auto *S = dyn_cast<StructType>(GEP->getSourceElementType());
+                    if (S && !S->isLiteral() && !GEP->getType()->isVectorTy())
+                        gepsOf[S].push_back(GEP);
+                    else
+                        reject(GEP->getSourceElementType(), false);
+                }
+
+                reject(I.getType(), false);
+                for (Value *Op : I.operands())
+                    reject(Op->getType(), false);
+            }
+    }
+}
+
+std::vector<StructType *> TypeSafeStructs::types() const
+{
+    std::vector<StructType *> result;
+    for (StructType *S : safe)
+        result.push_back(S);
+    // Keep the output independent of pointer values.
+    std::sort(result.begin(), result.end(), [](StructType *a, StructType *b) {
+        return a->getName() < b->getName();
+    });
+    return result;
+}
+
+//***********************Function visitCast********************************//
+// the only casts allowed on a safe type: the i8* from malloc to S*, and
+// S* back to i8* for free
+//*************************************************************************//
+
+void TypeSafeStructs::visitCast(CastInst *CI)
+{
+    Type *I8PtrTy = Type::getInt8PtrTy(CI->getContext());
+    Type *Src = CI->getSrcTy(), *Dst = CI->getDestTy();
+
+    if (isa<BitCastInst>(CI) && Src == I8PtrTy && Dst->isPointerTy() &&
+        !cast<PointerType>(Dst)->isOpaque()) {
+        auto *S = dyn_cast<StructType>(Dst->getPointerElementType());
+        auto *Malloc = dyn_cast<CallInst>(CI->getOperand(0));
+        if (S && !S->isLiteral() && Malloc && isCallTo(Malloc, "malloc") && S->isSized() &&
+            isMultipleOf(Malloc->getArgOperand(0), DL.getTypeAllocSize(S))) {
+            bool onlyCasts = true;
+            for (User *U : Malloc->users())
+                if (!isa<BitCastInst>(U) || U->getType() != Dst)
+                    onlyCasts = false;
+            if (onlyCasts) {
+                auto &sites = mallocsOf[S];
+                if (std::find(sites.begin(), sites.end(), Malloc) == sites.end())
+                    sites.push_back(Malloc);
+                return;
+            }
+        }
+    }
+
+    if (isa<BitCastInst>(CI) && Dst == I8PtrTy && Src->isPointerTy() &&
+        !cast<PointerType>(Src)->isOpaque()) {
+        auto *S = dyn_cast<StructType>(Src->getPointerElementType());
+        bool onlyFrees = S && !S->isLiteral() && !CI->use_empty();
+        for (User *U : CI->users()) {
+            auto *Free = dyn_cast<CallInst>(U);
+            if (!Free || !isCallTo(Free, "free") || Free->getArgOperand(0) != CI)
+                onlyFrees = false;
+        }
+        if (onlyFrees) {
+            for (User *U : CI->users())
+                freesOf[S].push_back(cast<CallInst>(U));
+            return;
+        }
+    }
+
+    reject(Src, true);
+    reject(Dst, true);
+}
+
+void TypeSafeStructs::visitCall(CallBase *CB)
+{
+    if (isa<DbgInfoIntrinsic>(CB))
+        return;
+
+    Function *Callee = CB->getCalledFunction();
+    bool visible = Callee && !Callee->isDeclaration() &&
+                   Callee->getFunctionType() == CB->getFunctionType();
+
+    for (unsigned a = 0; a < CB->arg_size(); a++) {
+        bool copies = CB->isByValArgument(a) || CB->paramHasAttr(a, Attribute::StructRet) ||
+                      CB->paramHasAttr(a, Attribute::InAlloca) ||
+                      CB->paramHasAttr(a, Attribute::Preallocated);
+        reject(CB->getArgOperand(a)->getType(), !visible || copies);
+    }
+    reject(CB->getType(), !visible);
+}
+
+void TypeSafeStructs::visitConstant(Constant *C)
+{
+    if (isa<GlobalValue>(C) || isa<ConstantData>(C))
+        return;
+    if (auto *CE = dyn_cast<ConstantExpr>(C)) {
+        reject(CE->getType(), true);
+        if (auto *GEP = dyn_cast<GEPOperator>(CE))
+            reject(GEP->getSourceElementType(), true);
+    }
+    for (Value *Op : C->operands())
+        if (auto *OpC = dyn_cast<Constant>(Op)) {
+            reject(OpC->getType(), isa<ConstantExpr>(C));
+            visitConstant(OpC);
+        }
+}
+
+int AccessedField(GetElementPtrInst *GEP)
+{
+    if (GEP->getNumIndices() < 2)
+        return -1;
+    return cast<ConstantInt>(GEP->getOperand(2))->getZExtValue();
+}
+
+Value *RescaleAllocationSize(Value *Size, uint64_t OldElem, uint64_t NewElem,
+                             Instruction *InsertBefore)
+{
+    if (auto *C = dyn_cast<ConstantInt>(Size))
+        return ConstantInt::get(C->getType(), C->getZExtValue() / OldElem * NewElem);
+
+    auto *BO = cast<BinaryOperator>(Size);
+    IRBuilder<> B(InsertBefore);
+    for (unsigned i = 0; i < 2; i++)
+        if (auto *C = dyn_cast<ConstantInt>(BO->getOperand(i)))
+            if (!C->isZero() && C->getZExtValue() % OldElem == 0)
+                return B.CreateMul(BO->getOperand(1 - i),
+                                   ConstantInt::get(C->getType(),
+                                                    C->getZExtValue() / OldElem * NewElem));
+    return Size;
+}
+
+void ClampAccessAlignment(Value *Addr, const DataLayout &DL)
+{
+    for (User *U : Addr->users()) {
+        if (auto *LI = dyn_cast<LoadInst>(U))
+            LI->setAlignment(std::min(LI->getAlign(), DL.getABITypeAlign(LI->getType())));
+        else if (auto *SI = dyn_cast<StoreInst>(U))
+            if (SI->getPointerOperand() == Addr)
+                SI->setAlignment(std::min(SI->getAlign(),
+                                          DL.getABITypeAlign(SI->getValueOperand()->getType())));
+    }
+}
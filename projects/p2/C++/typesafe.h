@@ -0,0 +1,61 @@
+#ifndef TYPESAFE_H
+#define TYPESAFE_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+/* Identified struct types whose layout a pass may change. Every object of
+   a safe type comes from a malloc whose result is only cast to that type,
+   its size is a multiple of the type's size, and its bytes are only
+   reached through GEPs on the type. Safe types never appear by value in
+   another type, a global, an alloca or a load/store, and typed pointers
+   to them never reach external code or integer/pointer casts. */
+class TypeSafeStructs {
+public:
+    explicit TypeSafeStructs(llvm::Module *M);
+
+    bool isSafe(llvm::StructType *S) const { return safe.count(S) != 0; }
+    std::vector<llvm::StructType *> types() const;
+
+    /* GEPs whose source element type is S. */
+    const std::vector<llvm::GetElementPtrInst *> &geps(llvm::StructType *S) { return gepsOf[S]; }
+
+    /* Calls to malloc whose result is cast to S*. */
+    const std::vector<llvm::CallInst *> &mallocs(llvm::StructType *S) { return mallocsOf[S]; }
+
+    /* Calls to free on an S* cast to i8*. */
+    const std::vector<llvm::CallInst *> &frees(llvm::StructType *S) { return freesOf[S]; }
+
+private:
+    std::set<llvm::StructType *> safe;
+    std::map<llvm::StructType *, std::vector<llvm::GetElementPtrInst *>> gepsOf;
+    std::map<llvm::StructType *, std::vector<llvm::CallInst *>> mallocsOf;
+    std::map<llvm::StructType *, std::vector<llvm::CallInst *>> freesOf;
+    const llvm::DataLayout &DL;
+
+    void reject(llvm::Type *T, bool throughPointers);
+    void visitCast(llvm::CastInst *CI);
+    void visitCall(llvm::CallBase *CB);
+    void visitConstant(llvm::Constant *C);
+};
+
+/* The field of the struct a GEP on it addresses, or -1 for plain pointer
+   arithmetic (a single index). */
+int AccessedField(llvm::GetElementPtrInst *GEP);
+
+/* Size of an allocation that held Size bytes of OldElem objects once each
+   object takes NewElem bytes. Size must be a constant or a multiply by a
+   constant that are multiples of OldElem. */
+llvm::Value *RescaleAllocationSize(llvm::Value *Size, uint64_t OldElem, uint64_t NewElem,
+                                   llvm::Instruction *InsertBefore);
+
+/* Lower the alignment of loads and stores through Addr to the ABI
+   alignment of the accessed type; after a layout change the field may
+   sit at a less aligned offset than before. */
+void ClampAccessAlignment(llvm::Value *Addr, const llvm::DataLayout &DL);
+
+#endif
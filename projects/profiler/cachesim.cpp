@@ -0,0 +1,380 @@
+/*
+ * File: cachesim.cpp
+ *
+ * Description:
+ *   Offline cache simulator for the traces of profiler -memtrace.
+ *
+ *     cachesim [-l1=32k:8:64] [-l2=256k:8:64] [-llc=8m:16:64] [-top=N]
+ *              [-o report] <llvmmem.trace> <map>
+ *
+ *   Each level is size:ways:line, with an LRU set-associative model. An
+ *   access goes to L1, then to L2 on a miss and the LLC on a miss there;
+ *   misses fill every level they went through (no inclusion is enforced).
+ *   An access that spans lines touches all of them and misses a level if
+ *   any of its lines does. Writes allocate like reads.
+ *
+ *   The map gives each ID its size, function, block, innermost loop and
+ *   IR text. The report has the totals, the top instructions by misses
+ *   (LLC first, then L2, then L1) and every loop by misses, with the miss
+ *   rates of each level over the accesses of that instruction or loop.
+ *   Accesses outside loops are grouped per function as loop "-".
+ *
+ *   Besides the binary format of runtime/memtrace_rt.c, a trace can be
+ *   text: a first line "# memtrace text", then "id address" lines (hex
+ *   address) and "gap count" lines.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string>
+        TraceFile(cl::Positional, cl::desc("<trace>"), cl::Required);
+
+static cl::opt<std::string>
+        MapFile(cl::Positional, cl::desc("<map>"), cl::Required);
+
+static cl::opt<std::string>
+        L1Config("l1", cl::desc("L1 size:ways:line."), cl::init("32k:8:64"));
+
+static cl::opt<std::string>
+        L2Config("l2", cl::desc("L2 size:ways:line."), cl::init("256k:8:64"));
+
+static cl::opt<std::string>
+        LLCConfig("llc", cl::desc("Last-level cache size:ways:line."), cl::init("8m:16:64"));
+
+static cl::opt<unsigned>
+        Top("top", cl::desc("Instructions listed in the report."), cl::init(20));
+
+static cl::opt<std::string>
+        ReportFile("o", cl::desc("<report>"), cl::init("-"));
+
+static const unsigned Levels = 3;
+
+struct Cache {
+    std::string config;
+    uint64_t sets = 0, ways = 0, line = 0;
+    std::vector<uint64_t> tags, stamps;
+    uint64_t clock = 0;
+
+    bool parse(const std::string &text)
+    {
+        config = text;
+        std::vector<uint64_t> f;
+        std::stringstream in(text);
+        std::string part;
+        while (std::getline(in, part, ':')) {
+            char *end;
+            uint64_t v = strtoull(part.c_str(), &end, 10);
+            if (*end == 'k' || *end == 'K')
+                v <<= 10;
+            else if (*end == 'm' || *end == 'M')
+                v <<= 20;
+            f.push_back(v);
+        }
+        if (f.size() != 3 || !f[1] || !f[2] || (f[2] & (f[2] - 1)) || f[0] % (f[1] * f[2]))
+            return false;
+        ways = f[1];
+        line = f[2];
+        sets = f[0] / (ways * line);
+        if (!sets)
+            return false;
+        tags.assign(sets * ways, ~0ull);
+        stamps.assign(sets * ways, 0);
+        return true;
+    }
+
+    // true on a hit; a miss replaces the least recently used way
+    bool access(uint64_t lineAddr)
+    {
+        uint64_t set = lineAddr % sets, victim = set * ways;
+        clock++;
+        for (uint64_t w = set * ways; w < (set + 1) * ways; w++) {
+            if (tags[w] == lineAddr) {
+                stamps[w] = clock;
+                return true;
+            }
+            if (stamps[w] < stamps[victim])
+                victim = w;
+        }
+        tags[victim] = lineAddr;
+        stamps[victim] = clock;
+        return false;
+    }
+};
+
+struct Access {
+    unsigned size = 1;
+    bool write = false;
+    std::string function, block, loop, text;
+    unsigned depth = 0;
+};
+
+struct Counts {
+    uint64_t accesses = 0;
+    uint64_t misses[Levels] = {0, 0, 0};
+
+    void add(const bool miss[Levels])
+    {
+        accesses++;
+        for (unsigned l = 0; l < Levels; l++)
+            misses[l] += miss[l];
+    }
+
+    bool operator<(const Counts &o) const
+    {
+        for (unsigned l = Levels; l-- > 0;)
+            if (misses[l] != o.misses[l])
+                return misses[l] > o.misses[l];
+        return accesses > o.accesses;
+    }
+};
+
+static Cache Caches[Levels];
+static std::vector<Access> Map;
+static std::vector<Counts> ByID;
+static Counts Total;
+static uint64_t Gaps, Skipped;
+
+static bool readMap(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::vector<std::string> f;
+        size_t start = 0, tab;
+        while (f.size() < 7 && (tab = line.find('\t', start)) != std::string::npos) {
+            f.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        f.push_back(line.substr(start));
+        if (f.size() != 8)
+            continue;
+        unsigned id = strtoul(f[0].c_str(), nullptr, 10);
+        if (id >= Map.size())
+            Map.resize(id + 1);
+        Access &A = Map[id];
+        A.write = f[1] == "W";
+        A.size = std::max(1ul, strtoul(f[2].c_str(), nullptr, 10));
+        A.function = f[3];
+        A.block = f[4];
+        A.loop = f[5];
+        A.depth = strtoul(f[6].c_str(), nullptr, 10);
+        A.text = f[7];
+    }
+    ByID.resize(Map.size());
+    return true;
+}
+
+//***********************Function simulate*********************************//
+// run one access through the hierarchy
+//*************************************************************************//
+
+static void simulate(unsigned id, uint64_t address)
+{
+    unsigned size = id < Map.size() ? Map[id].size : 1;
+    bool miss[Levels] = {false, false, false};
+    uint64_t line = Caches[0].line;
+    for (uint64_t a = address & ~(line - 1); a < address + size; a += line)
+        for (unsigned l = 0; l < Levels; l++) {
+            if (Caches[l].access(a / Caches[l].line))
+                break;
+            miss[l] = true;
+        }
+    if (id >= ByID.size())
+        ByID.resize(id + 1);
+    ByID[id].add(miss);
+    Total.add(miss);
+}
+
+static bool readVarint(std::istream &in, uint64_t &v)
+{
+    v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF)
+            return false;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static bool readBinaryTrace(std::istream &in)
+{
+    std::unordered_map<uint64_t, std::vector<uint64_t>> last;
+    for (;;) {
+        uint64_t tid;
+        uint32_t length;
+        if (!in.read((char *)&tid, 8))
+            return true;
+        if (!in.read((char *)&length, 4))
+            return false;
+        std::string chunk(length, '\0');
+        if (!in.read(&chunk[0], length))
+            return false;
+        std::istringstream records(chunk);
+        std::vector<uint64_t> &prev = last[tid];
+        uint64_t id, value;
+        while (readVarint(records, id)) {
+            if (!readVarint(records, value))
+                return false;
+            if (id == 0) {
+                Gaps++;
+                Skipped += value;
+                continue;
+            }
+            if (id >= prev.size())
+                prev.resize(id + 1, 0);
+            int64_t delta = (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+            prev[id] += delta;
+            simulate(id, prev[id]);
+        }
+    }
+}
+
+static bool readTextTrace(std::istream &in)
+{
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string first;
+        uint64_t value;
+        if (!(fields >> first) || first[0] == '#')
+            continue;
+        if (first == "gap") {
+            if (fields >> value) {
+                Gaps++;
+                Skipped += value;
+            }
+            continue;
+        }
+        if (!(fields >> std::hex >> value))
+            return false;
+        simulate(strtoul(first.c_str(), nullptr, 10), value);
+    }
+    return true;
+}
+
+static void printRates(raw_ostream &OS, const Counts &C)
+{
+    OS << format("%12llu", (unsigned long long)C.accesses);
+    for (unsigned l = 0; l < Levels; l++)
+        OS << format(" %8.2f", C.accesses ? 100.0 * C.misses[l] / C.accesses : 0.0);
+}
+
+static void report(raw_ostream &OS)
+{
+    static const char *names[Levels] = {"L1", "L2", "LLC"};
+
+    OS << "cachesim: " << Total.accesses << " accesses simulated";
+    if (Gaps)
+        OS << ", " << Skipped << " skipped in " << Gaps << " gaps";
+    OS << "\n";
+    for (unsigned l = 0; l < Levels; l++)
+        OS << format("  %-3s %-12s %12llu misses %8.2f%%\n", names[l], Caches[l].config.c_str(),
+                     (unsigned long long)Total.misses[l],
+                     Total.accesses ? 100.0 * Total.misses[l] / Total.accesses : 0.0);
+
+    std::vector<unsigned> ids;
+    for (unsigned id = 1; id < ByID.size(); id++)
+        if (ByID[id].accesses)
+            ids.push_back(id);
+    std::stable_sort(ids.begin(), ids.end(), [](unsigned a, unsigned b) { return ByID[a] < ByID[b]; });
+
+    OS << "\nInstructions by misses:\n";
+    OS << "    id     accesses      L1%      L2%     LLC%  where\n";
+    for (unsigned i = 0; i < ids.size() && i < Top; i++) {
+        unsigned id = ids[i];
+        OS << format("%6u ", id);
+        printRates(OS, ByID[id]);
+        if (id < Map.size() && !Map[id].function.empty()) {
+            const Access &A = Map[id];
+            OS << "  " << A.function << " " << A.block << " (loop " << A.loop << "): " << A.text;
+        }
+        OS << "\n";
+    }
+
+    std::map<std::pair<std::string, std::string>, Counts> loops;
+    std::map<std::pair<std::string, std::string>, unsigned> depth;
+    for (unsigned id : ids) {
+        if (id >= Map.size() || Map[id].function.empty())
+            continue;
+        auto key = std::make_pair(Map[id].function, Map[id].loop);
+        Counts &C = loops[key];
+        C.accesses += ByID[id].accesses;
+        for (unsigned l = 0; l < Levels; l++)
+            C.misses[l] += ByID[id].misses[l];
+        depth[key] = Map[id].depth;
+    }
+    std::vector<std::pair<std::pair<std::string, std::string>, Counts>> sorted(loops.begin(), loops.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const std::pair<std::pair<std::string, std::string>, Counts> &a,
+                        const std::pair<std::pair<std::string, std::string>, Counts> &b) { return a.second < b.second; });
+
+    OS << "\nLoops by misses:\n";
+    OS << " depth     accesses      L1%      L2%     LLC%  function loop\n";
+    for (auto &L : sorted) {
+        OS << format("%6u ", depth[L.first]);
+        printRates(OS, L.second);
+        OS << "  " << L.first.first << " " << L.first.second << "\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "cache simulator for profiler -memtrace traces\n");
+    llvm_shutdown_obj Y;
+
+    const std::string *configs[Levels] = {&L1Config.getValue(), &L2Config.getValue(), &LLCConfig.getValue()};
+    for (unsigned l = 0; l < Levels; l++)
+        if (!Caches[l].parse(*configs[l])) {
+            errs() << argv[0] << ": bad cache size:ways:line " << *configs[l] << "\n";
+            return 1;
+        }
+    if (!readMap(MapFile)) {
+        errs() << argv[0] << ": cannot read map " << MapFile << "\n";
+        return 1;
+    }
+
+    std::ifstream in(TraceFile, std::ios::binary);
+    char magic[8];
+    if (!in || !in.read(magic, 8)) {
+        errs() << argv[0] << ": cannot read trace " << TraceFile << "\n";
+        return 1;
+    }
+    bool ok;
+    if (!memcmp(magic, "LLVMMEM1", 8)) {
+        ok = readBinaryTrace(in);
+    } else {
+        in.seekg(0);
+        ok = readTextTrace(in);
+    }
+    if (!ok)
+        errs() << argv[0] << ": " << TraceFile << " is truncated or malformed, reporting what was read\n";
+
+    std::error_code EC;
+    raw_fd_ostream OS(ReportFile, EC, sys::fs::OF_Text);
+    if (EC) {
+        errs() << argv[0] << ": cannot write " << ReportFile << "\n";
+        return 1;
+    }
+    report(OS);
+    return 0;
+}
@@ -0,0 +1,487 @@
+/*
+ * File: edgeprofile.cpp
+ *
+ * Description:
+ *   Edge profiling. Each function's CFG gets a virtual EXIT node, with an
+ *   edge from every block that leaves the function and one from EXIT back
+ *   to the entry. A spanning tree of that graph is built from the heaviest
+ *   edges first (deeper loops weigh more, critical edges break ties), and
+ *   only the edges off the tree get a counter: E - V + 1 of them. The
+ *   tree edges are recovered from the counted ones by flow conservation.
+ *
+ *   A counted edge is incremented at the end of its source if that block
+ *   has a single successor, at the start of its target if that block has
+ *   a single predecessor, and otherwise in a new block on the edge.
+ *
+ *   Both -do-profile and -use-profile rebuild the same tree from the same
+ *   input, so the profile file only holds the counters. A checksum of the
+ *   CFG guards against a profile from a different build. Functions with
+ *   invoke, callbr or indirectbr are skipped. Exiting the program from a
+ *   nested call leaves the flow of the open frames unbalanced; counts that
+ *   come out negative are clamped to zero.
+ */
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "edgeprofile.h"
+
+using namespace llvm;
+
+static llvm::Statistic ProfEdges = {"", "ProfEdges", "Profile CFG edges (with the virtual exit edges)"};
+static llvm::Statistic ProfCounters = {"", "ProfCounters", "Profile edge counters inserted"};
+static llvm::Statistic ProfSplit = {"", "ProfSplit", "Profile edges split to hold a counter"};
+static llvm::Statistic ProfFunctions = {"", "ProfFunctions", "Profile functions instrumented"};
+static llvm::Statistic ProfLoaded = {"", "ProfLoaded", "Profile functions given counts"};
+static llvm::Statistic ProfMismatch = {"", "ProfMismatch", "Profile functions whose CFG no longer matches"};
+
+static const char *BlockCountKind = "block_count";
+
+// a null src or dst is the virtual EXIT node
+struct ProfileEdge {
+    BasicBlock *src, *dst;
+    bool inTree;
+};
+
+struct EdgeGraph {
+    std::vector<ProfileEdge> edges;    // edges[0] is EXIT -> entry
+    DenseMap<BasicBlock *, unsigned> node;
+    unsigned exitNode;
+    uint64_t checksum;
+
+    unsigned nodeOf(BasicBlock *BB) const { return BB ? node.lookup(BB) : exitNode; }
+};
+
+// what the loaded profile cost compared to counting every edge
+static uint64_t LoadedIncrements, LoadedEdgeRuns;
+
+static bool canProfile(Function &F)
+{
+    if (F.isDeclaration())
+        return false;
+    for (BasicBlock &BB : F) {
+        Instruction *TI = BB.getTerminator();
+        if (isa<InvokeInst>(TI) || isa<CallBrInst>(TI) || isa<IndirectBrInst>(TI) ||
+            BB.isEHPad())
+            return false;
+    }
+    return true;
+}
+
+static unsigned uniqueSuccessors(BasicBlock *BB)
+{
+    SmallPtrSet<BasicBlock *, 4> seen;
+    for (BasicBlock *S : successors(BB))
+        seen.insert(S);
+    return seen.size();
+}
+
+static unsigned uniquePredecessors(BasicBlock *BB)
+{
+    SmallPtrSet<BasicBlock *, 4> seen;
+    for (BasicBlock *P : predecessors(BB))
+        seen.insert(P);
+    return seen.size();
+}
+
+static unsigned findRoot(std::vector<unsigned> &parent, unsigned n)
+{
+    while (parent[n] != n)
+        n = parent[n] = parent[parent[n]];
+    return n;
+}
+
+//***********************Function buildGraph*******************************//
+// the edges of F in block and successor order, with the spanning tree
+// marked. The same IR always gives the same graph.
+//*************************************************************************//
+
+static EdgeGraph buildGraph(Function &F)
+{
+    EdgeGraph G;
+    unsigned n = 0;
+    for (BasicBlock &BB : F)
+        G.node[&BB] = n++;
+    G.exitNode = n;
+
+    G.edges.push_back({nullptr, &F.getEntryBlock(), false});
+    for (BasicBlock &BB : F) {
+        SmallPtrSet<BasicBlock *, 4> seen;
+        for (BasicBlock *S : successors(&BB))
+            if (seen.insert(S).second)
+                G.edges.push_back({&BB, S, false});
+        if (succ_empty(&BB))
+            G.edges.push_back({&BB, nullptr, false});
+    }
+
+    // FNV-1a over the shape of the graph
+    G.checksum = 14695981039346656037ull;
+    for (ProfileEdge &E : G.edges) {
+        G.checksum = (G.checksum ^ G.nodeOf(E.src)) * 1099511628211ull;
+        G.checksum = (G.checksum ^ G.nodeOf(E.dst)) * 1099511628211ull;
+    }
+
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    std::vector<std::pair<uint64_t, unsigned>> byWeight;
+    for (unsigned e = 0; e < G.edges.size(); e++) {
+        ProfileEdge &E = G.edges[e];
+        uint64_t w;
+        if (!E.src) {
+            w = ~0ull;
+        } else {
+            unsigned depth = LI.getLoopDepth(E.src);
+            if (E.dst)
+                depth = std::min(depth, LI.getLoopDepth(E.dst));
+            w = 2ull << (3 * std::min(depth, 20u));
+            // counting a critical edge costs a new block
+            if (E.dst && uniqueSuccessors(E.src) > 1 && uniquePredecessors(E.dst) > 1)
+                w++;
+        }
+        byWeight.push_back(std::make_pair(w, e));
+    }
+    std::stable_sort(byWeight.begin(), byWeight.end(),
+                     [](const std::pair<uint64_t, unsigned> &a,
+                        const std::pair<uint64_t, unsigned> &b) { return a.first > b.first; });
+
+    std::vector<unsigned> parent(n + 1);
+    for (unsigned i = 0; i <= n; i++)
+        parent[i] = i;
+    for (auto &p : byWeight) {
+        ProfileEdge &E = G.edges[p.second];
+        unsigned a = findRoot(parent, G.nodeOf(E.src));
+        unsigned b = findRoot(parent, G.nodeOf(E.dst));
+        if (a != b) {
+            parent[a] = b;
+            E.inTree = true;
+        }
+    }
+    return G;
+}
+
+//***********************Function splitProfileEdge*************************//
+// a block on every Src -> Dst successor slot; Dst's phis take their Src
+// value from it instead
+//*************************************************************************//
+
+static BasicBlock *splitProfileEdge(BasicBlock *Src, BasicBlock *Dst)
+{
+    BasicBlock *NB = BasicBlock::Create(Src->getContext(), "prof.edge", Src->getParent(), Dst);
+    BranchInst::Create(Dst, NB);
+    Instruction *TI = Src->getTerminator();
+    for (unsigned s = 0; s < TI->getNumSuccessors(); s++)
+        if (TI->getSuccessor(s) == Dst)
+            TI->setSuccessor(s, NB);
+    for (PHINode &PN : Dst->phis()) {
+        Value *V = PN.getIncomingValueForBlock(Src);
+        int idx;
+        while ((idx = PN.getBasicBlockIndex(Src)) >= 0)
+            PN.removeIncomingValue(idx, false);
+        PN.addIncoming(V, NB);
+    }
+    ProfSplit++;
+    return NB;
+}
+
+static Instruction *counterPosition(ProfileEdge &E)
+{
+    if (!E.dst || uniqueSuccessors(E.src) == 1)
+        return E.src->getTerminator();
+    if (uniquePredecessors(E.dst) == 1)
+        return &*E.dst->getFirstInsertionPt();
+    return splitProfileEdge(E.src, E.dst)->getTerminator();
+}
+
+//***********************Function instrumentFunction***********************//
+// one i64 counter per edge off the tree, in edge order; returns the
+// counter array, or null if nothing needs counting
+//*************************************************************************//
+
+static GlobalVariable *instrumentFunction(Function &F, EdgeGraph &G, unsigned &count)
+{
+    std::vector<ProfileEdge *> chords;
+    for (ProfileEdge &E : G.edges)
+        if (!E.inTree)
+            chords.push_back(&E);
+    count = chords.size();
+    ProfEdges += G.edges.size();
+    if (chords.empty())
+        return nullptr;
+
+    Module *M = F.getParent();
+    Type *I64 = Type::getInt64Ty(M->getContext());
+    ArrayType *Ty = ArrayType::get(I64, chords.size());
+    auto *Counters = new GlobalVariable(*M, Ty, false, GlobalValue::InternalLinkage,
+                                        ConstantAggregateZero::get(Ty), "prof.counters." + F.getName());
+
+    // pick every position before splitting anything
+    std::vector<Instruction *> at;
+    for (ProfileEdge *E : chords)
+        at.push_back(counterPosition(*E));
+
+    for (unsigned c = 0; c < chords.size(); c++) {
+        IRBuilder<> B(at[c]);
+        Value *P = B.CreateConstInBoundsGEP2_64(Ty, Counters, 0, c);
+        B.CreateStore(B.CreateAdd(B.CreateLoad(I64, P), B.getInt64(1)), P);
+    }
+    ProfCounters += chords.size();
+    ProfFunctions++;
+    return Counters;
+}
+
+void InsertEdgeProfiling(Module *M)
+{
+    LLVMContext &C = M->getContext();
+    Type *I8PtrTy = Type::getInt8PtrTy(C);
+    Type *I64 = Type::getInt64Ty(C);
+    Type *I32 = Type::getInt32Ty(C);
+    // runtime/profile_rt.c: struct ProfFunction
+    StructType *EntryTy = StructType::create(C, {I8PtrTy, I64, I64->getPointerTo(), I32},
+                                             "prof.function");
+
+    std::vector<Function *> funcs;
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (canProfile(*f))
+            funcs.push_back(&*f);
+
+    Function *Dump = Function::Create(FunctionType::get(Type::getVoidTy(C), false),
+                                      GlobalValue::InternalLinkage, "prof.dump", M);
+    IRBuilder<> B(BasicBlock::Create(C, "entry", Dump));
+
+    std::vector<Constant *> table;
+    for (Function *F : funcs) {
+        EdgeGraph G = buildGraph(*F);
+        unsigned count;
+        GlobalVariable *Counters = instrumentFunction(*F, G, count);
+        Constant *Ptr = Counters ? ConstantExpr::getBitCast(Counters, I64->getPointerTo())
+                                 : ConstantPointerNull::get(I64->getPointerTo());
+        table.push_back(ConstantStruct::get(EntryTy, {B.CreateGlobalStringPtr(F->getName()),
+                                                      ConstantInt::get(I64, G.checksum), Ptr,
+                                                      ConstantInt::get(I32, count)}));
+    }
+
+    ArrayType *TableTy = ArrayType::get(EntryTy, table.size());
+    auto *Table = new GlobalVariable(*M, TableTy, true, GlobalValue::InternalLinkage,
+                                     ConstantArray::get(TableTy, table), "prof.functions");
+    FunctionCallee Write = M->getOrInsertFunction("prof_dump", Type::getVoidTy(C),
+                                                  EntryTy->getPointerTo(), I32);
+    B.CreateCall(Write, {B.CreateConstInBoundsGEP2_64(TableTy, Table, 0, 0),
+                         B.getInt32(table.size())});
+    B.CreateRetVoid();
+    appendToGlobalDtors(*M, Dump, 0);
+}
+
+struct FunctionProfile {
+    uint64_t checksum;
+    std::vector<uint64_t> counters;
+};
+
+//***********************Function readProfile******************************//
+// one line per function: name checksum n c0 .. c(n-1)
+//*************************************************************************//
+
+static bool readProfile(StringRef path, std::map<std::string, FunctionProfile> &profile)
+{
+    std::ifstream in(path.str());
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        FunctionProfile P;
+        unsigned n;
+        if (!(fields >> name >> P.checksum >> n))
+            continue;
+        P.counters.resize(n);
+        for (unsigned c = 0; c < n; c++)
+            fields >> P.counters[c];
+        if (fields)
+            profile[name] = P;
+    }
+    return true;
+}
+
+//***********************Function solveEdges*******************************//
+// fill in the tree edges: a node with one unknown edge left gets it from
+// inflow == outflow, until none is left
+//*************************************************************************//
+
+static std::vector<int64_t> solveEdges(EdgeGraph &G, std::vector<uint64_t> &counters)
+{
+    std::vector<int64_t> count(G.edges.size(), 0);
+    std::vector<bool> known(G.edges.size(), false);
+    std::vector<std::vector<unsigned>> incident(G.exitNode + 1);
+    unsigned c = 0;
+    for (unsigned e = 0; e < G.edges.size(); e++) {
+        ProfileEdge &E = G.edges[e];
+        if (!E.inTree) {
+            count[e] = counters[c++];
+            known[e] = true;
+        }
+        incident[G.nodeOf(E.src)].push_back(e);
+        if (G.nodeOf(E.dst) != G.nodeOf(E.src))
+            incident[G.nodeOf(E.dst)].push_back(e);
+    }
+
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (unsigned v = 0; v <= G.exitNode; v++) {
+            int unknown = -1, unknowns = 0;
+            int64_t in = 0, out = 0;
+            for (unsigned e : incident[v]) {
+                ProfileEdge &E = G.edges[e];
+                if (!known[e]) {
+                    unknown = e;
+                    unknowns++;
+                    continue;
+                }
+                if (G.nodeOf(E.dst) == v)
+                    in += count[e];
+                if (G.nodeOf(E.src) == v)
+                    out += count[e];
+            }
+            if (unknowns != 1)
+                continue;
+            bool isIn = G.nodeOf(G.edges[unknown].dst) == v;
+            count[unknown] = isIn ? out - in : in - out;
+            known[unknown] = true;
+            progress = true;
+        }
+    }
+
+    for (int64_t &n : count)
+        n = std::max<int64_t>(n, 0);
+    return count;
+}
+
+static void attachCounts(Function &F, EdgeGraph &G, std::vector<int64_t> &count)
+{
+    LLVMContext &C = F.getContext();
+    MDBuilder MDB(C);
+    std::map<std::pair<BasicBlock *, BasicBlock *>, uint64_t> edgeCount;
+    DenseMap<BasicBlock *, uint64_t> blockCount;
+    for (unsigned e = 0; e < G.edges.size(); e++) {
+        ProfileEdge &E = G.edges[e];
+        if (!E.src) {
+            F.setEntryCount(Function::ProfileCount(count[e], Function::PCT_Real));
+            continue;
+        }
+        edgeCount[std::make_pair(E.src, E.dst)] = count[e];
+        blockCount[E.src] += count[e];
+    }
+
+    for (BasicBlock &BB : F) {
+        Instruction *TI = BB.getTerminator();
+        TI->setMetadata(BlockCountKind, MDNode::get(C, ConstantAsMetadata::get(
+                ConstantInt::get(Type::getInt64Ty(C), blockCount.lookup(&BB)))));
+        if (TI->getNumSuccessors() < 2 || !(isa<BranchInst>(TI) || isa<SwitchInst>(TI)))
+            continue;
+
+        // the count of a repeated successor goes on its first slot
+        std::vector<uint64_t> weights;
+        SmallPtrSet<BasicBlock *, 4> seen;
+        uint64_t largest = 0;
+        for (BasicBlock *S : successors(&BB)) {
+            uint64_t w = seen.insert(S).second ? edgeCount[std::make_pair(&BB, S)] : 0;
+            weights.push_back(w);
+            largest = std::max(largest, w);
+        }
+        uint64_t scale = largest / UINT32_MAX + 1;
+        std::vector<uint32_t> scaled;
+        for (uint64_t w : weights)
+            scaled.push_back(w / scale);
+        TI->setMetadata(LLVMContext::MD_prof, MDB.createBranchWeights(scaled));
+    }
+}
+
+bool LoadEdgeProfile(Module *M, StringRef path)
+{
+    std::map<std::string, FunctionProfile> profile;
+    if (!readProfile(path, profile))
+        return false;
+
+    for (auto f = M->begin(); f != M->end(); f++) {
+        if (!canProfile(*f))
+            continue;
+        auto p = profile.find(f->getName().str());
+        if (p == profile.end())
+            continue;
+
+        EdgeGraph G = buildGraph(*f);
+        unsigned chords = 0;
+        for (ProfileEdge &E : G.edges)
+            chords += !E.inTree;
+        if (p->second.checksum != G.checksum || p->second.counters.size() != chords) {
+            ProfMismatch++;
+            continue;
+        }
+
+        std::vector<int64_t> count = solveEdges(G, p->second.counters);
+        for (unsigned e = 0; e < G.edges.size(); e++) {
+            if (!G.edges[e].inTree)
+                LoadedIncrements += count[e];
+            if (G.edges[e].src)
+                LoadedEdgeRuns += count[e];
+        }
+        attachCounts(*f, G, count);
+        ProfLoaded++;
+    }
+    return true;
+}
+
+bool GetBlockCount(const BasicBlock *BB, uint64_t &count)
+{
+    const Instruction *TI = BB->getTerminator();
+    MDNode *N = TI ? TI->getMetadata(BlockCountKind) : nullptr;
+    if (!N)
+        return false;
+    count = mdconst::extract<ConstantInt>(N->getOperand(0))->getZExtValue();
+    return true;
+}
+
+void PrintProfileSummary(Module *M, raw_ostream &OS)
+{
+    std::vector<std::pair<uint64_t, Function *>> hot;
+    for (auto f = M->begin(); f != M->end(); f++) {
+        uint64_t total = 0, count;
+        for (BasicBlock &BB : *f)
+            if (GetBlockCount(&BB, count))
+                total += count;
+        if (total)
+            hot.push_back(std::make_pair(total, &*f));
+    }
+    std::stable_sort(hot.begin(), hot.end(),
+                     [](const std::pair<uint64_t, Function *> &a,
+                        const std::pair<uint64_t, Function *> &b) { return a.first > b.first; });
+
+    OS << "Profile: " << hot.size() << " functions executed\n";
+    for (unsigned h = 0; h < hot.size() && h < 10; h++) {
+        Function *F = hot[h].second;
+        auto entries = F->getEntryCount();
+        OS << "  " << F->getName() << ": " << (entries ? entries->getCount() : 0)
+           << " calls, " << hot[h].first << " block executions\n";
+    }
+    if (LoadedEdgeRuns)
+        OS << "Profile: " << LoadedIncrements << " counter increments for "
+           << LoadedEdgeRuns << " edge executions ("
+           << format("%.1f", 100.0 * LoadedIncrements / LoadedEdgeRuns) << "%)\n";
+}
@@ -0,0 +1,24 @@
+#ifndef EDGEPROFILE_H
+#define EDGEPROFILE_H
+
+#include <cstdint>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+
+/* Count the edges off a spanning tree of each CFG; the counters are
+   written to the profile file at exit by runtime/profile_rt.c. */
+void InsertEdgeProfiling(llvm::Module *M);
+
+/* Read a profile written by an instrumented run of the same module and
+   attach entry counts, branch weights and block counts. Returns false if
+   the file could not be read. */
+bool LoadEdgeProfile(llvm::Module *M, llvm::StringRef path);
+
+/* Hottest functions and the counter overhead of the loaded profile. */
+void PrintProfileSummary(llvm::Module *M, llvm::raw_ostream &OS);
+
+/* The execution count -use-profile attached to BB, if any. */
+bool GetBlockCount(const llvm::BasicBlock *BB, uint64_t &count);
+
+#endif
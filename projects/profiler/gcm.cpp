@@ -0,0 +1,184 @@
+/*
+ * File: gcm.cpp
+ *
+ * Description:
+ *   Global code motion (Click, "Global Code Motion / Global Value
+ *   Numbering", PLDI 1995). Phis, terminators, calls and anything that
+ *   touches memory, has side effects or could trap stay where they are
+ *   (pinned). Every other instruction is free to move:
+ *
+ *   1. Schedule early: the deepest block in the dominator tree that holds
+ *      one of its operands (entry for arguments and constants).
+ *   2. Schedule late: the nearest common dominator of its uses, where a
+ *      phi uses a value at the end of the incoming block and a free user
+ *      counts at the block it was itself scheduled to.
+ *   3. Between the two, on the dominator tree path from late up to early,
+ *      take the block that runs least often: the -use-profile block count
+ *      when the function has one, the loop depth otherwise. Ties go to
+ *      the later block, so nothing is hoisted for no gain.
+ *
+ *   The chosen block gets the instruction before its first user there,
+ *   or before the terminator. Instructions whose block does not change
+ *   keep their place.
+ */
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "edgeprofile.h"
+#include "gcm.h"
+
+using namespace llvm;
+
+static llvm::Statistic GCMHoisted = {"", "GCMHoisted", "GCM instructions moved up the dominator tree"};
+static llvm::Statistic GCMSunk = {"", "GCMSunk", "GCM instructions moved down the dominator tree"};
+static llvm::Statistic GCMProfiled = {"", "GCMProfiled", "GCM functions scheduled with profile counts"};
+
+static bool isPinned(Instruction *I)
+{
+    return isa<PHINode>(I) || I->isTerminator() || isa<CallBase>(I) || isa<AllocaInst>(I) ||
+           I->isEHPad() || I->mayReadOrWriteMemory() || I->mayHaveSideEffects() ||
+           !isSafeToSpeculativelyExecute(I);
+}
+
+struct Scheduler {
+    DominatorTree DT;
+    LoopInfo LI;
+    bool profiled;
+    DenseMap<Instruction *, BasicBlock *> early, block;
+
+    explicit Scheduler(Function &F) : DT(F), LI(DT)
+    {
+        uint64_t count;
+        profiled = GetBlockCount(&F.getEntryBlock(), count);
+    }
+
+    BasicBlock *deeper(BasicBlock *A, BasicBlock *B)
+    {
+        return DT.getNode(A)->getLevel() >= DT.getNode(B)->getLevel() ? A : B;
+    }
+
+    // true if running I in A costs less than in B
+    bool cheaper(BasicBlock *A, BasicBlock *B)
+    {
+        uint64_t a, b;
+        if (profiled && GetBlockCount(A, a) && GetBlockCount(B, b))
+            return a < b;
+        return LI.getLoopDepth(A) < LI.getLoopDepth(B);
+    }
+
+    //***********************Function scheduleEarly************************//
+    // deepest block holding an operand; free operands count at their
+    // own early block, so this is run in dominance order
+    //*********************************************************************//
+
+    void scheduleEarly(Instruction *I, BasicBlock *Entry)
+    {
+        BasicBlock *E = Entry;
+        for (Value *Op : I->operands()) {
+            auto *OpI = dyn_cast<Instruction>(Op);
+            if (!OpI)
+                continue;
+            auto it = early.find(OpI);
+            E = deeper(E, it != early.end() ? it->second : OpI->getParent());
+        }
+        early[I] = E;
+    }
+
+    BasicBlock *useBlock(Use &U)
+    {
+        auto *User = cast<Instruction>(U.getUser());
+        if (auto *PN = dyn_cast<PHINode>(User))
+            return PN->getIncomingBlock(U);
+        auto it = block.find(User);
+        return it != block.end() ? it->second : User->getParent();
+    }
+
+    //***********************Function scheduleLate*************************//
+    // common dominator of the uses, then the cheapest block from there up
+    // to early; run users first
+    //*********************************************************************//
+
+    void scheduleLate(Instruction *I)
+    {
+        BasicBlock *Late = nullptr;
+        for (Use &U : I->uses()) {
+            BasicBlock *B = useBlock(U);
+            if (!DT.isReachableFromEntry(B))
+                continue;
+            Late = Late ? DT.findNearestCommonDominator(Late, B) : B;
+        }
+        BasicBlock *Early = early[I];
+        if (!Late || !DT.dominates(Early, Late))
+            return;
+
+        BasicBlock *Best = Late;
+        for (BasicBlock *B = Late; B != Early;) {
+            B = DT.getNode(B)->getIDom()->getBlock();
+            if (cheaper(B, Best))
+                Best = B;
+        }
+        block[I] = Best;
+    }
+};
+
+static void place(Instruction *I, BasicBlock *B)
+{
+    Instruction *At = B->getTerminator();
+    for (Instruction &J : *B) {
+        if (isa<PHINode>(&J) || &J == I)
+            continue;
+        if (is_contained(J.operands(), I)) {
+            At = &J;
+            break;
+        }
+    }
+    I->moveBefore(At);
+}
+
+static void scheduleFunction(Function &F)
+{
+    Scheduler S(F);
+    if (S.profiled)
+        GCMProfiled++;
+
+    std::vector<Instruction *> order;
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    for (BasicBlock *BB : RPOT)
+        for (Instruction &I : *BB)
+            if (!isPinned(&I)) {
+                S.scheduleEarly(&I, &F.getEntryBlock());
+                order.push_back(&I);
+            }
+
+    for (auto it = order.rbegin(); it != order.rend(); it++)
+        S.scheduleLate(*it);
+
+    // users were scheduled first, so moving in the same order puts each
+    // instruction in front of users that already sit in its new block
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        Instruction *I = *it;
+        auto b = S.block.find(I);
+        if (b == S.block.end() || b->second == I->getParent())
+            continue;
+        if (S.DT.properlyDominates(b->second, I->getParent()))
+            GCMHoisted++;
+        else
+            GCMSunk++;
+        place(I, b->second);
+    }
+}
+
+void GlobalCodeMotion(Module *M)
+{
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration())
+            scheduleFunction(*f);
+}
@@ -0,0 +1,11 @@
+#ifndef GCM_H
+#define GCM_H
+
+#include "llvm/IR/Module.h"
+
+/* Click's global code motion: move each unpinned instruction to the
+   least frequently executed block between its earliest and latest legal
+   position. */
+void GlobalCodeMotion(llvm::Module *M);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * File: instmix.cpp
+ *
+ * Description:
+ *   Dynamic instruction mix. llvm-inst-count and the summaries of p2 and
+ *   p3 count instructions in the IR; this counts the instructions a run
+ *   executes, by class, so an optimization can be judged by the work it
+ *   removes at run time.
+ *
+ *   Every block gets one i64 counter, incremented at its first insertion
+ *   point, and a row of a constant histogram with the number of its
+ *   instructions in each class. Both arrays are handed to prof_mix_dump
+ *   from a global destructor, which multiplies them out and writes the
+ *   totals. Classes:
+ *     loads     load
+ *     stores    store, atomicrmw, cmpxchg
+ *     branches  br, switch, indirectbr, ret, resume
+ *     calls     call, invoke, callbr (intrinsics included)
+ *     alu       integer arithmetic, icmp, casts, getelementptr, select
+ *     fp        floating-point arithmetic, fcmp, casts to or from FP
+ *     other     phi, alloca, aggregate and vector operations, the rest
+ *   Debug intrinsics and lifetime markers emit no code and are not
+ *   counted. The counters themselves are added after the histograms are
+ *   taken, so they are not counted either.
+ */
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "instmix.h"
+
+using namespace llvm;
+
+static llvm::Statistic MixBlocks = {"", "MixBlocks", "InstMix block counters inserted"};
+static llvm::Statistic MixInstructions = {"", "MixInstructions", "InstMix instructions classified"};
+
+// the order of the columns runtime/instmix_rt.c prints
+enum MixClass { MixLoad, MixStore, MixBranch, MixCall, MixALU, MixFP, MixOther, MixClasses };
+
+static bool isFP(Type *T)
+{
+    return T->isFPOrFPVectorTy();
+}
+
+static MixClass classify(Instruction &I)
+{
+    switch (I.getOpcode()) {
+    case Instruction::Load:
+        return MixLoad;
+    case Instruction::Store:
+    case Instruction::AtomicRMW:
+    case Instruction::AtomicCmpXchg:
+        return MixStore;
+    case Instruction::Br:
+    case Instruction::Switch:
+    case Instruction::IndirectBr:
+    case Instruction::Ret:
+    case Instruction::Resume:
+        return MixBranch;
+    case Instruction::Call:
+    case Instruction::Invoke:
+    case Instruction::CallBr:
+        return MixCall;
+    case Instruction::FNeg:
+    case Instruction::FCmp:
+        return MixFP;
+    case Instruction::ICmp:
+    case Instruction::GetElementPtr:
+    case Instruction::Select:
+        return MixALU;
+    default:
+        break;
+    }
+    if (isa<BinaryOperator>(&I))
+        return isFP(I.getType()) ? MixFP : MixALU;
+    if (isa<CastInst>(&I))
+        return isFP(I.getType()) || isFP(I.getOperand(0)->getType()) ? MixFP : MixALU;
+    return MixOther;
+}
+
+static bool emitsCode(Instruction &I)
+{
+    if (I.isDebugOrPseudoInst())
+        return false;
+    if (auto *II = dyn_cast<IntrinsicInst>(&I))
+        return !II->isLifetimeStartOrEnd();
+    return true;
+}
+
+void InsertInstMix(Module *M)
+{
+    LLVMContext &C = M->getContext();
+    Type *I64 = Type::getInt64Ty(C);
+    Type *I32 = Type::getInt32Ty(C);
+
+    std::vector<BasicBlock *> blocks;
+    std::vector<Constant *> rows;
+    ArrayType *RowTy = ArrayType::get(I32, MixClasses);
+    for (auto f = M->begin(); f != M->end(); f++)
+        for (BasicBlock &BB : *f) {
+            // a catchswitch block has nowhere to put a counter
+            if (BB.getFirstInsertionPt() == BB.end())
+                continue;
+            unsigned row[MixClasses] = {0};
+            for (Instruction &I : BB)
+                if (emitsCode(I)) {
+                    row[classify(I)]++;
+                    MixInstructions++;
+                }
+            std::vector<Constant *> cells;
+            for (unsigned c = 0; c < MixClasses; c++)
+                cells.push_back(ConstantInt::get(I32, row[c]));
+            rows.push_back(ConstantArray::get(RowTy, cells));
+            blocks.push_back(&BB);
+        }
+    if (blocks.empty())
+        return;
+
+    ArrayType *CountersTy = ArrayType::get(I64, blocks.size());
+    auto *Counters = new GlobalVariable(*M, CountersTy, false, GlobalValue::InternalLinkage,
+                                        ConstantAggregateZero::get(CountersTy), "prof.mix.counters");
+    ArrayType *HistTy = ArrayType::get(RowTy, blocks.size());
+    auto *Hist = new GlobalVariable(*M, HistTy, true, GlobalValue::InternalLinkage,
+                                    ConstantArray::get(HistTy, rows), "prof.mix.histogram");
+
+    for (unsigned b = 0; b < blocks.size(); b++) {
+        IRBuilder<> B(&*blocks[b]->getFirstInsertionPt());
+        Value *P = B.CreateConstInBoundsGEP2_64(CountersTy, Counters, 0, b);
+        B.CreateStore(B.CreateAdd(B.CreateLoad(I64, P), B.getInt64(1)), P);
+        MixBlocks++;
+    }
+
+    Function *Dump = Function::Create(FunctionType::get(Type::getVoidTy(C), false),
+                                      GlobalValue::InternalLinkage, "prof.mix.dump", M);
+    IRBuilder<> B(BasicBlock::Create(C, "entry", Dump));
+    FunctionCallee Write = M->getOrInsertFunction("prof_mix_dump", Type::getVoidTy(C),
+                                                  I64->getPointerTo(), I32->getPointerTo(), I32);
+    B.CreateCall(Write, {B.CreateConstInBoundsGEP2_64(CountersTy, Counters, 0, 0),
+                         ConstantExpr::getBitCast(Hist, I32->getPointerTo()),
+                         B.getInt32(blocks.size())});
+    B.CreateRetVoid();
+    appendToGlobalDtors(*M, Dump, 0);
+}
@@ -0,0 +1,11 @@
+#ifndef INSTMIX_H
+#define INSTMIX_H
+
+#include "llvm/IR/Module.h"
+
+/* Count each basic block's executions; at exit runtime/instmix_rt.c
+   weights every block's opcode-class histogram by its count and writes
+   the dynamic totals (loads, stores, branches, calls, ALU, FP). */
+void InsertInstMix(llvm::Module *M);
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * File: layout.cpp
+ *
+ * Description:
+ *   Code layout after Pettis and Hansen ("Profile Guided Code
+ *   Positioning", PLDI 1990).
+ *
+ *   Blocks: every block starts as a chain of its own. Edges are visited
+ *   from the heaviest down, and an edge joins two chains when it leaves
+ *   the tail of one and enters the head of the other, so the hot
+ *   successor becomes the fall-through, except that a hot block never
+ *   falls through into a cold one. The entry chain goes first, then
+ *   the other hot chains from the hottest down, then the cold ones in
+ *   their old order. A block is cold when the profile never reached it,
+ *   or without a profile when the static estimate is under 1% of the
+ *   entry.
+ *
+ *   Edge weights are the -use-profile block count of the source times
+ *   the branch probability. Without a profile they come from LLVM's
+ *   static heuristics (loops, unreachable and noreturn paths, pointer and
+ *   zero compares) per call of the function.
+ *
+ *   Functions: call sites weighted the same way give a call graph. Its
+ *   edges are merged heaviest first, each merge putting the callee's
+ *   group after the caller's; groups are then emitted from the heaviest
+ *   down, with functions the profile never entered and cold functions
+ *   (such as those -split outlines) last.
+ *
+ *   LayoutTakenBefore/After estimate the taken branches executed in the
+ *   old and the new order and LayoutTakenAvoided the difference: profile
+ *   counts when there is a profile, per call of each function otherwise.
+ */
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "edgeprofile.h"
+#include "layout.h"
+
+using namespace llvm;
+
+static llvm::Statistic LayoutFunctions = {"", "LayoutFunctions", "Layout functions whose blocks were reordered"};
+static llvm::Statistic LayoutColdBlocks = {"", "LayoutColdBlocks", "Layout cold blocks moved to the end"};
+static llvm::Statistic LayoutTakenBefore = {"", "LayoutTakenBefore", "Layout estimated taken branches in the old order"};
+static llvm::Statistic LayoutTakenAfter = {"", "LayoutTakenAfter", "Layout estimated taken branches in the new order"};
+static llvm::Statistic LayoutTakenAvoided = {"", "LayoutTakenAvoided", "Layout estimated taken branches avoided"};
+
+// a static estimate below this fraction of the entry is cold
+static const double ColdFraction = 0.01;
+
+struct BlockWeights {
+    DominatorTree DT;
+    LoopInfo LI;
+    BranchProbabilityInfo BPI;
+    BlockFrequencyInfo BFI;
+    bool profiled;
+    double entryFreq;
+
+    explicit BlockWeights(Function &F)
+        : DT(F), LI(DT), BPI(F, LI), BFI(F, BPI, LI)
+    {
+        uint64_t count;
+        profiled = GetBlockCount(&F.getEntryBlock(), count);
+        entryFreq = BFI.getEntryFreq();
+    }
+
+    double block(BasicBlock *BB)
+    {
+        uint64_t count;
+        if (profiled && GetBlockCount(BB, count))
+            return count;
+        return BFI.getBlockFreq(BB).getFrequency() / entryFreq;
+    }
+
+    double edge(BasicBlock *Src, BasicBlock *Dst)
+    {
+        BranchProbability P = BPI.getEdgeProbability(Src, Dst);
+        return block(Src) * P.getNumerator() / P.getDenominator();
+    }
+
+    bool cold(BasicBlock *BB)
+    {
+        return profiled ? block(BB) == 0 : block(BB) < ColdFraction;
+    }
+};
+
+//***********************Function takenBranches****************************//
+// weight of the edges that do not fall through to the next block in F's
+// current order
+//*************************************************************************//
+
+static double takenBranches(Function &F, BlockWeights &W)
+{
+    double taken = 0;
+    for (auto bb = F.begin(); bb != F.end(); bb++) {
+        BasicBlock *Next = std::next(bb) != F.end() ? &*std::next(bb) : nullptr;
+        SmallPtrSet<BasicBlock *, 4> seen;
+        for (BasicBlock *S : successors(&*bb))
+            if (seen.insert(S).second && S != Next)
+                taken += W.edge(&*bb, S);
+    }
+    return taken;
+}
+
+struct WeightedEdge {
+    double weight;
+    BasicBlock *src, *dst;
+};
+
+static void layoutBlocks(Function &F, double &takenBefore, double &takenAfter)
+{
+    BlockWeights W(F);
+    double before = takenBranches(F, W);
+    takenBefore += before;
+
+    std::vector<std::vector<BasicBlock *>> chains;
+    DenseMap<BasicBlock *, unsigned> chainOf;
+    std::vector<WeightedEdge> edges;
+    for (BasicBlock &BB : F) {
+        chainOf[&BB] = chains.size();
+        chains.push_back({&BB});
+        SmallPtrSet<BasicBlock *, 4> seen;
+        for (BasicBlock *S : successors(&BB))
+            if (seen.insert(S).second && S != &BB)
+                edges.push_back({W.edge(&BB, S), &BB, S});
+    }
+    std::stable_sort(edges.begin(), edges.end(),
+                     [](const WeightedEdge &a, const WeightedEdge &b) { return a.weight > b.weight; });
+
+    BasicBlock *Entry = &F.getEntryBlock();
+    for (WeightedEdge &E : edges) {
+        unsigned a = chainOf[E.src], b = chainOf[E.dst];
+        if (a == b || E.dst == Entry || chains[a].back() != E.src || chains[b].front() != E.dst)
+            continue;
+        // a cold block never becomes the fall-through of a hot one
+        if (W.cold(E.dst) && !W.cold(E.src))
+            continue;
+        for (BasicBlock *BB : chains[b]) {
+            chains[a].push_back(BB);
+            chainOf[BB] = a;
+        }
+        chains[b].clear();
+    }
+
+    // entry first, then hot chains by their hottest block, then cold ones
+    std::vector<std::pair<double, unsigned>> hot;
+    std::vector<unsigned> cold;
+    for (unsigned c = 0; c < chains.size(); c++) {
+        if (chains[c].empty() || c == chainOf[Entry])
+            continue;
+        double heat = 0;
+        for (BasicBlock *BB : chains[c])
+            heat = std::max(heat, W.block(BB));
+        bool isCold = true;
+        for (BasicBlock *BB : chains[c])
+            isCold = isCold && W.cold(BB);
+        if (isCold)
+            cold.push_back(c);
+        else
+            hot.push_back(std::make_pair(heat, c));
+    }
+    std::stable_sort(hot.begin(), hot.end(),
+                     [](const std::pair<double, unsigned> &a,
+                        const std::pair<double, unsigned> &b) { return a.first > b.first; });
+
+    std::vector<BasicBlock *> order(chains[chainOf[Entry]]);
+    for (auto &h : hot)
+        order.insert(order.end(), chains[h.second].begin(), chains[h.second].end());
+    for (unsigned c : cold) {
+        order.insert(order.end(), chains[c].begin(), chains[c].end());
+        LayoutColdBlocks += chains[c].size();
+    }
+
+    bool changed = false;
+    auto bb = F.begin();
+    for (BasicBlock *BB : order) {
+        changed = changed || BB != &*bb;
+        bb++;
+    }
+    if (!changed) {
+        takenAfter += before;
+        return;
+    }
+
+    for (unsigned b = 1; b < order.size(); b++)
+        order[b]->moveAfter(order[b - 1]);
+    LayoutFunctions++;
+    takenAfter += takenBranches(F, W);
+}
+
+//***********************Function layoutFunctions**************************//
+// Pettis-Hansen function ordering over the weighted call graph
+//*************************************************************************//
+
+static void layoutFunctions(Module *M)
+{
+    DenseMap<Function *, unsigned> groupOf;
+    std::vector<std::vector<Function *>> groups;
+    std::map<std::pair<Function *, Function *>, double> calls;
+    DenseMap<Function *, double> heat;
+    bool profiled = false;
+
+    for (auto f = M->begin(); f != M->end(); f++) {
+        if (f->isDeclaration())
+            continue;
+        groupOf[&*f] = groups.size();
+        groups.push_back({&*f});
+
+        BlockWeights W(*f);
+        profiled = profiled || W.profiled;
+        for (BasicBlock &BB : *f)
+            for (Instruction &I : BB)
+                if (auto *CB = dyn_cast<CallBase>(&I)) {
+                    Function *Callee = CB->getCalledFunction();
+                    if (Callee && !Callee->isDeclaration() && Callee != &*f &&
+                        !Callee->hasFnAttribute(Attribute::Cold))
+                        calls[std::make_pair(&*f, Callee)] += W.block(&BB);
+                }
+    }
+
+    std::vector<std::pair<double, std::pair<Function *, Function *>>> edges;
+    for (auto &c : calls) {
+        edges.push_back(std::make_pair(c.second, c.first));
+        heat[c.first.first] += c.second;
+        heat[c.first.second] += c.second;
+    }
+    std::stable_sort(edges.begin(), edges.end(),
+                     [](const std::pair<double, std::pair<Function *, Function *>> &a,
+                        const std::pair<double, std::pair<Function *, Function *>> &b) {
+                         return a.first > b.first;
+                     });
+
+    for (auto &e : edges) {
+        unsigned a = groupOf[e.second.first], b = groupOf[e.second.second];
+        if (a == b || e.first <= 0)
+            continue;
+        for (Function *F : groups[b]) {
+            groups[a].push_back(F);
+            groupOf[F] = a;
+        }
+        groups[b].clear();
+    }
+
+    std::vector<std::pair<double, unsigned>> byHeat;
+    std::vector<unsigned> never;
+    for (unsigned g = 0; g < groups.size(); g++) {
+        if (groups[g].empty())
+            continue;
+        double h = 0;
+        bool entered = false, allCold = true;
+        for (Function *F : groups[g]) {
+            h += heat.lookup(F);
+            auto count = F->getEntryCount();
+            entered = entered || !count || count->getCount() > 0;
+            allCold = allCold && F->hasFnAttribute(Attribute::Cold);
+        }
+        if ((profiled && !entered) || allCold)
+            never.push_back(g);
+        else
+            byHeat.push_back(std::make_pair(h, g));
+    }
+    std::stable_sort(byHeat.begin(), byHeat.end(),
+                     [](const std::pair<double, unsigned> &a,
+                        const std::pair<double, unsigned> &b) { return a.first > b.first; });
+    for (unsigned g : never)
+        byHeat.push_back(std::make_pair(0.0, g));
+
+    for (auto &g : byHeat)
+        for (Function *F : groups[g.second]) {
+            F->removeFromParent();
+            M->getFunctionList().push_back(F);
+        }
+}
+
+void ProfileLayout(Module *M)
+{
+    // summed as doubles so the per-call estimates are not truncated
+    double before = 0, after = 0;
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration())
+            layoutBlocks(*f, before, after);
+    LayoutTakenBefore += before + 0.5;
+    LayoutTakenAfter += after + 0.5;
+    if (before > after)
+        LayoutTakenAvoided += before - after + 0.5;
+    layoutFunctions(M);
+}
@@ -0,0 +1,11 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "llvm/IR/Module.h"
+
+/* Chain each function's blocks along their hottest edges with the cold
+   blocks last, and order the functions so hot callers and callees sit
+   together. */
+void ProfileLayout(llvm::Module *M);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * File: memtrace.cpp
+ *
+ * Description:
+ *   Memory-access tracing. Each load, store, atomicrmw and cmpxchg gets
+ *   an ID (from 1) and a call to prof_mem_access(ID, address) in front of
+ *   it; runtime/memtrace_rt.c samples and compresses the addresses into
+ *   llvmmem.trace. Everything that does not change from one execution of
+ *   an access to the next stays out of the trace and goes into a map
+ *   file written here, one tab-separated line per ID:
+ *     id  R|W  size  function  block  loop  depth  instruction
+ *   where loop is the header of the innermost loop around the access
+ *   ("-" outside loops) and instruction is the access as printed before
+ *   instrumentation. The instrumented access also carries !memtrace !{ID}
+ *   so the output IR can be matched against cachesim's report.
+ *
+ *   Accesses to allocas are left out unless -memtrace-stack is given:
+ *   the stack is small and hot, and at -O0 it would take most of the
+ *   trace. Accesses outside address space 0 are left out too.
+ */
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "memtrace.h"
+
+using namespace llvm;
+
+static cl::opt<bool>
+        MemTraceStack("memtrace-stack",
+                      cl::desc("Trace accesses to allocas too."),
+                      cl::init(false));
+
+static llvm::Statistic MemTraceLoads = {"", "MemTraceLoads", "MemTrace loads instrumented"};
+static llvm::Statistic MemTraceStores = {"", "MemTraceStores", "MemTrace stores and atomics instrumented"};
+static llvm::Statistic MemTraceSkipped = {"", "MemTraceSkipped", "MemTrace stack accesses left out"};
+
+static Value *accessPointer(Instruction &I)
+{
+    if (auto *L = dyn_cast<LoadInst>(&I))
+        return L->getPointerOperand();
+    if (auto *S = dyn_cast<StoreInst>(&I))
+        return S->getPointerOperand();
+    if (auto *A = dyn_cast<AtomicRMWInst>(&I))
+        return A->getPointerOperand();
+    if (auto *X = dyn_cast<AtomicCmpXchgInst>(&I))
+        return X->getPointerOperand();
+    return nullptr;
+}
+
+static Type *accessType(Instruction &I)
+{
+    if (auto *S = dyn_cast<StoreInst>(&I))
+        return S->getValueOperand()->getType();
+    if (auto *X = dyn_cast<AtomicCmpXchgInst>(&I))
+        return X->getCompareOperand()->getType();
+    return I.getType();
+}
+
+static std::string blockLabel(BasicBlock *BB, unsigned index)
+{
+    return BB->hasName() ? BB->getName().str() : "bb" + std::to_string(index);
+}
+
+bool InsertMemTrace(Module *M, StringRef mapPath)
+{
+    std::error_code EC;
+    raw_fd_ostream Map(mapPath, EC);
+    if (EC)
+        return false;
+
+    LLVMContext &C = M->getContext();
+    const DataLayout &DL = M->getDataLayout();
+    Type *I32 = Type::getInt32Ty(C);
+    Type *I8Ptr = Type::getInt8PtrTy(C);
+    FunctionCallee Access = M->getOrInsertFunction("prof_mem_access", Type::getVoidTy(C), I32, I8Ptr);
+    unsigned kind = C.getMDKindID("memtrace");
+    unsigned id = 0;
+
+    for (auto f = M->begin(); f != M->end(); f++) {
+        if (f->isDeclaration())
+            continue;
+        DominatorTree DT(*f);
+        LoopInfo LI(DT);
+
+        std::vector<std::string> labels;
+        DenseMap<BasicBlock *, unsigned> index;
+        for (BasicBlock &BB : *f) {
+            index[&BB] = labels.size();
+            labels.push_back(blockLabel(&BB, labels.size()));
+        }
+
+        std::vector<Instruction *> accesses;
+        for (BasicBlock &BB : *f)
+            for (Instruction &I : BB) {
+                Value *P = accessPointer(I);
+                if (!P || P->getType()->getPointerAddressSpace() != 0)
+                    continue;
+                if (!MemTraceStack && isa<AllocaInst>(getUnderlyingObject(P))) {
+                    MemTraceSkipped++;
+                    continue;
+                }
+                accesses.push_back(&I);
+            }
+
+        for (Instruction *I : accesses) {
+            BasicBlock *BB = I->getParent();
+            Loop *L = LI.getLoopFor(BB);
+            bool isLoad = isa<LoadInst>(I);
+            std::string text;
+            raw_string_ostream OS(text);
+            I->print(OS);
+            OS.flush();
+            text.erase(0, text.find_first_not_of(' '));
+
+            id++;
+            Map << id << '\t' << (isLoad ? 'R' : 'W') << '\t' << DL.getTypeStoreSize(accessType(*I)) << '\t'
+                << f->getName() << '\t' << labels[index[BB]] << '\t'
+                << (L ? labels[index[L->getHeader()]] : "-") << '\t' << LI.getLoopDepth(BB) << '\t'
+                << text << '\n';
+
+            IRBuilder<> B(I);
+            B.CreateCall(Access, {B.getInt32(id), B.CreatePointerCast(accessPointer(*I), I8Ptr)});
+            I->setMetadata(kind, MDNode::get(C, ConstantAsMetadata::get(B.getInt32(id))));
+            if (isLoad)
+                MemTraceLoads++;
+            else
+                MemTraceStores++;
+        }
+    }
+
+    Function *Dump = Function::Create(FunctionType::get(Type::getVoidTy(C), false),
+                                      GlobalValue::InternalLinkage, "prof.mem.dump", M);
+    IRBuilder<> B(BasicBlock::Create(C, "entry", Dump));
+    B.CreateCall(M->getOrInsertFunction("prof_mem_dump", Type::getVoidTy(C)));
+    B.CreateRetVoid();
+    appendToGlobalDtors(*M, Dump, 0);
+    return true;
+}
@@ -0,0 +1,13 @@
+#ifndef MEMTRACE_H
+#define MEMTRACE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+
+/* Pass the address of every load and store to runtime/memtrace_rt.c,
+   which writes a sampled, delta-compressed trace for cachesim. The map
+   from instruction IDs to function, block, loop, access size and IR is
+   written to mapPath. Returns false if the map cannot be written. */
+bool InsertMemTrace(llvm::Module *M, llvm::StringRef mapPath);
+
+#endif
@@ -0,0 +1,210 @@
+#include <fstream>
+#include <memory>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "llvm-c/Core.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/LinkAllPasses.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/SourceMgr.h"
+
+#include "edgeprofile.h"
+#include "gcm.h"
+#include "instmix.h"
+#include "layout.h"
+#include "memtrace.h"
+#include "split.h"
+#include "trace.h"
+
+using namespace llvm;
+
+static void print_csv_file(std::string outputfile);
+
+static cl::opt<std::string>
+        InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required, cl::init("-"));
+
+static cl::opt<std::string>
+        OutputFilename("o", cl::desc("<output bitcode>"), cl::Required, cl::init("out.bc"));
+
+static cl::opt<bool>
+        DoProfile("do-profile",
+                  cl::desc("Insert edge counters (link with libprofrt)."),
+                  cl::init(false));
+
+static cl::opt<bool>
+        UseProfile("use-profile",
+                   cl::desc("Attach the counts in the profile file as branch weights and block counts."),
+                   cl::init(false));
+
+static cl::opt<std::string>
+        ProfileFile("profile-file",
+                    cl::desc("Profile written by a -do-profile run."),
+                    cl::init("llvmprof.out"));
+
+static cl::opt<bool>
+        GCM("gcm",
+            cl::desc("Perform global code motion, guided by the profile when one is loaded."),
+            cl::init(false));
+
+static cl::opt<bool>
+        Split("split",
+              cl::desc("Outline cold regions into separate cold functions."),
+              cl::init(false));
+
+static cl::opt<bool>
+        Layout("layout",
+               cl::desc("Chain blocks along their hottest edges, move cold blocks last and order functions by call weight."),
+               cl::init(false));
+
+static cl::opt<bool>
+        InstMix("inst-mix",
+                cl::desc("Count block executions and report the dynamic instruction mix at exit (link with libprofrt)."),
+                cl::init(false));
+
+static cl::opt<bool>
+        Trace("trace",
+              cl::desc("Add entry and exit probes to functions (see -trace-all, -trace-min-size); the run writes a Chrome trace and a flat profile (link with libprofrt)."),
+              cl::init(false));
+
+static cl::opt<bool>
+        MemTrace("memtrace",
+                 cl::desc("Trace the addresses of loads and stores for cachesim; the map of access IDs goes to -memtrace-map (link with libprofrt)."),
+                 cl::init(false));
+
+static cl::opt<std::string>
+        MemTraceMap("memtrace-map",
+                    cl::desc("Access map written by -memtrace (default <output>.memmap)."),
+                    cl::init(""));
+
+static cl::opt<bool>
+        Summary("summary",
+                cl::desc("Print the hottest functions, the counter overhead and the statistics."),
+                cl::init(false));
+
+static cl::opt<bool>
+        Verbose("verbose",
+                cl::desc("Verbose stats."),
+                cl::init(false));
+
+static cl::opt<bool>
+        NoCheck("no",
+                cl::desc("Do not check for valid IR."),
+                cl::init(false));
+
+int main(int argc, char **argv) {
+    // Parse command line arguments
+    cl::ParseCommandLineOptions(argc, argv, "llvm edge profiler\n");
+
+    // Handle creating output files and shutting down properly
+    llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
+    LLVMContext Context;
+
+    // LLVM idiom for constructing output file.
+    std::unique_ptr<ToolOutputFile> Out;
+    std::error_code EC;
+    Out.reset(new ToolOutputFile(OutputFilename.c_str(), EC,
+                                 sys::fs::OF_None));
+
+    EnableStatistics();
+
+    // Read in module
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M;
+    M = parseIRFile(InputFilename, Err, Context);
+
+    // If errors, fail
+    if (M.get() == 0)
+    {
+        Err.print(argv[0], errs());
+        return 1;
+    }
+
+    if (DoProfile && UseProfile) {
+        errs() << argv[0] << ": -do-profile and -use-profile cannot be combined\n";
+        return 1;
+    }
+
+    if (UseProfile && !LoadEdgeProfile(M.get(), ProfileFile)) {
+        errs() << argv[0] << ": cannot read profile " << ProfileFile
+               << ", continuing without it\n";
+    }
+
+    if (GCM) {
+        GlobalCodeMotion(M.get());
+    }
+
+    if (Split) {
+        HotColdSplit(M.get());
+    }
+
+    if (Layout) {
+        ProfileLayout(M.get());
+    }
+
+    if (InstMix) {
+        InsertInstMix(M.get());
+    }
+
+    if (Trace) {
+        InsertTracing(M.get());
+    }
+
+    if (MemTrace) {
+        std::string map = MemTraceMap.empty() ? OutputFilename + ".memmap" : MemTraceMap.getValue();
+        if (!InsertMemTrace(M.get(), map)) {
+            errs() << argv[0] << ": cannot write " << map << "\n";
+            return 1;
+        }
+    }
+
+    if (DoProfile) {
+        InsertEdgeProfiling(M.get());
+    }
+
+    print_csv_file(OutputFilename);
+
+    if (Summary && UseProfile)
+        PrintProfileSummary(M.get(), errs());
+
+    if (Verbose || Summary)
+        PrintStatistics(errs());
+
+    // Verify integrity of Module, do this by default
+    if (!NoCheck)
+    {
+        legacy::PassManager Passes;
+        Passes.add(createVerifierPass());
+        Passes.run(*M.get());
+    }
+
+    // Write final bitcode
+    WriteBitcodeToFile(*M.get(), Out->os());
+    Out->keep();
+
+    return 0;
+}
+
+static void print_csv_file(std::string outputfile)
+{
+    std::ofstream stats(outputfile + ".stats");
+    auto a = GetStatistics();
+
+    for (auto p : a) {
+        stats << p.first.str() << "," << p.second << std::endl;
+    }
+    stats.close();
+}
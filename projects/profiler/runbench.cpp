@@ -0,0 +1,405 @@
+/*
+ * File: runbench.cpp
+ *
+ * Description:
+ *   Benchmark runner for wolfbench, used by RunSafely.sh in place of
+ *   time -p and TimedExec.sh when it is installed.
+ *
+ *     runbench [-v kb] [-f kb] [-w warmup] [-r runs] [-ci percent]
+ *              <timeout> <infile> <outfile> <program> <args...>
+ *
+ *   A wrapper such as valgrind goes in front of <program> as words of
+ *   its own, so "valgrind --tool=massif prog" runs as expected.
+ *
+ *   The program is forked and exec'd with stdin from <infile> and stdout
+ *   and stderr to <outfile>, under the limits RunSafely.sh used to set
+ *   with ulimit: <timeout> seconds of CPU, -v KB of address space
+ *   (default 400000, 0 for none), -f KB of file size (default 10485760)
+ *   and unlimited core files. The wall clock is bounded by <timeout> too:
+ *   a timer sends SIGTERM to the program's process group when it runs
+ *   out, and SIGKILL 2 seconds later, so nothing polls.
+ *
+ *   The time is CLOCK_MONOTONIC around the run, and the rest comes from
+ *   the rusage that wait4 returns. <outfile>.time gets one "key value"
+ *   line each:
+ *     exit      exit status, 128+signal if killed (as the shell reports it)
+ *     signal    the signal, if killed
+ *     timeout   1 if the timer fired
+ *     real      wall-clock seconds
+ *     user sys  CPU seconds
+ *     maxrss    peak resident set, KB
+ *     minflt majflt   page faults without and with I/O
+ *     nvcsw nivcsw    voluntary and involuntary context switches
+ *     program   user CPU seconds, the line timing.py reads, as before
+ *
+ *   Repeated runs: -w runs are made and discarded first, then -r measured
+ *   runs, or with -ci, runs until the 95% confidence interval of the
+ *   median user time is within that percent of the median (at most -r).
+ *   The lines above describe the last run; these are added
+ *     runs      measured runs
+ *     median mad min   of the user times (mad: median absolute deviation)
+ *     ci95_lo ci95_hi  95% confidence interval of the median
+ *   and program is the median. A run that fails (nonzero exit, signal or
+ *   timeout) stops the repetition and is reported alone.
+ *
+ *   Hardware counters: each run is counted with perf_event_open in two
+ *   groups, so the counters of a group run at the same time: cycles,
+ *   instructions, branches and branch-misses; l1d-misses, llc-misses and
+ *   dtlb-misses (read misses). They count user mode only, follow the
+ *   program's threads and children, and start at its exec. Each count is
+ *   scaled by time enabled / time running for multiplexing and written
+ *   under its name, for the last run. A counter the kernel or the CPU
+ *   does not allow (perf_event_paranoid, no PMU in a VM) is left out.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct Counter {
+    const char *name;
+    unsigned type;
+    unsigned long long config;
+    unsigned group;
+    int fd;
+    double value;
+};
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static Counter Counters[] = {
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0, -1, -1},
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0, -1, -1},
+        {"branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, 0, -1, -1},
+        {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 0, -1, -1},
+        {"l1d-misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D), 1, -1, -1},
+        {"llc-misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL), 1, -1, -1},
+        {"dtlb-misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB), 1, -1, -1},
+};
+
+static const unsigned NumCounters = sizeof(Counters) / sizeof(Counters[0]);
+
+static volatile sig_atomic_t TimedOut;
+static volatile pid_t Child;
+
+static void onAlarm(int)
+{
+    // first alarm: ask politely; the second, 2 seconds later, does not
+    if (!TimedOut) {
+        TimedOut = 1;
+        kill(-Child, SIGTERM);
+        alarm(2);
+    } else {
+        kill(-Child, SIGKILL);
+    }
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: runbench [-v kb] [-f kb] [-w warmup] [-r runs] [-ci percent]\n"
+                    "                <timeout> <infile> <outfile> <program> <args...>\n");
+    exit(2);
+}
+
+static void setLimit(int resource, rlim_t value)
+{
+    struct rlimit r;
+    r.rlim_cur = r.rlim_max = value;
+    setrlimit(resource, &r);
+}
+
+static double seconds(const struct timeval &t)
+{
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+//***********************Function runChild*********************************//
+// set up the limits and I/O of the child and exec the program
+//*************************************************************************//
+
+static void runChild(std::vector<char *> &argv, const char *infile, const char *outfile,
+                     unsigned timeout, rlim_t memKB, rlim_t fileKB, int go)
+{
+    setpgid(0, 0);
+    setLimit(RLIMIT_CPU, timeout);
+    setLimit(RLIMIT_CORE, RLIM_INFINITY);
+    setLimit(RLIMIT_FSIZE, fileKB * 1024);
+    if (memKB)
+        setLimit(RLIMIT_AS, memKB * 1024);
+
+    int in = open(infile, O_RDONLY);
+    int out = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (in < 0 || out < 0) {
+        perror(in < 0 ? infile : outfile);
+        _exit(126);
+    }
+    dup2(in, 0);
+    dup2(out, 1);
+    dup2(out, 2);
+    close(in);
+    close(out);
+
+    // wait until the parent has opened the counters (it closes the pipe)
+    char c;
+    while (read(go, &c, 1) < 0 && errno == EINTR)
+        ;
+    close(go);
+
+    execvp(argv[0], argv.data());
+    int err = errno;
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+    _exit(err == ENOENT ? 127 : 126);
+}
+
+//***********************Function openCounters*****************************//
+// Open the counters on pid, disabled until its exec. The first counter of
+// a group that opens leads it; the ones that fail are left out.
+//*************************************************************************//
+
+static void openCounters(pid_t pid)
+{
+    int leader[2] = {-1, -1};
+
+    for (unsigned c = 0; c < NumCounters; c++) {
+        Counter &C = Counters[c];
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = C.type;
+        attr.config = C.config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        if (leader[C.group] < 0) {
+            attr.disabled = 1;
+            attr.enable_on_exec = 1;
+        }
+        C.fd = syscall(__NR_perf_event_open, &attr, pid, -1, leader[C.group], PERF_FLAG_FD_CLOEXEC);
+        if (C.fd >= 0 && leader[C.group] < 0)
+            leader[C.group] = C.fd;
+    }
+}
+
+static void readCounters()
+{
+    for (unsigned c = 0; c < NumCounters; c++) {
+        Counter &C = Counters[c];
+        unsigned long long v[3];  // value, time enabled, time running
+        C.value = -1;
+        if (C.fd < 0)
+            continue;
+        if (read(C.fd, v, sizeof v) == sizeof v && v[2] > 0)
+            C.value = v[2] < v[1] ? (double)v[0] * v[1] / v[2] : v[0];
+        close(C.fd);
+        C.fd = -1;
+    }
+}
+
+struct Run {
+    int status = 0;
+    bool timedOut = false;
+    double real = 0;
+    struct rusage usage;
+
+    bool failed() const { return !WIFEXITED(status) || WEXITSTATUS(status) != 0 || timedOut; }
+};
+
+static bool runOnce(std::vector<char *> &command, const char *infile, const char *outfile,
+                    unsigned timeout, rlim_t memKB, rlim_t fileKB, Run &run)
+{
+    struct timespec start, end;
+    int go[2];
+    TimedOut = 0;
+    if (pipe2(go, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(go[1]);
+        runChild(command, infile, outfile, timeout, memKB, fileKB, go[0]);
+    }
+    close(go[0]);
+    // also from the parent, so the group exists before the timer can fire
+    setpgid(pid, pid);
+    Child = pid;
+    openCounters(pid);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (timeout)
+        alarm(timeout);
+    close(go[1]);
+
+    while (wait4(pid, &run.status, 0, &run.usage) < 0) {
+        if (errno != EINTR) {
+            perror("wait4");
+            return false;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    alarm(0);
+    readCounters();
+    run.timedOut = TimedOut;
+    run.real = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return true;
+}
+
+// sorted must be sorted
+static double median(const std::vector<double> &sorted)
+{
+    size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+//***********************Function medianCI*********************************//
+// Distribution-free 95% confidence interval for the median: the order
+// statistics x(j) and x(n+1-j) for the largest j with
+// P(Binomial(n, 1/2) < j) <= 2.5%. Timings are skewed, so no normality
+// is assumed. Under 6 runs no j qualifies and the interval is min..max,
+// which then covers less than 95%.
+//*************************************************************************//
+
+static void medianCI(const std::vector<double> &sorted, double &lo, double &hi)
+{
+    size_t n = sorted.size(), j = 0;
+    double term = std::pow(0.5, (double)n), cdf = term;  // P(X <= 0)
+    while (j + 1 < n / 2 + 1 && cdf <= 0.025) {
+        j++;
+        term = term * (n - j + 1) / j;
+        cdf += term;
+    }
+    // x(j) with j 1-based is sorted[j - 1]; j = 0 means min..max
+    lo = sorted[j ? j - 1 : 0];
+    hi = sorted[j ? n - j : n - 1];
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<char *> command;
+    rlim_t memKB = 400000, fileKB = 10485760;
+    unsigned warmup = 0, runs = 1;
+    double ciTarget = 0;
+    int a = 1;
+
+    for (; a < argc && argv[a][0] == '-' && a + 1 < argc; a += 2) {
+        if (!strcmp(argv[a], "-v")) {
+            memKB = strtoull(argv[a + 1], nullptr, 10);
+        } else if (!strcmp(argv[a], "-f")) {
+            fileKB = strtoull(argv[a + 1], nullptr, 10);
+        } else if (!strcmp(argv[a], "-w")) {
+            warmup = strtoul(argv[a + 1], nullptr, 10);
+        } else if (!strcmp(argv[a], "-r")) {
+            runs = std::max(1ul, strtoul(argv[a + 1], nullptr, 10));
+        } else if (!strcmp(argv[a], "-ci")) {
+            ciTarget = strtod(argv[a + 1], nullptr);
+        } else {
+            usage();
+        }
+    }
+    if (argc - a < 4)
+        usage();
+    unsigned timeout = strtoul(argv[a], nullptr, 10);
+    const char *infile = argv[a + 1];
+    const char *outfile = argv[a + 2];
+    for (int i = a + 3; i < argc; i++)
+        command.push_back(argv[i]);
+    command.push_back(nullptr);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = onAlarm;
+    sigaction(SIGALRM, &sa, nullptr);
+
+    // Warmup runs are discarded. With -ci, runs go on until the 95% CI of
+    // the median is within that percent of it either way, from 6 runs (the
+    // fewest that give a 95% interval) to -r. A failing run ends it all
+    // and is what gets reported.
+    Run run;
+    std::vector<double> times;
+    double lo = 0, hi = 0, med = 0;
+    for (unsigned i = 0; i < warmup + runs; i++) {
+        if (!runOnce(command, infile, outfile, timeout, memKB, fileKB, run))
+            return 1;
+        if (run.failed()) {
+            times.clear();
+            break;
+        }
+        if (i < warmup)
+            continue;
+        times.push_back(seconds(run.usage.ru_utime));
+        if (ciTarget > 0 && times.size() >= 6) {
+            std::vector<double> sorted(times);
+            std::sort(sorted.begin(), sorted.end());
+            med = median(sorted);
+            medianCI(sorted, lo, hi);
+            if (hi - med <= med * ciTarget / 100 && med - lo <= med * ciTarget / 100)
+                break;
+        }
+    }
+
+    std::string timefile = std::string(outfile) + ".time";
+    FILE *f = fopen(timefile.c_str(), "w");
+    if (!f) {
+        perror(timefile.c_str());
+        return 1;
+    }
+    if (WIFSIGNALED(run.status)) {
+        fprintf(f, "exit %d\n", 128 + WTERMSIG(run.status));
+        fprintf(f, "signal %d\n", WTERMSIG(run.status));
+    } else {
+        fprintf(f, "exit %d\n", WEXITSTATUS(run.status));
+    }
+    if (run.timedOut)
+        fprintf(f, "timeout 1\n");
+    fprintf(f, "real %.6f\n", run.real);
+    fprintf(f, "user %.6f\n", seconds(run.usage.ru_utime));
+    fprintf(f, "sys %.6f\n", seconds(run.usage.ru_stime));
+    fprintf(f, "maxrss %ld\n", run.usage.ru_maxrss);
+    fprintf(f, "minflt %ld\n", run.usage.ru_minflt);
+    fprintf(f, "majflt %ld\n", run.usage.ru_majflt);
+    fprintf(f, "nvcsw %ld\n", run.usage.ru_nvcsw);
+    fprintf(f, "nivcsw %ld\n", run.usage.ru_nivcsw);
+    for (unsigned c = 0; c < NumCounters; c++)
+        if (Counters[c].value >= 0)
+            fprintf(f, "%s %.0f\n", Counters[c].name, Counters[c].value);
+
+    double program = seconds(run.usage.ru_utime);
+    if (times.size() > 1) {
+        std::vector<double> sorted(times), deviations;
+        std::sort(sorted.begin(), sorted.end());
+        med = median(sorted);
+        medianCI(sorted, lo, hi);
+        for (double t : sorted)
+            deviations.push_back(std::fabs(t - med));
+        std::sort(deviations.begin(), deviations.end());
+        fprintf(f, "runs %zu\n", sorted.size());
+        fprintf(f, "median %.6f\n", med);
+        fprintf(f, "mad %.6f\n", median(deviations));
+        fprintf(f, "min %.6f\n", sorted[0]);
+        fprintf(f, "ci95_lo %.6f\n", lo);
+        fprintf(f, "ci95_hi %.6f\n", hi);
+        program = med;
+    }
+    fprintf(f, "program %.6f\n", program);
+    fclose(f);
+    return 0;
+}
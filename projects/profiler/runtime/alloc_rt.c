@@ -0,0 +1,562 @@
+/*
+ * File: alloc_rt.c
+ *
+ * Description:
+ *   Allocation profiler, built as liballocprof.so and loaded with
+ *     LD_PRELOAD=liballocprof.so ./program
+ *   No instrumentation or relinking is needed. It replaces malloc, free,
+ *   calloc, realloc, reallocarray, the aligned allocators and
+ *   malloc_usable_size (the set glibc allows to be replaced) and forwards
+ *   them to glibc's __libc_* entry points.
+ *
+ *   Each block gets a 32-byte header in front of it holding the size,
+ *   the allocation clock when it was made and its call site, so free
+ *   needs no lookup. The allocation clock counts allocations, so the
+ *   lifetime of a block is the number of allocations made while it was
+ *   live. Blocks of different threads are not told apart.
+ *
+ *   Each thread keeps its own histograms and call-site table, pushed onto
+ *   a global list with a compare-and-swap the first time it allocates.
+ *   Only the clock and the live and peak byte counts are shared, and
+ *   they are updated with atomics, so there are no locks. A call site is
+ *   the return address of the allocation call. A free in another thread
+ *   updates the site's counters atomically. Once the site table of a
+ *   thread is full (ALLOC_SITES), further sites count as "other".
+ *
+ *   The report goes to llvmalloc.out (or $LLVMALLOC_OUT) from a
+ *   destructor. It has the totals, peak live bytes, size and lifetime
+ *   histograms, the most common exact sizes and the top call sites
+ *   ($LLVMALLOC_TOP, default 20). Sites are printed as module+offset, so
+ *   addr2line -e module offset names the line, plus the symbol when
+ *   dladdr knows it. Allocations made while the report is written are
+ *   not counted. Only the program started with the library is profiled:
+ *   it takes itself out of LD_PRELOAD for the programs that one runs, and
+ *   a forked child does not report.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void __libc_free(void *);
+
+#define ALLOC_MAGIC 0xa110cu
+#define ALLOC_BUCKETS 64
+#define ALLOC_EXACT 1025        /* sizes 0..1024 are also counted exactly */
+#define ALLOC_SITES 4096        /* per thread, a power of two */
+
+typedef struct AllocSite {
+  uintptr_t address;            /* 0: unused, or the "other" entry */
+  unsigned long long count, bytes;
+  unsigned long long frees, lifetime;  /* updated by any thread */
+} AllocSite;
+
+typedef struct AllocHeader {
+  size_t size;
+  unsigned long long clock;
+  AllocSite *site;              /* NULL: not counted */
+  unsigned offset;              /* from the glibc block to the user block */
+  unsigned magic;
+} AllocHeader;
+
+typedef struct AllocThread {
+  struct AllocThread *next;
+  unsigned long long mallocs, callocs, reallocs, aligned, frees, bytes;
+  unsigned long long sizes[ALLOC_BUCKETS], sizeBytes[ALLOC_BUCKETS];
+  unsigned long long lifetimes[ALLOC_BUCKETS];
+  unsigned long long exact[ALLOC_EXACT];
+  unsigned nsites;
+  AllocSite other;
+  AllocSite sites[ALLOC_SITES];
+} AllocThread;
+
+static AllocThread *alloc_threads;
+static __thread AllocThread *alloc_self __attribute__((tls_model("initial-exec")));
+static __thread int alloc_busy __attribute__((tls_model("initial-exec")));
+static unsigned long long alloc_clock, alloc_live, alloc_live_blocks;
+static unsigned long long alloc_peak, alloc_peak_blocks, alloc_peak_clock;
+static int alloc_done;
+
+static unsigned alloc_bucket(unsigned long long v)
+{
+  return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+static AllocThread *alloc_thread(void)
+{
+  AllocThread *t = __libc_calloc(1, sizeof *t);
+
+  if (!t)
+    return NULL;
+  t->next = __atomic_load_n(&alloc_threads, __ATOMIC_ACQUIRE);
+  while (!__atomic_compare_exchange_n(&alloc_threads, &t->next, t, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+    ;
+  return t;
+}
+
+static AllocSite *alloc_site(AllocThread *t, uintptr_t address)
+{
+  unsigned h = (unsigned)((address * 0x9e3779b97f4a7c15ull) >> 52) & (ALLOC_SITES - 1);
+
+  for (;; h = (h + 1) & (ALLOC_SITES - 1)) {
+    if (t->sites[h].address == address)
+      return &t->sites[h];
+    if (t->sites[h].address == 0)
+      break;
+  }
+  if (t->nsites >= ALLOC_SITES * 3 / 4)
+    return &t->other;
+  t->nsites++;
+  t->sites[h].address = address;
+  return &t->sites[h];
+}
+
+/* stamp the header of a new block and count it */
+static void *alloc_record(char *base, size_t offset, size_t size, void *caller, int kind)
+{
+  AllocHeader *h = (AllocHeader *)(base + offset) - 1;
+  AllocThread *t = alloc_self;
+  unsigned long long live, peak;
+  unsigned b = alloc_bucket(size);
+
+  h->size = size;
+  h->offset = (unsigned)offset;
+  h->magic = ALLOC_MAGIC;
+  h->site = NULL;
+  if (alloc_busy || __atomic_load_n(&alloc_done, __ATOMIC_RELAXED))
+    return h + 1;
+  if (!t) {
+    alloc_busy = 1;
+    t = alloc_self = alloc_thread();
+    alloc_busy = 0;
+    if (!t)
+      return h + 1;
+  }
+
+  h->clock = __atomic_add_fetch(&alloc_clock, 1, __ATOMIC_RELAXED);
+  h->site = alloc_site(t, (uintptr_t)caller);
+  h->site->count++;
+  h->site->bytes += size;
+  switch (kind) {
+  case 0: t->mallocs++; break;
+  case 1: t->callocs++; break;
+  case 2: t->reallocs++; break;
+  default: t->aligned++; break;
+  }
+  t->bytes += size;
+  t->sizes[b]++;
+  t->sizeBytes[b] += size;
+  if (size < ALLOC_EXACT)
+    t->exact[size]++;
+
+  live = __atomic_add_fetch(&alloc_live, size, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&alloc_live_blocks, 1, __ATOMIC_RELAXED);
+  peak = __atomic_load_n(&alloc_peak, __ATOMIC_RELAXED);
+  while (live > peak) {
+    if (__atomic_compare_exchange_n(&alloc_peak, &peak, live, 1,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      alloc_peak_blocks = alloc_live_blocks;
+      alloc_peak_clock = h->clock;
+      break;
+    }
+  }
+  return h + 1;
+}
+
+/* the header of a block, or NULL if this library did not make it */
+static AllocHeader *alloc_header(void *p)
+{
+  AllocHeader *h = (AllocHeader *)p - 1;
+
+  return h->magic == ALLOC_MAGIC ? h : NULL;
+}
+
+static void alloc_forget(AllocHeader *h)
+{
+  AllocThread *t = alloc_self;
+  AllocSite *s = h->site;
+  unsigned long long life;
+
+  h->magic = 0;
+  if (!s)
+    return;
+  if (!t && !alloc_busy) {
+    alloc_busy = 1;
+    t = alloc_self = alloc_thread();
+    alloc_busy = 0;
+  }
+  life = __atomic_load_n(&alloc_clock, __ATOMIC_RELAXED) - h->clock;
+  __atomic_add_fetch(&s->frees, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&s->lifetime, life, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&alloc_live, h->size, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&alloc_live_blocks, 1, __ATOMIC_RELAXED);
+  if (t && !alloc_busy) {
+    t->frees++;
+    t->lifetimes[alloc_bucket(life)]++;
+  }
+}
+
+static void *alloc_aligned(size_t align, size_t size, void *caller, int kind)
+{
+  char *base;
+  size_t offset;
+
+  if (align <= 16)
+    align = 16;
+  if (size > (size_t)-1 - align - sizeof(AllocHeader)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (!(base = __libc_malloc(size + align + sizeof(AllocHeader))))
+    return NULL;
+  offset = (align - ((uintptr_t)base + sizeof(AllocHeader)) % align) % align + sizeof(AllocHeader);
+  return alloc_record(base, offset, size, caller, kind);
+}
+
+void *malloc(size_t size)
+{
+  char *base;
+
+  if (size > (size_t)-1 - sizeof(AllocHeader)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (!(base = __libc_malloc(size + sizeof(AllocHeader))))
+    return NULL;
+  return alloc_record(base, sizeof(AllocHeader), size, __builtin_return_address(0), 0);
+}
+
+void *calloc(size_t n, size_t size)
+{
+  char *base;
+
+  if (size && n > ((size_t)-1 - sizeof(AllocHeader)) / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (!(base = __libc_calloc(1, n * size + sizeof(AllocHeader))))
+    return NULL;
+  return alloc_record(base, sizeof(AllocHeader), n * size, __builtin_return_address(0), 1);
+}
+
+void free(void *p)
+{
+  AllocHeader *h;
+
+  if (!p)
+    return;
+  if (!(h = alloc_header(p))) {
+    __libc_free(p);
+    return;
+  }
+  alloc_forget(h);
+  __libc_free((char *)p - h->offset);
+}
+
+static void *alloc_realloc(void *p, size_t size, void *caller)
+{
+  AllocHeader *h;
+  AllocHeader old;
+  char *base;
+
+  if (!p) {
+    if (size > (size_t)-1 - sizeof(AllocHeader) || !(base = __libc_malloc(size + sizeof(AllocHeader))))
+      return NULL;
+    return alloc_record(base, sizeof(AllocHeader), size, caller, 2);
+  }
+  if (size == 0) {
+    free(p);
+    return NULL;
+  }
+  if (!(h = alloc_header(p)))
+    return __libc_realloc(p, size);
+  if (size > (size_t)-1 - sizeof(AllocHeader) - h->offset) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (h->offset != sizeof(AllocHeader)) {
+    /* an aligned block: keep the alignment out of it */
+    void *q = alloc_aligned(16, size, caller, 2);
+    if (q) {
+      memcpy(q, p, h->size < size ? h->size : size);
+      free(p);
+    }
+    return q;
+  }
+  old = *h;
+  if (!(base = __libc_realloc((char *)h, size + sizeof(AllocHeader))))
+    return NULL;
+  alloc_forget(&old);
+  return alloc_record(base, sizeof(AllocHeader), size, caller, 2);
+}
+
+void *realloc(void *p, size_t size)
+{
+  return alloc_realloc(p, size, __builtin_return_address(0));
+}
+
+void *reallocarray(void *p, size_t n, size_t size)
+{
+  if (size && n > (size_t)-1 / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return alloc_realloc(p, n * size, __builtin_return_address(0));
+}
+
+int posix_memalign(void **out, size_t align, size_t size)
+{
+  void *p;
+
+  if (align % sizeof(void *) || (align & (align - 1)))
+    return EINVAL;
+  if (!(p = alloc_aligned(align, size, __builtin_return_address(0), 3)))
+    return ENOMEM;
+  *out = p;
+  return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+  if (align & (align - 1)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return alloc_aligned(align, size, __builtin_return_address(0), 3);
+}
+
+void *memalign(size_t align, size_t size)
+{
+  if (align & (align - 1)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return alloc_aligned(align, size, __builtin_return_address(0), 3);
+}
+
+void *valloc(size_t size)
+{
+  return alloc_aligned(sysconf(_SC_PAGESIZE), size, __builtin_return_address(0), 3);
+}
+
+void *pvalloc(size_t size)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+
+  return alloc_aligned(page, (size + page - 1) & ~(page - 1), __builtin_return_address(0), 3);
+}
+
+size_t malloc_usable_size(void *p)
+{
+  AllocHeader *h;
+
+  if (!p)
+    return 0;
+  return (h = alloc_header(p)) ? h->size : 0;
+}
+
+static int alloc_by_address(const void *a, const void *b)
+{
+  uintptr_t x = (*(AllocSite *const *)a)->address, y = (*(AllocSite *const *)b)->address;
+
+  return x < y ? -1 : x > y;
+}
+
+static int alloc_by_count(const void *a, const void *b)
+{
+  const AllocSite *x = *(AllocSite *const *)a, *y = *(AllocSite *const *)b;
+
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+  return x->bytes < y->bytes ? 1 : x->bytes > y->bytes ? -1 : 0;
+}
+
+static void alloc_range(char *out, size_t n, unsigned b)
+{
+  if (b == 0)
+    snprintf(out, n, "0");
+  else if (b == 1)
+    snprintf(out, n, "1");
+  else
+    snprintf(out, n, "%llu-%llu", 1ull << (b - 1), b == 64 ? ~0ull : (1ull << b) - 1);
+}
+
+static void alloc_print_site(FILE *f, AllocSite *s)
+{
+  Dl_info info;
+
+  fprintf(f, "%12llu %14llu %10.1f %12llu %12.1f  ", s->count, s->bytes,
+          s->count ? (double)s->bytes / s->count : 0.0, s->frees,
+          s->frees ? (double)s->lifetime / s->frees : 0.0);
+  if (s->address == 0)
+    fprintf(f, "other (site table full)\n");
+  else if (dladdr((void *)s->address, &info) && info.dli_fname) {
+    fprintf(f, "%s+0x%lx", info.dli_fname, (unsigned long)(s->address - (uintptr_t)info.dli_fbase));
+    if (info.dli_sname)
+      fprintf(f, " (%s+0x%lx)", info.dli_sname, (unsigned long)(s->address - (uintptr_t)info.dli_saddr));
+    fprintf(f, "\n");
+  } else
+    fprintf(f, "0x%lx\n", (unsigned long)s->address);
+}
+
+static void alloc_child(void)
+{
+  alloc_done = 1;
+}
+
+/* profile only the program started with the library: drop it from
+   LD_PRELOAD for the programs it runs, and do not report from forks */
+static void alloc_start(void) __attribute__((constructor));
+
+static void alloc_start(void)
+{
+  const char *preload = getenv("LD_PRELOAD"), *p, *end;
+  char *rest;
+  size_t n = 0;
+
+  pthread_atfork(NULL, NULL, alloc_child);
+  if (!preload || !(rest = __libc_malloc(strlen(preload) + 1)))
+    return;
+  for (p = preload; *p; p = end) {
+    for (end = p; *end && *end != ':' && *end != ' '; end++)
+      ;
+    if (end > p && !memmem(p, end - p, "liballocprof", 12)) {
+      if (n)
+        rest[n++] = ':';
+      memcpy(rest + n, p, end - p);
+      n += end - p;
+    }
+    if (*end)
+      end++;
+  }
+  rest[n] = '\0';
+  if (n)
+    setenv("LD_PRELOAD", rest, 1);
+  else
+    unsetenv("LD_PRELOAD");
+  __libc_free(rest);
+}
+
+static void alloc_report(void) __attribute__((destructor));
+
+static void alloc_report(void)
+{
+  unsigned long long mallocs = 0, callocs = 0, reallocs = 0, aligned = 0, frees = 0, bytes = 0;
+  unsigned long long sizes[ALLOC_BUCKETS] = {0}, sizeBytes[ALLOC_BUCKETS] = {0};
+  unsigned long long lifetimes[ALLOC_BUCKETS] = {0}, exact[ALLOC_EXACT] = {0};
+  unsigned long long count, top[10] = {0};
+  unsigned topSize[10] = {0};
+  const char *path = getenv("LLVMALLOC_OUT"), *env = getenv("LLVMALLOC_TOP");
+  unsigned ntop = env ? (unsigned)strtoul(env, NULL, 0) : 20;
+  AllocSite **sites;
+  size_t nsites = 0, i, j;
+  AllocThread *t;
+  char range[48];
+  FILE *f;
+
+  if (__atomic_exchange_n(&alloc_done, 1, __ATOMIC_ACQ_REL))
+    return;
+  alloc_busy = 1;
+  for (t = __atomic_load_n(&alloc_threads, __ATOMIC_ACQUIRE); t; t = t->next) {
+    mallocs += t->mallocs;
+    callocs += t->callocs;
+    reallocs += t->reallocs;
+    aligned += t->aligned;
+    frees += t->frees;
+    bytes += t->bytes;
+    for (i = 0; i < ALLOC_BUCKETS; i++) {
+      sizes[i] += t->sizes[i];
+      sizeBytes[i] += t->sizeBytes[i];
+      lifetimes[i] += t->lifetimes[i];
+    }
+    for (i = 0; i < ALLOC_EXACT; i++)
+      exact[i] += t->exact[i];
+    nsites += t->nsites + 1;
+  }
+  count = mallocs + callocs + reallocs + aligned;
+  if (count == 0)
+    return;
+
+  if (!path)
+    path = "llvmalloc.out";
+  if (!(f = fopen(path, "w"))) {
+    perror(path);
+    return;
+  }
+  fprintf(f, "allocations %llu (malloc %llu, calloc %llu, realloc %llu, aligned %llu), %llu bytes, %.1f bytes each\n",
+          count, mallocs, callocs, reallocs, aligned, bytes, (double)bytes / count);
+  fprintf(f, "frees %llu, live at exit %llu blocks, %llu bytes\n",
+          frees, alloc_live_blocks, alloc_live);
+  fprintf(f, "peak live %llu bytes in %llu blocks, at allocation %llu\n",
+          alloc_peak, alloc_peak_blocks, alloc_peak_clock);
+
+  fprintf(f, "\nSizes:\n%21s %12s %7s %14s %7s\n", "bytes", "count", "%", "total bytes", "%");
+  for (i = 0; i < ALLOC_BUCKETS; i++)
+    if (sizes[i]) {
+      alloc_range(range, sizeof range, i);
+      fprintf(f, "%21s %12llu %7.2f %14llu %7.2f\n", range, sizes[i], 100.0 * sizes[i] / count,
+              sizeBytes[i], bytes ? 100.0 * sizeBytes[i] / bytes : 0.0);
+    }
+
+  for (i = 0; i < ALLOC_EXACT; i++)
+    for (j = 0; j < 10; j++)
+      if (exact[i] > top[j]) {
+        memmove(top + j + 1, top + j, (9 - j) * sizeof *top);
+        memmove(topSize + j + 1, topSize + j, (9 - j) * sizeof *topSize);
+        top[j] = exact[i];
+        topSize[j] = (unsigned)i;
+        break;
+      }
+  fprintf(f, "\nMost common sizes:\n%21s %12s %7s\n", "bytes", "count", "%");
+  for (j = 0; j < 10 && top[j]; j++)
+    fprintf(f, "%21u %12llu %7.2f\n", topSize[j], top[j], 100.0 * top[j] / count);
+
+  fprintf(f, "\nLifetimes (allocations made while live):\n%21s %12s %7s\n", "allocations", "frees", "%");
+  for (i = 0; i < ALLOC_BUCKETS; i++)
+    if (lifetimes[i]) {
+      alloc_range(range, sizeof range, i);
+      fprintf(f, "%21s %12llu %7.2f\n", range, lifetimes[i], 100.0 * lifetimes[i] / count);
+    }
+  fprintf(f, "%21s %12llu %7.2f\n", "never freed", count - frees, 100.0 * (count - frees) / count);
+
+  if ((sites = __libc_malloc(nsites * sizeof *sites))) {
+    nsites = 0;
+    for (t = __atomic_load_n(&alloc_threads, __ATOMIC_ACQUIRE); t; t = t->next) {
+      for (i = 0; i < ALLOC_SITES; i++)
+        if (t->sites[i].address)
+          sites[nsites++] = &t->sites[i];
+      if (t->other.count)
+        sites[nsites++] = &t->other;
+    }
+    /* merge the entries threads made for the same site */
+    qsort(sites, nsites, sizeof *sites, alloc_by_address);
+    for (i = 0, j = 0; i < nsites; i++)
+      if (j && sites[i]->address == sites[j - 1]->address) {
+        sites[j - 1]->count += sites[i]->count;
+        sites[j - 1]->bytes += sites[i]->bytes;
+        sites[j - 1]->frees += sites[i]->frees;
+        sites[j - 1]->lifetime += sites[i]->lifetime;
+      } else
+        sites[j++] = sites[i];
+    nsites = j;
+    qsort(sites, nsites, sizeof *sites, alloc_by_count);
+    fprintf(f, "\nCall sites by allocations (addr2line -e module offset):\n%12s %14s %10s %12s %12s  %s\n",
+            "count", "bytes", "avg size", "frees", "avg life", "site");
+    for (i = 0; i < nsites && i < ntop; i++)
+      alloc_print_site(f, sites[i]);
+    __libc_free(sites);
+  }
+  fclose(f);
+  fprintf(stderr, "allocprof: %llu allocations, peak live %llu bytes, report in %s\n", count, alloc_peak, path);
+}
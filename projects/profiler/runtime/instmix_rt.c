@@ -0,0 +1,57 @@
+/*
+ * File: instmix_rt.c
+ *
+ * Description:
+ *   Runtime for profiler -inst-mix. The instrumented module counts the
+ *   executions of each block and keeps a histogram of each block's
+ *   instructions by class; prof_mix_dump, called from a global
+ *   destructor, weights the histograms by the counts and writes the
+ *   totals to llvmmix.out (or $LLVMMIX_OUT), one "class count" line per
+ *   class and then the total. A one-line summary goes to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the columns of the histogram, in instmix.cpp's MixClass order */
+#define MIX_CLASSES 7
+
+static const char *mix_names[MIX_CLASSES] = {
+  "loads", "stores", "branches", "calls", "alu", "fp", "other"
+};
+
+/* a process with several instrumented modules appends each one's totals */
+static int mix_written;
+
+void prof_mix_dump(const unsigned long long *counts, const unsigned *histogram,
+                   unsigned nblocks)
+{
+  const char *path = getenv("LLVMMIX_OUT");
+  unsigned long long totals[MIX_CLASSES] = {0}, total = 0;
+  unsigned b, c;
+  FILE *out;
+
+  for (b = 0; b < nblocks; b++)
+    for (c = 0; c < MIX_CLASSES; c++)
+      totals[c] += counts[b] * histogram[b * MIX_CLASSES + c];
+  for (c = 0; c < MIX_CLASSES; c++)
+    total += totals[c];
+
+  if (!path)
+    path = "llvmmix.out";
+  out = fopen(path, mix_written ? "a" : "w");
+  if (!out) {
+    perror(path);
+    return;
+  }
+  mix_written = 1;
+  for (c = 0; c < MIX_CLASSES; c++)
+    fprintf(out, "%s %llu\n", mix_names[c], totals[c]);
+  fprintf(out, "total %llu\n", total);
+  fclose(out);
+
+  fprintf(stderr, "instmix: %llu instructions executed,", total);
+  for (c = 0; c < MIX_CLASSES; c++)
+    fprintf(stderr, " %s %.1f%%", mix_names[c],
+            total ? 100.0 * totals[c] / total : 0.0);
+  fprintf(stderr, " (%s)\n", path);
+}
@@ -0,0 +1,190 @@
+/*
+ * File: memtrace_rt.c
+ *
+ * Description:
+ *   Runtime for profiler -memtrace. prof_mem_access(id, address) is
+ *   called before every traced load and store. Each thread keeps its own
+ *   state and buffer, so the probe takes no locks.
+ *
+ *   Sampling: a thread records bursts of $LLVMMEM_BURST accesses (default
+ *   100000) out of every $LLVMMEM_PERIOD (default 1000000); a period of 0
+ *   records everything. Bursts keep runs of consecutive accesses, which
+ *   a cache simulation needs. The accesses skipped before a burst are
+ *   written as a gap record.
+ *
+ *   Compression: the size and kind of an access are in the map file
+ *   written at instrumentation time, so a record is just the ID and the
+ *   address, as LEB128 varints: the ID, then the zigzag-encoded
+ *   difference from the address that ID touched last in this thread
+ *   (strided accesses take one or two bytes). A gap is ID 0 followed by
+ *   the number of accesses skipped.
+ *
+ *   File: "LLVMMEM1", then chunks of a thread's records, each an 8-byte
+ *   thread ID and a 4-byte length in host byte order followed by the
+ *   records. A chunk goes out in one write() to a file opened with
+ *   O_APPEND, so chunks of different threads do not interleave. The file
+ *   is llvmmem.trace or $LLVMMEM_OUT; prof_mem_dump, called from a
+ *   global destructor, flushes what is left.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define MEM_BUFFER (1u << 20)
+#define MEM_HEADER 12
+#define MEM_RECORD_MAX 20
+
+typedef struct MemThread {
+  struct MemThread *next;
+  unsigned long long tid;
+  unsigned long long accesses, recorded;
+  unsigned long long left, skipped;
+  int recording;
+  unsigned long long *last;     /* last address per ID */
+  unsigned nlast;
+  unsigned used;
+  unsigned char buffer[MEM_BUFFER];
+} MemThread;
+
+static MemThread *mem_threads;
+static __thread MemThread *mem_self;
+static int mem_fd = -1, mem_opening, mem_done;
+static unsigned long long mem_burst, mem_period, mem_bytes;
+
+static void mem_open(void)
+{
+  const char *path = getenv("LLVMMEM_OUT"), *env;
+
+  if (__atomic_exchange_n(&mem_opening, 1, __ATOMIC_ACQ_REL)) {
+    while (__atomic_load_n(&mem_fd, __ATOMIC_ACQUIRE) == -1)
+      ;
+    return;
+  }
+  env = getenv("LLVMMEM_BURST");
+  mem_burst = env ? strtoull(env, NULL, 0) : 100000;
+  env = getenv("LLVMMEM_PERIOD");
+  mem_period = env ? strtoull(env, NULL, 0) : 1000000;
+  if (mem_period <= mem_burst)
+    mem_period = 0;
+
+  if (!path)
+    path = "llvmmem.trace";
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd < 0)
+    perror(path);
+  else if (write(fd, "LLVMMEM1", 8) != 8)
+    perror(path);
+  __atomic_store_n(&mem_fd, fd < 0 ? -2 : fd, __ATOMIC_RELEASE);
+}
+
+static void mem_flush(MemThread *t)
+{
+  unsigned n = t->used - MEM_HEADER;
+
+  if (n == 0)
+    return;
+  memcpy(t->buffer, &t->tid, 8);
+  memcpy(t->buffer + 8, &n, 4);
+  if (mem_fd >= 0 && write(mem_fd, t->buffer, t->used) != (ssize_t)t->used)
+    perror("memtrace");
+  __atomic_add_fetch(&mem_bytes, t->used, __ATOMIC_RELAXED);
+  t->used = MEM_HEADER;
+}
+
+static MemThread *mem_thread(void)
+{
+  MemThread *t = calloc(1, sizeof *t);
+
+  if (!t)
+    return NULL;
+  mem_open();
+  t->tid = syscall(SYS_gettid);
+  t->used = MEM_HEADER;
+  t->recording = 1;
+  t->left = mem_period ? mem_burst : ~0ull;
+  t->next = __atomic_load_n(&mem_threads, __ATOMIC_ACQUIRE);
+  while (!__atomic_compare_exchange_n(&mem_threads, &t->next, t, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+    ;
+  return t;
+}
+
+static inline void mem_put(MemThread *t, unsigned long long v)
+{
+  while (v >= 0x80) {
+    t->buffer[t->used++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  t->buffer[t->used++] = (unsigned char)v;
+}
+
+void prof_mem_access(unsigned id, const void *address)
+{
+  MemThread *t = mem_self;
+  unsigned long long a = (unsigned long long)address;
+  long long delta;
+
+  if (mem_done)
+    return;
+  if (!t && !(t = mem_self = mem_thread()))
+    return;
+  t->accesses++;
+
+  if (t->left-- == 0) {
+    t->recording = !t->recording;
+    t->left = (t->recording ? mem_burst : mem_period - mem_burst) - 1;
+  }
+  if (!t->recording) {
+    t->skipped++;
+    return;
+  }
+
+  if (id >= t->nlast) {
+    unsigned n = t->nlast ? t->nlast : 256;
+    unsigned long long *grown;
+    while (n <= id)
+      n *= 2;
+    grown = realloc(t->last, n * sizeof *grown);
+    if (!grown)
+      return;
+    memset(grown + t->nlast, 0, (n - t->nlast) * sizeof *grown);
+    t->last = grown;
+    t->nlast = n;
+  }
+  if (t->used + 2 * MEM_RECORD_MAX > MEM_BUFFER)
+    mem_flush(t);
+  if (t->skipped) {
+    mem_put(t, 0);
+    mem_put(t, t->skipped);
+    t->skipped = 0;
+  }
+  delta = (long long)(a - t->last[id]);
+  t->last[id] = a;
+  mem_put(t, id);
+  mem_put(t, ((unsigned long long)delta << 1) ^ (unsigned long long)(delta >> 63));
+  t->recorded++;
+}
+
+void prof_mem_dump(void)
+{
+  unsigned long long accesses = 0, recorded = 0;
+  MemThread *t;
+
+  if (__atomic_exchange_n(&mem_done, 1, __ATOMIC_ACQ_REL) || mem_fd == -1)
+    return;
+  for (t = __atomic_load_n(&mem_threads, __ATOMIC_ACQUIRE); t; t = t->next) {
+    mem_flush(t);
+    accesses += t->accesses;
+    recorded += t->recorded;
+  }
+  if (mem_fd >= 0)
+    close(mem_fd);
+  fprintf(stderr, "memtrace: %llu of %llu accesses recorded in %llu bytes (%.2f bytes each)\n",
+          recorded, accesses, mem_bytes, recorded ? (double)mem_bytes / recorded : 0.0);
+}
@@ -0,0 +1,49 @@
+/*
+ * File: profile_rt.c
+ *
+ * Description:
+ *   Runtime for profiler -do-profile. The instrumented module keeps one
+ *   array of edge counters per function and calls prof_dump from a global
+ *   destructor, which writes them to llvmprof.out (or $LLVMPROF_OUT) in
+ *   the format -use-profile reads: one line per function with its name,
+ *   CFG checksum, counter count and the counters. The number of counter
+ *   increments the run paid for goes to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+/* edgeprofile.cpp builds a table of these */
+typedef struct ProfFunction {
+  const char *name;
+  unsigned long long checksum;
+  unsigned long long *counters;
+  unsigned ncounters;
+} ProfFunction;
+
+void prof_dump(ProfFunction *fns, unsigned nfns)
+{
+  const char *path = getenv("LLVMPROF_OUT");
+  unsigned long long increments = 0;
+  unsigned f, c;
+  FILE *out;
+
+  if (!path)
+    path = "llvmprof.out";
+  out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return;
+  }
+
+  for (f = 0; f < nfns; f++) {
+    fprintf(out, "%s %llu %u", fns[f].name, fns[f].checksum, fns[f].ncounters);
+    for (c = 0; c < fns[f].ncounters; c++) {
+      fprintf(out, " %llu", fns[f].counters[c]);
+      increments += fns[f].counters[c];
+    }
+    fprintf(out, "\n");
+  }
+  fclose(out);
+
+  fprintf(stderr, "profile: %llu counter increments written to %s\n", increments, path);
+}
@@ -0,0 +1,350 @@
+/*
+ * File: trace_rt.c
+ *
+ * Description:
+ *   Runtime for profiler -trace. prof_trace_enter and prof_trace_exit
+ *   append a timestamped event to a ring buffer owned by the calling
+ *   thread, so the probes take no locks; each thread's buffer is pushed
+ *   onto a global list with a compare-and-swap the first time it traces.
+ *   Timestamps are rdtsc ticks on x86, converted to time against
+ *   clock_gettime over the whole run, and clock_gettime elsewhere. A full
+ *   ring overwrites its oldest events ($LLVMTRACE_EVENTS sets the size
+ *   per thread).
+ *
+ *   prof_trace_dump, called from a global destructor, first times the
+ *   probe itself and takes that cost back out of every timestamp: each
+ *   event is moved earlier by the cost of all the probes its thread ran
+ *   before it. It then writes
+ *   - llvmtrace.json (or $LLVMTRACE_OUT), Chrome Trace Event Format
+ *     begin/end events, for chrome://tracing or Perfetto;
+ *   - llvmtrace.flat (or $LLVMTRACE_FLAT), a flat profile with the calls,
+ *     self time and inclusive time of each function, by self time.
+ *   An exit that does not match the innermost open call (longjmp) closes
+ *   the calls above the matching one; calls still open at the end of a
+ *   thread's events (exit) close at its last event.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef struct TraceEvent {
+  unsigned long long ts;      /* ticks, with TRACE_EXIT set on exits */
+  const char *name;
+} TraceEvent;
+
+#define TRACE_EXIT (1ull << 63)
+#define TRACE_DEFAULT_EVENTS (1u << 20)
+#define TRACE_CALIBRATE 100000
+
+typedef struct TraceBuffer {
+  struct TraceBuffer *next;
+  long tid;
+  unsigned long long written;   /* events recorded, overwritten ones included */
+  unsigned long long mask;
+  TraceEvent *events;
+} TraceBuffer;
+
+static TraceBuffer *trace_buffers;
+static __thread TraceBuffer *trace_self;
+static int trace_started, trace_done;
+static unsigned long long trace_tick0;
+static struct timespec trace_time0;
+
+static inline unsigned long long trace_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((unsigned long long)hi << 32) | lo;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000ull + t.tv_nsec;
+#endif
+}
+
+static double trace_elapsed_ns(struct timespec *from)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (t.tv_sec - from->tv_sec) * 1e9 + (t.tv_nsec - from->tv_nsec);
+}
+
+static unsigned long long trace_capacity(void)
+{
+  const char *env = getenv("LLVMTRACE_EVENTS");
+  unsigned long long want = env ? strtoull(env, NULL, 0) : TRACE_DEFAULT_EVENTS, cap = 16;
+  while (cap < want)
+    cap <<= 1;
+  return cap;
+}
+
+static TraceBuffer *trace_new_buffer(void)
+{
+  unsigned long long cap = trace_capacity();
+  TraceBuffer *b = malloc(sizeof *b);
+
+  if (!b)
+    return NULL;
+  b->events = malloc(cap * sizeof(TraceEvent));
+  if (!b->events) {
+    free(b);
+    return NULL;
+  }
+  b->mask = cap - 1;
+  b->written = 0;
+  b->tid = syscall(SYS_gettid);
+
+  if (!__atomic_exchange_n(&trace_started, 1, __ATOMIC_ACQ_REL)) {
+    clock_gettime(CLOCK_MONOTONIC, &trace_time0);
+    trace_tick0 = trace_now();
+  }
+  b->next = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE);
+  while (!__atomic_compare_exchange_n(&trace_buffers, &b->next, b, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+    ;
+  return b;
+}
+
+static inline void trace_record(TraceBuffer *b, const char *name, unsigned long long exit)
+{
+  TraceEvent *e = &b->events[b->written & b->mask];
+  e->ts = trace_now() | exit;
+  e->name = name;
+  __atomic_store_n(&b->written, b->written + 1, __ATOMIC_RELEASE);
+}
+
+static void trace_probe(const char *name, unsigned long long exit)
+{
+  TraceBuffer *b = trace_self;
+  if (trace_done)
+    return;
+  if (!b && !(b = trace_self = trace_new_buffer()))
+    return;
+  trace_record(b, name, exit);
+}
+
+void prof_trace_enter(const char *name)
+{
+  trace_probe(name, 0);
+}
+
+void prof_trace_exit(const char *name)
+{
+  trace_probe(name, TRACE_EXIT);
+}
+
+/* ticks one probe costs: the best of a few timed runs into a scratch ring */
+static double trace_probe_cost(void)
+{
+  static TraceEvent scratch[1024];
+  TraceBuffer b = {NULL, 0, 0, 1023, scratch};
+  void (*volatile record)(TraceBuffer *, const char *, unsigned long long) = trace_record;
+  double best = 0;
+  int run, i;
+
+  for (run = 0; run < 5; run++) {
+    unsigned long long t0 = trace_now(), t;
+    for (i = 0; i < TRACE_CALIBRATE; i++)
+      record(&b, "", i & 1 ? TRACE_EXIT : 0);
+    t = trace_now() - t0;
+    if (run == 0 || t < best)
+      best = t;
+  }
+  return best / TRACE_CALIBRATE;
+}
+
+/* flat profile: one entry per function name, open addressing on the pointer */
+typedef struct TraceStat {
+  const char *name;
+  unsigned long long calls;
+  double self, total;
+  unsigned active;              /* open calls, so recursion counts once */
+} TraceStat;
+
+static TraceStat **trace_stats;
+static unsigned long long trace_nstats, trace_statcap;
+
+static TraceStat *trace_stat(const char *name)
+{
+  unsigned long long i, mask;
+
+  if (2 * (trace_nstats + 1) > trace_statcap) {
+    TraceStat **old = trace_stats;
+    unsigned long long oldcap = trace_statcap;
+    trace_statcap = trace_statcap ? 2 * trace_statcap : 256;
+    trace_stats = calloc(trace_statcap, sizeof(TraceStat *));
+    mask = trace_statcap - 1;
+    for (i = 0; i < oldcap; i++)
+      if (old[i]) {
+        unsigned long long j = ((unsigned long long)old[i]->name * 0x9E3779B97F4A7C15ull >> 7) & mask;
+        while (trace_stats[j])
+          j = (j + 1) & mask;
+        trace_stats[j] = old[i];
+      }
+    free(old);
+  }
+  mask = trace_statcap - 1;
+  for (i = ((unsigned long long)name * 0x9E3779B97F4A7C15ull >> 7) & mask; trace_stats[i];
+       i = (i + 1) & mask)
+    if (trace_stats[i]->name == name)
+      return trace_stats[i];
+  trace_stats[i] = calloc(1, sizeof(TraceStat));
+  trace_stats[i]->name = name;
+  trace_nstats++;
+  return trace_stats[i];
+}
+
+typedef struct TraceFrame {
+  TraceStat *stat;
+  double start, children;
+} TraceFrame;
+
+static void trace_close(TraceFrame *f, TraceFrame *parent, double end)
+{
+  double total = end - f->start;
+  f->stat->calls++;
+  f->stat->self += total - f->children;
+  if (--f->stat->active == 0)
+    f->stat->total += total;
+  if (parent)
+    parent->children += total;
+}
+
+static void trace_json_name(FILE *out, const char *s)
+{
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', out);
+    if ((unsigned char)*s >= ' ')
+      fputc(*s, out);
+  }
+}
+
+static int trace_by_self(const void *a, const void *b)
+{
+  const TraceStat *x = a, *y = b;
+  return x->self < y->self ? 1 : x->self > y->self ? -1 : 0;
+}
+
+void prof_trace_dump(void)
+{
+  const char *path = getenv("LLVMTRACE_OUT"), *flatpath = getenv("LLVMTRACE_FLAT");
+  unsigned long long events = 0, dropped = 0, i;
+  double cost, ns_per_tick = 1, all = 0;
+  unsigned threads = 0;
+  int pid = getpid(), first = 1;
+  TraceBuffer *b;
+  FILE *out, *flat;
+
+  if (__atomic_exchange_n(&trace_done, 1, __ATOMIC_ACQ_REL) || !trace_started)
+    return;
+#if defined(__x86_64__) || defined(__i386__)
+  {
+    unsigned long long ticks = trace_now() - trace_tick0;
+    double ns = trace_elapsed_ns(&trace_time0);
+    if (ticks && ns > 0)
+      ns_per_tick = ns / ticks;
+  }
+#endif
+  cost = trace_probe_cost();
+
+  if (!path)
+    path = "llvmtrace.json";
+  if (!flatpath)
+    flatpath = "llvmtrace.flat";
+  out = fopen(path, "w");
+  if (!out) {
+    perror(path);
+    return;
+  }
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+  for (b = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE); b; b = b->next) {
+    unsigned long long written = __atomic_load_n(&b->written, __ATOMIC_ACQUIRE);
+    unsigned long long from = written > b->mask + 1 ? written - b->mask - 1 : 0;
+    TraceFrame *stack = NULL;
+    unsigned depth = 0, room = 0;
+    double last = 0, t;
+
+    threads++;
+    events += written - from;
+    dropped += from;
+    for (i = from; i < written; i++) {
+      TraceEvent *e = &b->events[i & b->mask];
+      int exit = (e->ts & TRACE_EXIT) != 0;
+      unsigned long long ticks = e->ts & ~TRACE_EXIT;
+
+      /* time since the start, less every probe this thread ran before */
+      t = ((double)(ticks - trace_tick0) - i * cost) * ns_per_tick;
+      if (t < last)
+        t = last;
+      last = t;
+
+      fprintf(out, "%s{\"name\":\"", first ? "" : ",\n");
+      trace_json_name(out, e->name);
+      fprintf(out, "\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld}",
+              exit ? "E" : "B", t / 1000, pid, b->tid);
+      first = 0;
+
+      if (!exit) {
+        if (depth == room) {
+          room = room ? 2 * room : 64;
+          stack = realloc(stack, room * sizeof(TraceFrame));
+        }
+        stack[depth].stat = trace_stat(e->name);
+        stack[depth].stat->active++;
+        stack[depth].start = t;
+        stack[depth].children = 0;
+        depth++;
+      } else {
+        unsigned d = depth;
+        while (d > 0 && stack[d - 1].stat->name != e->name)
+          d--;
+        /* an exit whose entry was overwritten closes nothing */
+        while (d > 0 && depth >= d) {
+          depth--;
+          trace_close(&stack[depth], depth ? &stack[depth - 1] : NULL, t);
+        }
+      }
+    }
+    while (depth > 0) {
+      depth--;
+      trace_close(&stack[depth], depth ? &stack[depth - 1] : NULL, last);
+    }
+    free(stack);
+  }
+  fprintf(out, "\n]}\n");
+  fclose(out);
+
+  flat = fopen(flatpath, "w");
+  if (!flat) {
+    perror(flatpath);
+    return;
+  }
+  {
+    TraceStat *sorted = malloc((trace_nstats + 1) * sizeof(TraceStat));
+    unsigned long long n = 0;
+    for (i = 0; i < trace_statcap; i++)
+      if (trace_stats[i]) {
+        sorted[n++] = *trace_stats[i];
+        all += trace_stats[i]->self;
+      }
+    qsort(sorted, n, sizeof(TraceStat), trace_by_self);
+    fprintf(flat, "%7s %12s %12s %12s  %s\n", "%self", "self(ms)", "total(ms)", "calls", "name");
+    for (i = 0; i < n; i++)
+      fprintf(flat, "%7.2f %12.3f %12.3f %12llu  %s\n", all > 0 ? 100 * sorted[i].self / all : 0.0,
+              sorted[i].self / 1e6, sorted[i].total / 1e6, sorted[i].calls, sorted[i].name);
+    free(sorted);
+  }
+  fclose(flat);
+
+  fprintf(stderr, "trace: %llu events from %u threads (%llu overwritten), %.1f ns per probe subtracted, written to %s and %s\n",
+          events, threads, dropped, cost * ns_per_tick, path, flatpath);
+}
@@ -0,0 +1,222 @@
+/*
+ * File: split.cpp
+ *
+ * Description:
+ *   Hot/cold function splitting. Error handling and usage paths are
+ *   moved out of the functions they sit in, so the hot code that is left
+ *   spans fewer cache lines and pages.
+ *
+ *   Cold blocks: with -use-profile, the blocks of an entered function
+ *   that never ran. Without a profile, blocks that call exit, abort,
+ *   __assert_fail, perror or a noreturn or cold function, write to
+ *   stderr (fprintf, vfprintf, fputs, fputc, putc, fwrite), or end in
+ *   unreachable. Coldness then spreads to blocks whose successors are
+ *   all cold and to blocks whose predecessors are all cold. The entry
+ *   block is never cold.
+ *
+ *   Regions: in reverse post order, each cold block not yet taken heads
+ *   a region of the cold blocks it dominates and reaches through cold
+ *   blocks, so every region has a single entry. Regions under
+ *   MinSplitInstructions are left alone, since the call that replaces
+ *   them would be about as big.
+ *
+ *   CodeExtractor does the outlining. Values live into the region become
+ *   arguments. Values live out of it are returned through stack slots
+ *   in the caller. When the region has several exits, the outlined
+ *   function returns which exit was taken. The new function,
+ *   <fn>.cold.<n>, is marked cold and noinline.
+ *
+ *   SplitBytes estimates the code moved out of hot functions at
+ *   BytesPerInstruction bytes per IR instruction, the average of llc -O0
+ *   x86-64 text over the p2 tests.
+ */
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/CodeExtractor.h"
+
+#include "edgeprofile.h"
+#include "split.h"
+
+using namespace llvm;
+
+static llvm::Statistic SplitFunctions = {"", "SplitFunctions", "Split functions with cold code outlined"};
+static llvm::Statistic SplitRegions = {"", "SplitRegions", "Split cold regions outlined"};
+static llvm::Statistic SplitInstructions = {"", "SplitInstructions", "Split instructions moved out of hot functions"};
+static llvm::Statistic SplitBytes = {"", "SplitBytes", "Split estimated bytes moved out of hot functions"};
+
+static const unsigned MinSplitInstructions = 4;
+static const unsigned BytesPerInstruction = 6;
+
+static bool isStderr(Value *V)
+{
+    auto *LI = dyn_cast<LoadInst>(V->stripPointerCasts());
+    if (!LI)
+        return false;
+    auto *GV = dyn_cast<GlobalVariable>(LI->getPointerOperand()->stripPointerCasts());
+    return GV && GV->getName() == "stderr";
+}
+
+static bool isColdCall(CallBase *CB)
+{
+    Function *Callee = CB->getCalledFunction();
+    if (!Callee)
+        return false;
+    if (Callee->hasFnAttribute(Attribute::NoReturn) || Callee->hasFnAttribute(Attribute::Cold))
+        return true;
+
+    StringRef name = Callee->getName();
+    if (name == "exit" || name == "_exit" || name == "abort" || name == "__assert_fail" ||
+        name == "perror")
+        return true;
+
+    // the stream argument of the stdio calls that take one
+    int stream = -1;
+    if (name == "fprintf" || name == "vfprintf")
+        stream = 0;
+    else if (name == "fputs" || name == "fputc" || name == "putc")
+        stream = 1;
+    else if (name == "fwrite")
+        stream = 3;
+    return stream >= 0 && (unsigned)stream < CB->arg_size() && isStderr(CB->getArgOperand(stream));
+}
+
+static bool isColdRoot(BasicBlock &BB)
+{
+    if (isa<UnreachableInst>(BB.getTerminator()))
+        return true;
+    for (Instruction &I : BB)
+        if (auto *CB = dyn_cast<CallBase>(&I))
+            if (isColdCall(CB))
+                return true;
+    return false;
+}
+
+//***********************Function findColdBlocks***************************//
+// profile: blocks that never ran; static: the cold roots, spread to blocks
+// that only lead to or only come from cold blocks
+//*************************************************************************//
+
+static DenseSet<BasicBlock *> findColdBlocks(Function &F, bool profiled)
+{
+    DenseSet<BasicBlock *> cold;
+    BasicBlock *Entry = &F.getEntryBlock();
+    if (profiled) {
+        for (BasicBlock &BB : F) {
+            uint64_t count;
+            if (&BB != Entry && GetBlockCount(&BB, count) && count == 0)
+                cold.insert(&BB);
+        }
+        return cold;
+    }
+
+    for (BasicBlock &BB : F)
+        if (&BB != Entry && isColdRoot(BB))
+            cold.insert(&BB);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (BasicBlock &BB : F) {
+            if (&BB == Entry || cold.count(&BB))
+                continue;
+            bool allSucc = succ_begin(&BB) != succ_end(&BB);
+            for (BasicBlock *S : successors(&BB))
+                allSucc = allSucc && cold.count(S);
+            bool allPred = pred_begin(&BB) != pred_end(&BB);
+            for (BasicBlock *P : predecessors(&BB))
+                allPred = allPred && cold.count(P);
+            if (allSucc || allPred) {
+                cold.insert(&BB);
+                changed = true;
+            }
+        }
+    }
+    return cold;
+}
+
+static unsigned regionSize(const std::vector<BasicBlock *> &region)
+{
+    unsigned n = 0;
+    for (BasicBlock *BB : region)
+        for (Instruction &I : *BB)
+            if (!isa<PHINode>(&I) && !I.isDebugOrPseudoInst())
+                n++;
+    return n;
+}
+
+static void splitFunction(Function &F)
+{
+    uint64_t count;
+    bool profiled = GetBlockCount(&F.getEntryBlock(), count);
+    // a function the profile never entered is left to -layout as a whole
+    if (profiled && count == 0)
+        return;
+
+    DenseSet<BasicBlock *> cold = findColdBlocks(F, profiled);
+    if (cold.empty())
+        return;
+
+    DominatorTree DT(F);
+    DenseSet<BasicBlock *> taken;
+    std::vector<std::vector<BasicBlock *>> regions;
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    for (BasicBlock *Head : RPOT) {
+        if (!cold.count(Head) || taken.count(Head))
+            continue;
+        std::vector<BasicBlock *> region, work{Head};
+        taken.insert(Head);
+        while (!work.empty()) {
+            BasicBlock *BB = work.back();
+            work.pop_back();
+            region.push_back(BB);
+            for (BasicBlock *S : successors(BB))
+                if (cold.count(S) && !taken.count(S) && DT.dominates(Head, S)) {
+                    taken.insert(S);
+                    work.push_back(S);
+                }
+        }
+        if (regionSize(region) >= MinSplitInstructions)
+            regions.push_back(region);
+    }
+
+    CodeExtractorAnalysisCache CEAC(F);
+    bool split = false;
+    for (auto &region : regions) {
+        unsigned size = regionSize(region);
+        CodeExtractor CE(region, &DT, false, nullptr, nullptr, nullptr, false, false, "cold");
+        if (!CE.isEligible())
+            continue;
+        Function *Out = CE.extractCodeRegion(CEAC);
+        if (!Out)
+            continue;
+        Out->addFnAttr(Attribute::Cold);
+        Out->addFnAttr(Attribute::NoInline);
+        if (profiled)
+            Out->setEntryCount(0);
+        SplitRegions++;
+        SplitInstructions += size;
+        SplitBytes += size * BytesPerInstruction;
+        split = true;
+    }
+    if (split)
+        SplitFunctions++;
+}
+
+void HotColdSplit(Module *M)
+{
+    // the outlined functions are appended to M and not visited again
+    std::vector<Function *> funcs;
+    for (auto f = M->begin(); f != M->end(); f++)
+        if (!f->isDeclaration() && !f->hasFnAttribute(Attribute::Cold))
+            funcs.push_back(&*f);
+    for (Function *F : funcs)
+        splitFunction(*F);
+}
@@ -0,0 +1,11 @@
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include "llvm/IR/Module.h"
+
+/* Outline the cold regions of each function (never run in the profile,
+   or leading only to exit, abort, stderr output or unreachable) into
+   separate cold functions. */
+void HotColdSplit(llvm::Module *M);
+
+#endif
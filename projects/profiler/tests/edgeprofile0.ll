@@ -0,0 +1,75 @@
+; ModuleID = 'edgeprofile0'
+; CHECK-LABEL: source_filename = "edgeprofile0"
+source_filename = "edgeprofile0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; Both functions are registered with the runtime, which writes the counters
+; out from a global destructor. Each has E - V + 1 = 3 counters.
+; CHECK: @prof.counters.count = internal global [3 x i64] zeroinitializer
+; CHECK: @prof.counters.pick = internal global [3 x i64] zeroinitializer
+; CHECK: @prof.functions = internal constant [2 x %prof.function]
+; CHECK: @llvm.global_dtors = appending global {{.*}} @prof.dump
+
+; A one-block loop's back edge cannot be on the tree, and it is critical,
+; so its counter gets a block of its own. Entering the loop is not counted.
+; CHECK-LABEL: define i32 @count(i32 %n)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %z = icmp sgt i32 %n, 0
+; CHECK-NEXT: br i1 %z, label %loop, label %done
+; CHECK: prof.edge:
+; CHECK-NEXT: load i64, i64* getelementptr inbounds ([3 x i64], [3 x i64]* @prof.counters.count, i64 0, i64 0)
+; CHECK-NEXT: add i64 %{{[0-9]+}}, 1
+; CHECK-NEXT: store i64
+; CHECK-NEXT: br label %loop
+; CHECK: loop:
+; CHECK-NEXT: %i = phi i32 [ 0, %entry ], [ %i1, %prof.edge ]
+; CHECK: br i1 %more, label %prof.edge, label %prof.edge1
+; CHECK: done:
+; CHECK-NEXT: %s = phi i32 [ 0, %entry ], [ %s1, %prof.edge1 ]
+define i32 @count(i32 %n) {
+entry:
+  %z = icmp sgt i32 %n, 0
+  br i1 %z, label %loop, label %done
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %loop ]
+  %s0 = phi i32 [ 0, %entry ], [ %s1, %loop ]
+  %s1 = add i32 %s0, %i
+  %i1 = add i32 %i, 1
+  %more = icmp slt i32 %i1, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  %s = phi i32 [ 0, %entry ], [ %s1, %loop ]
+  ret i32 %s
+}
+
+; The critical edges stay on the tree, so every counter sits in a block
+; with a single predecessor or successor and nothing is split.
+; CHECK-LABEL: define i32 @pick(i1 %c, i1 %d)
+; CHECK-NOT: prof.edge
+; CHECK: a:
+; CHECK-NEXT: load i64, i64* getelementptr inbounds ([3 x i64], [3 x i64]* @prof.counters.pick, i64 0, i64 0)
+; CHECK: b:
+; CHECK-NEXT: load i64, i64* getelementptr inbounds ([3 x i64], [3 x i64]* @prof.counters.pick, i64 0, i64 1)
+; CHECK: join:
+; CHECK-NEXT: %r = phi i32
+; CHECK-NEXT: load i64, i64* getelementptr inbounds ([3 x i64], [3 x i64]* @prof.counters.pick, i64 0, i64 2)
+define i32 @pick(i1 %c, i1 %d) {
+entry:
+  br i1 %c, label %a, label %join
+
+a:
+  br i1 %d, label %join, label %b
+
+b:
+  br label %join
+
+join:
+  %r = phi i32 [ 1, %a ], [ 2, %b ], [ 3, %entry ]
+  ret i32 %r
+}
+
+; CHECK-LABEL: define internal void @prof.dump()
+; CHECK: call void @prof_dump(%prof.function* getelementptr inbounds ([2 x %prof.function], [2 x %prof.function]* @prof.functions, i64 0, i64 0), i32 2)
@@ -0,0 +1,73 @@
+; ModuleID = 'edgeprofile1'
+; CHECK-LABEL: source_filename = "edgeprofile1"
+source_filename = "edgeprofile1"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; edgeprofile1.prof comes from a -do-profile build of this file: main calls
+; count(10) and count(0), then pick with (c, d) = (1, 1), (1, 0), (0, 0),
+; (1, 1). The tree edges are solved from the counted ones.
+
+; CHECK-LABEL: define i32 @count(i32 %n)
+; CHECK-SAME: !prof ![[COUNTENTRY:[0-9]+]]
+; CHECK: br i1 %z, label %loop, label %done, !prof ![[Z:[0-9]+]], !block_count ![[TWO:[0-9]+]]
+; CHECK: br i1 %more, label %loop, label %done, !prof ![[MORE:[0-9]+]], !block_count ![[TEN:[0-9]+]]
+; CHECK: ret i32 %s, !block_count ![[TWO]]
+define i32 @count(i32 %n) {
+entry:
+  %z = icmp sgt i32 %n, 0
+  br i1 %z, label %loop, label %done
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %loop ]
+  %s0 = phi i32 [ 0, %entry ], [ %s1, %loop ]
+  %s1 = add i32 %s0, %i
+  %i1 = add i32 %i, 1
+  %more = icmp slt i32 %i1, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  %s = phi i32 [ 0, %entry ], [ %s1, %loop ]
+  ret i32 %s
+}
+
+; CHECK-LABEL: define i32 @pick(i1 %c, i1 %d)
+; CHECK-SAME: !prof ![[PICKENTRY:[0-9]+]]
+; CHECK: br i1 %c, label %a, label %join, !prof ![[C:[0-9]+]], !block_count ![[FOUR:[0-9]+]]
+; CHECK: br i1 %d, label %join, label %b, !prof ![[D:[0-9]+]], !block_count ![[THREE:[0-9]+]]
+define i32 @pick(i1 %c, i1 %d) {
+entry:
+  br i1 %c, label %a, label %join
+
+a:
+  br i1 %d, label %join, label %b
+
+b:
+  br label %join
+
+join:
+  %r = phi i32 [ 1, %a ], [ 2, %b ], [ 3, %entry ]
+  ret i32 %r
+}
+
+define i32 @main() {
+entry:
+  %a = call i32 @count(i32 10)
+  %b = call i32 @count(i32 0)
+  %p1 = call i32 @pick(i1 true, i1 true)
+  %p2 = call i32 @pick(i1 true, i1 false)
+  %p3 = call i32 @pick(i1 false, i1 false)
+  %p4 = call i32 @pick(i1 true, i1 true)
+  ret i32 0
+}
+
+; CHECK-DAG: ![[COUNTENTRY]] = !{!"function_entry_count", i64 2}
+; CHECK-DAG: ![[Z]] = !{!"branch_weights", i32 1, i32 1}
+; CHECK-DAG: ![[MORE]] = !{!"branch_weights", i32 9, i32 1}
+; CHECK-DAG: ![[TWO]] = !{i64 2}
+; CHECK-DAG: ![[TEN]] = !{i64 10}
+; CHECK-DAG: ![[PICKENTRY]] = !{!"function_entry_count", i64 4}
+; CHECK-DAG: ![[C]] = !{!"branch_weights", i32 3, i32 1}
+; CHECK-DAG: ![[D]] = !{!"branch_weights", i32 2, i32 1}
+; CHECK-DAG: ![[FOUR]] = !{i64 4}
+; CHECK-DAG: ![[THREE]] = !{i64 3}
@@ -0,0 +1,67 @@
+; ModuleID = 'gcm0'
+; CHECK-LABEL: source_filename = "gcm0"
+source_filename = "gcm0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; Without a profile the loop depth decides. %k only needs %x, so it leaves
+; the loop for the latest block outside it; %t is only used on one side of
+; the branch and sinks there.
+; CHECK-LABEL: define i32 @f(i32* %p, i32 %x, i32 %n, i1 %c)
+; CHECK: entry:
+; CHECK-NEXT: br i1 %c, label %pre, label %other
+; CHECK: other:
+; CHECK-NEXT: %t = mul i32 %x, %n
+; CHECK-NEXT: ret i32 %t
+; CHECK: pre:
+; CHECK-NEXT: %k = mul i32 %x, 7
+; CHECK-NEXT: br label %loop
+; CHECK: loop:
+; CHECK-NEXT: %i = phi i32
+; CHECK-NEXT: %q = getelementptr i32, i32* %p, i32 %i
+; CHECK-NEXT: store i32 %k, i32* %q
+define i32 @f(i32* %p, i32 %x, i32 %n, i1 %c) {
+entry:
+  %t = mul i32 %x, %n
+  br i1 %c, label %pre, label %other
+
+other:
+  ret i32 %t
+
+pre:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %pre ], [ %i1, %loop ]
+  %k = mul i32 %x, 7
+  %q = getelementptr i32, i32* %p, i32 %i
+  store i32 %k, i32* %q
+  %i1 = add i32 %i, 1
+  %more = icmp slt i32 %i1, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  ret i32 0
+}
+
+; A division could trap, so it is pinned even though it is invariant.
+; CHECK-LABEL: define void @g(i32* %p, i32 %x, i32 %n)
+; CHECK: loop:
+; CHECK-NEXT: %i = phi i32
+; CHECK-NEXT: %d = sdiv i32 %n, %x
+define void @g(i32* %p, i32 %x, i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %loop ]
+  %d = sdiv i32 %n, %x
+  %q = getelementptr i32, i32* %p, i32 %i
+  store i32 %d, i32* %q
+  %i1 = add i32 %i, 1
+  %more = icmp slt i32 %i1, %n
+  br i1 %more, label %loop, label %done
+
+done:
+  ret void
+}
@@ -0,0 +1,44 @@
+; ModuleID = 'gcm1'
+; CHECK-LABEL: source_filename = "gcm1"
+source_filename = "gcm1"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; gcm1.prof comes from a -do-profile build of this file, where main only
+; ever calls fill with n = 0. By loop depth %k would stay in entry, but the
+; profile says the loop body never runs, so %k sinks into it.
+; CHECK-LABEL: define void @fill(i32* %p, i32 %x, i32 %n)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: br label %header
+; CHECK: body:
+; CHECK-NEXT: %q = getelementptr i32, i32* %p, i32 %i
+; CHECK-NEXT: %k = mul i32 %x, 7
+; CHECK-NEXT: store i32 %k, i32* %q
+define void @fill(i32* %p, i32 %x, i32 %n) {
+entry:
+  %k = mul i32 %x, 7
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %body ]
+  %more = icmp slt i32 %i, %n
+  br i1 %more, label %body, label %done
+
+body:
+  %q = getelementptr i32, i32* %p, i32 %i
+  store i32 %k, i32* %q
+  %i1 = add i32 %i, 1
+  br label %header
+
+done:
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %a = alloca i32
+  call void @fill(i32* %a, i32 1, i32 0)
+  call void @fill(i32* %a, i32 2, i32 0)
+  call void @fill(i32* %a, i32 3, i32 0)
+  ret i32 0
+}
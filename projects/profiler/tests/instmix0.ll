@@ -0,0 +1,58 @@
+; ModuleID = 'instmix0'
+; CHECK-LABEL: source_filename = "instmix0"
+source_filename = "instmix0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; One counter per block, and per block the number of loads, stores,
+; branches, calls, ALU, FP and other instructions. Lifetime markers emit
+; no code and are not counted.
+; CHECK: @prof.mix.counters = internal global [3 x i64] zeroinitializer
+; CHECK: @prof.mix.histogram = internal constant [3 x [7 x i32]]
+; CHECK-SAME: [7 x i32] [i32 0, i32 0, i32 1, i32 0, i32 0, i32 0, i32 1]
+; CHECK-SAME: [7 x i32] [i32 1, i32 1, i32 1, i32 0, i32 3, i32 2, i32 2]
+; CHECK-SAME: [7 x i32] [i32 0, i32 0, i32 1, i32 1, i32 0, i32 1, i32 0]
+; CHECK: @llvm.global_dtors = appending global {{.*}} @prof.mix.dump
+
+; The counter goes after the phis.
+; CHECK-LABEL: define double @sum(i32* %a, i64 %n)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: load i64, i64* getelementptr inbounds ([3 x i64], [3 x i64]* @prof.mix.counters, i64 0, i64 0)
+; CHECK: {{^}}loop:
+; CHECK-NEXT: %i = phi
+; CHECK-NEXT: %s = phi
+; CHECK-NEXT: load i64, i64* getelementptr inbounds ([3 x i64], [3 x i64]* @prof.mix.counters, i64 0, i64 1)
+; CHECK: {{^}}exit:
+; CHECK-NEXT: load i64, i64* getelementptr inbounds ([3 x i64], [3 x i64]* @prof.mix.counters, i64 0, i64 2)
+
+; CHECK-LABEL: define internal void @prof.mix.dump()
+; CHECK: call void @prof_mix_dump(i64* getelementptr inbounds ([3 x i64], [3 x i64]* @prof.mix.counters, i64 0, i64 0), i32* {{.*}}@prof.mix.histogram{{.*}}, i32 3)
+
+declare void @llvm.lifetime.start.p0i8(i64, i8*)
+declare void @llvm.lifetime.end.p0i8(i64, i8*)
+declare void @use(double)
+
+define double @sum(i32* %a, i64 %n) {
+entry:
+  %t = alloca i8
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %s = phi double [ 0.0, %entry ], [ %s1, %loop ]
+  %p = getelementptr i32, i32* %a, i64 %i
+  %v = load i32, i32* %p
+  store i32 0, i32* %p
+  %f = sitofp i32 %v to double
+  %s1 = fadd double %s, %f
+  %i1 = add i64 %i, 1
+  %c = icmp ult i64 %i1, %n
+  br i1 %c, label %loop, label %exit
+
+exit:
+  %h = fmul double %s1, 5.000000e-01
+  call void @llvm.lifetime.start.p0i8(i64 1, i8* %t)
+  call void @use(double %h)
+  call void @llvm.lifetime.end.p0i8(i64 1, i8* %t)
+  ret double %h
+}
@@ -0,0 +1,67 @@
+; ModuleID = 'layout0'
+; CHECK-LABEL: source_filename = "layout0"
+source_filename = "layout0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+declare void @exit(i32) noreturn
+
+; No profile, so the static heuristics decide: the noreturn path to %fail
+; is cold and goes last, and the loop is chained around its back edge so
+; that %header falls through into %body. main calls search and comes
+; first, with search right behind it.
+; CHECK-LABEL: define i32 @main()
+; CHECK-LABEL: define i32 @search(
+; CHECK: {{^}}entry:
+; CHECK: {{^}}next:
+; CHECK: {{^}}header:
+; CHECK: {{^}}body:
+; CHECK: {{^}}found:
+; CHECK: {{^}}notfound:
+; CHECK: {{^}}fail:
+; CHECK-LABEL: define i32 @helper(
+
+define i32 @search(i32* %a, i32 %n, i32 %key) {
+entry:
+  %bad = icmp slt i32 %n, 0
+  br i1 %bad, label %fail, label %header
+
+fail:
+  call void @exit(i32 1)
+  unreachable
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %next ]
+  %more = icmp slt i32 %i, %n
+  br i1 %more, label %body, label %notfound
+
+notfound:
+  ret i32 -1
+
+body:
+  %p = getelementptr i32, i32* %a, i32 %i
+  %v = load i32, i32* %p
+  %hit = icmp eq i32 %v, %key
+  br i1 %hit, label %found, label %next
+
+found:
+  ret i32 %i
+
+next:
+  %i1 = add i32 %i, 1
+  br label %header
+}
+
+define i32 @helper(i32 %x) {
+entry:
+  ret i32 %x
+}
+
+define i32 @main() {
+entry:
+  %a = alloca [4 x i32]
+  %p = getelementptr [4 x i32], [4 x i32]* %a, i32 0, i32 0
+  store i32 3, i32* %p
+  %r = call i32 @search(i32* %p, i32 1, i32 3)
+  ret i32 %r
+}
@@ -0,0 +1,81 @@
+; ModuleID = 'layout1'
+; CHECK-LABEL: source_filename = "layout1"
+source_filename = "layout1"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; layout1.prof comes from a -do-profile build of this file. step takes
+; %fast 990 times out of 1000, so %fast becomes the fall-through and %slow
+; moves behind %join. In main the loop body follows %header, and %bad,
+; which never ran, goes last. rare was never entered, so it moves to the
+; end of the module, behind main and the step it calls 1000 times.
+; CHECK-LABEL: define i32 @main()
+; CHECK: {{^}}entry:
+; CHECK: {{^}}header:
+; CHECK: {{^}}body:
+; CHECK: {{^}}latch:
+; CHECK: {{^}}done:
+; CHECK: {{^}}out:
+; CHECK: {{^}}bad:
+; CHECK-LABEL: define i32 @step(
+; CHECK: {{^}}entry:
+; CHECK: {{^}}fast:
+; CHECK: {{^}}join:
+; CHECK: {{^}}slow:
+; CHECK-LABEL: define i32 @rare(
+define i32 @rare(i32 %x) {
+entry:
+  %y = mul i32 %x, 3
+  ret i32 %y
+}
+
+define i32 @step(i32 %x) {
+entry:
+  %r = srem i32 %x, 100
+  %odd = icmp eq i32 %r, 0
+  br i1 %odd, label %slow, label %fast
+
+slow:
+  %s = sub i32 %x, 1
+  br label %join
+
+fast:
+  %f = add i32 %x, 1
+  br label %join
+
+join:
+  %v = phi i32 [ %s, %slow ], [ %f, %fast ]
+  ret i32 %v
+}
+
+define i32 @main() {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %latch ]
+  %acc = phi i32 [ 0, %entry ], [ %acc2, %latch ]
+  %more = icmp slt i32 %i, 1000
+  br i1 %more, label %body, label %done
+
+done:
+  %neg = icmp slt i32 %acc, 0
+  br i1 %neg, label %bad, label %out
+
+bad:
+  %b = call i32 @rare(i32 %acc)
+  br label %out
+
+out:
+  %res = phi i32 [ %b, %bad ], [ 0, %done ]
+  ret i32 %res
+
+body:
+  %acc1 = call i32 @step(i32 %i)
+  br label %latch
+
+latch:
+  %acc2 = add i32 %acc, %acc1
+  %i1 = add i32 %i, 1
+  br label %header
+}
@@ -0,0 +1,60 @@
+; ModuleID = 'memtrace0'
+; CHECK-LABEL: source_filename = "memtrace0"
+source_filename = "memtrace0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; CHECK: @llvm.global_dtors = appending global {{.*}} @prof.mem.dump
+
+; Loads and stores get numbered probes in program order; the alloca
+; accesses are left out without -memtrace-stack.
+; CHECK-LABEL: define void @copy(i32* %a, i64* %b, i64 %n)
+; CHECK: {{^}}loop:
+; CHECK-NOT: @prof_mem_access
+; CHECK: [[P:%.*]] = getelementptr i32, i32* %a, i64 %i
+; CHECK-NEXT: [[C:%.*]] = bitcast i32* [[P]] to i8*
+; CHECK-NEXT: call void @prof_mem_access(i32 1, i8* [[C]])
+; CHECK-NEXT: %v = load i32, i32* [[P]], align 4, !memtrace [[M1:![0-9]+]]
+; CHECK: call void @prof_mem_access(i32 2, i8* {{%.*}})
+; CHECK-NEXT: store i64 %w, i64* %q, align 8, !memtrace [[M2:![0-9]+]]
+; CHECK-NOT: @prof_mem_access
+; CHECK: ret void
+define void @copy(i32* %a, i64* %b, i64 %n) {
+entry:
+  %t = alloca i64
+  store i64 0, i64* %t
+  br label %loop
+loop:
+  %i = phi i64 [0, %entry], [%i1, %loop]
+  %p = getelementptr i32, i32* %a, i64 %i
+  %v = load i32, i32* %p, align 4
+  %w = sext i32 %v to i64
+  %q = getelementptr i64, i64* %b, i64 %i
+  store i64 %w, i64* %q, align 8
+  %s = load i64, i64* %t
+  %s1 = add i64 %s, %w
+  store i64 %s1, i64* %t
+  %i1 = add i64 %i, 1
+  %c = icmp ult i64 %i1, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; Atomics count as writes.
+; CHECK-LABEL: define i32 @bump(i32* %p)
+; CHECK: call void @prof_mem_access(i32 3, i8* {{%.*}})
+; CHECK-NEXT: atomicrmw add i32* %p, i32 1 seq_cst, align 4, !memtrace [[M3:![0-9]+]]
+define i32 @bump(i32* %p) {
+entry:
+  %old = atomicrmw add i32* %p, i32 1 seq_cst
+  ret i32 %old
+}
+
+; CHECK-LABEL: define internal void @prof.mem.dump()
+; CHECK-NEXT: entry:
+; CHECK-NEXT: call void @prof_mem_dump()
+
+; CHECK: [[M1]] = !{i32 1}
+; CHECK: [[M2]] = !{i32 2}
+; CHECK: [[M3]] = !{i32 3}
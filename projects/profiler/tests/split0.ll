@@ -0,0 +1,73 @@
+; ModuleID = 'split0'
+; CHECK-LABEL: source_filename = "split0"
+source_filename = "split0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+%struct._IO_FILE = type opaque
+
+@stderr = external global %struct._IO_FILE*
+@.bad = private constant [11 x i8] c"bad %d %d\0A\00"
+@.usage = private constant [15 x i8] c"usage: %s n m\0A\00"
+
+declare i32 @fprintf(%struct._IO_FILE*, i8*, ...)
+declare void @exit(i32) noreturn
+
+; No profile: %err writes to stderr and %usage exits, so both are cold.
+; %err uses %x and %lo and defines %fix for the phi in %join, which comes
+; back through a stack slot.
+; CHECK-LABEL: define i32 @clamp(i32 %x, i32 %lo)
+; CHECK: %fix.loc = alloca i32
+; CHECK: call void @clamp.cold(i32 %lo, i32 %x, i32* %fix.loc)
+; CHECK-NEXT: %fix.reload = load i32, i32* %fix.loc
+; CHECK: %r = phi i32 [ %fix.reload, %codeRepl ], [ %y, %ok ]
+; CHECK-LABEL: define i32 @main(
+; CHECK: call void @main.cold(i8** %argv)
+; CHECK-LABEL: define internal void @clamp.cold(i32 %lo, i32 %x, i32* %fix.out)
+; CHECK-SAME: #[[COLD:[0-9]+]]
+; CHECK: call i32 {{.*}} @fprintf(
+; CHECK: store i32 %fix, i32* %fix.out
+; CHECK-LABEL: define internal void @main.cold(i8** %argv)
+; CHECK: call void @exit(i32 1)
+; CHECK: attributes #[[COLD]] = { cold noinline }
+define i32 @clamp(i32 %x, i32 %lo) {
+entry:
+  %neg = icmp slt i32 %x, %lo
+  br i1 %neg, label %err, label %ok
+
+err:
+  %e = load %struct._IO_FILE*, %struct._IO_FILE** @stderr
+  %m = sub i32 %lo, %x
+  %f = getelementptr [11 x i8], [11 x i8]* @.bad, i32 0, i32 0
+  %c = call i32 (%struct._IO_FILE*, i8*, ...) @fprintf(%struct._IO_FILE* %e, i8* %f, i32 %x, i32 %m)
+  %fix = add i32 %m, %lo
+  br label %join
+
+ok:
+  %y = add i32 %x, 2
+  br label %join
+
+join:
+  %r = phi i32 [ %fix, %err ], [ %y, %ok ]
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %few = icmp slt i32 %argc, 1
+  br i1 %few, label %usage, label %run
+
+usage:
+  %e = load %struct._IO_FILE*, %struct._IO_FILE** @stderr
+  %name = load i8*, i8** %argv
+  %f = getelementptr [15 x i8], [15 x i8]* @.usage, i32 0, i32 0
+  %c = call i32 (%struct._IO_FILE*, i8*, ...) @fprintf(%struct._IO_FILE* %e, i8* %f, i8* %name)
+  call void @exit(i32 1)
+  unreachable
+
+run:
+  %a = call i32 @clamp(i32 5, i32 0)
+  %b = call i32 @clamp(i32 -3, i32 0)
+  %s = add i32 %a, %b
+  ret i32 %s
+}
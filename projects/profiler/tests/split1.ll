@@ -0,0 +1,68 @@
+; ModuleID = 'split1'
+; CHECK-LABEL: source_filename = "split1"
+source_filename = "split1"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; split1.prof comes from a -do-profile build of this file, where main
+; only calls scale with x < 100, so %wide and %wideodd never ran. They are
+; outlined together, and the value they feed into %join comes back through
+; a stack slot.
+; CHECK-LABEL: define i32 @scale(i32 %x)
+; CHECK: call void @scale.cold(i32 %x, i32* %r.ce.loc)
+; CHECK-NEXT: %r.ce.reload = load i32, i32* %r.ce.loc
+; CHECK: %r = phi i32 [ %n, %narrow ], [ %r.ce.reload, %codeRepl ]
+; CHECK-LABEL: define internal void @scale.cold(i32 %x, i32* %r.ce.out)
+; CHECK-SAME: !prof ![[ZERO:[0-9]+]]
+; CHECK: {{^}}wide:
+; CHECK: {{^}}wideodd:
+; CHECK: %r.ce = phi i32 [ %d, %wide ], [ %e, %wideodd ]
+; CHECK-NEXT: store i32 %r.ce, i32* %r.ce.out
+; CHECK: ![[ZERO]] = !{!"function_entry_count", i64 0}
+define i32 @scale(i32 %x) {
+entry:
+  %big = icmp sgt i32 %x, 1000
+  br i1 %big, label %wide, label %narrow
+
+wide:
+  %a = mul i32 %x, 3
+  %b = sdiv i32 %a, 7
+  %c = xor i32 %b, %x
+  %d = add i32 %c, 11
+  %odd = and i32 %d, 1
+  %isodd = icmp ne i32 %odd, 0
+  br i1 %isodd, label %wideodd, label %join
+
+wideodd:
+  %e = sub i32 %d, 1
+  br label %join
+
+narrow:
+  %n = shl i32 %x, 1
+  br label %join
+
+join:
+  %r = phi i32 [ %d, %wide ], [ %e, %wideodd ], [ %n, %narrow ]
+  ret i32 %r
+}
+
+define i32 @main() {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %i1, %body ]
+  %acc = phi i32 [ 0, %entry ], [ %acc1, %body ]
+  %more = icmp slt i32 %i, 100
+  br i1 %more, label %body, label %done
+
+body:
+  %v = call i32 @scale(i32 %i)
+  %acc1 = add i32 %acc, %v
+  %i1 = add i32 %i, 1
+  br label %header
+
+done:
+  %res = and i32 %acc, 255
+  ret i32 %res
+}
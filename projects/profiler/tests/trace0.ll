@@ -0,0 +1,62 @@
+; ModuleID = 'trace0'
+; CHECK-LABEL: source_filename = "trace0"
+source_filename = "trace0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+
+; Probes take the function name; the runtime dumps from a destructor.
+; CHECK: @prof.trace.name = private unnamed_addr constant [4 x i8] c"big\00"
+; CHECK-NOT: c"small\00"
+; CHECK: @llvm.global_dtors = appending global {{.*}} @prof.trace.dump
+
+; Under -trace-min-size (20) instructions: no probes.
+; CHECK-LABEL: define i32 @small(i32 %x)
+; CHECK-NOT: call void @prof_trace
+; CHECK: ret i32
+define i32 @small(i32 %x) {
+entry:
+  %y = add i32 %x, 1
+  ret i32 %y
+}
+
+; One probe on entry, one before each return.
+; CHECK-LABEL: define i32 @big(i32 %x)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: call void @prof_trace_enter(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @prof.trace.name, i32 0, i32 0))
+; CHECK: {{^}}neg:
+; CHECK: call void @prof_trace_exit(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @prof.trace.name, i32 0, i32 0))
+; CHECK-NEXT: ret i32 %n
+; CHECK: {{^}}pos:
+; CHECK: call void @prof_trace_exit(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @prof.trace.name, i32 0, i32 0))
+; CHECK-NEXT: ret i32 %p9
+define i32 @big(i32 %x) {
+entry:
+  %c = icmp slt i32 %x, 0
+  br i1 %c, label %neg, label %pos
+
+neg:
+  %n0 = sub i32 0, %x
+  %n1 = mul i32 %n0, 3
+  %n2 = add i32 %n1, 7
+  %n3 = xor i32 %n2, %x
+  %n4 = call i32 @small(i32 %n3)
+  %n = and i32 %n4, 255
+  ret i32 %n
+
+pos:
+  %p0 = mul i32 %x, %x
+  %p1 = add i32 %p0, 1
+  %p2 = shl i32 %p1, 2
+  %p3 = sub i32 %p2, %x
+  %p4 = or i32 %p3, 16
+  %p5 = lshr i32 %p4, 1
+  %p6 = call i32 @small(i32 %p5)
+  %p7 = mul i32 %p6, 5
+  %p8 = add i32 %p7, %p0
+  %p9 = xor i32 %p8, %p1
+  ret i32 %p9
+}
+
+; CHECK-LABEL: define internal void @prof.trace.dump()
+; CHECK-NEXT: entry:
+; CHECK-NEXT: call void @prof_trace_dump()
@@ -0,0 +1,91 @@
+/*
+ * File: trace.cpp
+ *
+ * Description:
+ *   Function-level tracing. Each traced function calls
+ *   prof_trace_enter(name) first and prof_trace_exit(name) before every
+ *   ret and resume; the name is a private string, so the runtime needs no
+ *   table and modules can be traced separately. The module also calls
+ *   prof_trace_dump from a global destructor, where runtime/trace_rt.c
+ *   writes the Chrome trace and the flat profile.
+ *
+ *   Small functions are left out, since a probe pair costs about as much
+ *   as a short function and would swamp its time: only functions of at
+ *   least -trace-min-size instructions are traced, or all of them with
+ *   -trace-all. Functions with musttail calls are skipped, since nothing
+ *   may come between such a call and its ret.
+ */
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "trace.h"
+
+using namespace llvm;
+
+static cl::opt<bool>
+        TraceAll("trace-all",
+                 cl::desc("Trace every function, whatever its size."),
+                 cl::init(false));
+
+static cl::opt<unsigned>
+        TraceMinSize("trace-min-size",
+                     cl::desc("Smallest function (in instructions) -trace instruments."),
+                     cl::init(20));
+
+static llvm::Statistic TraceFunctions = {"", "TraceFunctions", "Trace functions given entry and exit probes"};
+static llvm::Statistic TraceSmall = {"", "TraceSmall", "Trace functions under the size threshold"};
+static llvm::Statistic TraceProbes = {"", "TraceProbes", "Trace probes inserted"};
+
+static bool canTrace(Function &F)
+{
+    if (F.isDeclaration() || F.getName().startswith("prof."))
+        return false;
+    for (BasicBlock &BB : F)
+        if (BB.getTerminatingMustTailCall())
+            return false;
+    return true;
+}
+
+void InsertTracing(Module *M)
+{
+    LLVMContext &C = M->getContext();
+    Type *Void = Type::getVoidTy(C);
+    Type *I8Ptr = Type::getInt8PtrTy(C);
+    FunctionCallee Enter = M->getOrInsertFunction("prof_trace_enter", Void, I8Ptr);
+    FunctionCallee Exit = M->getOrInsertFunction("prof_trace_exit", Void, I8Ptr);
+
+    for (auto f = M->begin(); f != M->end(); f++) {
+        if (!canTrace(*f))
+            continue;
+        if (!TraceAll && f->getInstructionCount() < TraceMinSize) {
+            TraceSmall++;
+            continue;
+        }
+
+        IRBuilder<> B(&*f->getEntryBlock().getFirstInsertionPt());
+        Constant *Name = B.CreateGlobalStringPtr(f->getName(), "prof.trace.name");
+        B.CreateCall(Enter, {Name});
+        TraceProbes++;
+        for (BasicBlock &BB : *f) {
+            Instruction *TI = BB.getTerminator();
+            if (!isa<ReturnInst>(TI) && !isa<ResumeInst>(TI))
+                continue;
+            B.SetInsertPoint(TI);
+            B.CreateCall(Exit, {Name});
+            TraceProbes++;
+        }
+        TraceFunctions++;
+    }
+
+    Function *Dump = Function::Create(FunctionType::get(Void, false),
+                                      GlobalValue::InternalLinkage, "prof.trace.dump", M);
+    IRBuilder<> B(BasicBlock::Create(C, "entry", Dump));
+    B.CreateCall(M->getOrInsertFunction("prof_trace_dump", Void));
+    B.CreateRetVoid();
+    appendToGlobalDtors(*M, Dump, 0);
+}
@@ -0,0 +1,11 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "llvm/IR/Module.h"
+
+/* Call the runtime/trace_rt.c probes on entry to and exit from each
+   function over the size threshold; the runtime writes a Chrome trace
+   and a flat profile at exit. */
+void InsertTracing(llvm::Module *M);
+
+#endif
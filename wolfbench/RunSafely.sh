@@ -19,6 +19,12 @@
 #           normally or that the program was terminated as a signal are
 #           considered to indicate a test failure.
 #
+#           If the runbench tool is installed ($RUNBENCH, set by
+#           Makefile.defs), it runs and times the program instead of
+#           time -p and TimedExec.sh, and the <outfile>.time file also
+#           has the wall-clock time, system time, max RSS, page faults
+#           and context switches.
+#
 #           If optional parameters -r <remote host> -l <remote user> are
 #           specified, it execute the program remotely using rsh.
 #
@@ -97,10 +103,12 @@ if [ `basename ${PROGRAM}` = "lli" ]; then
 fi
 
 ULIMITCMD=""
+RUNBENCHFLAGS=""
 case $SYSTEM in
   CYGWIN*) 
     ;;
   Darwin*)
+    RUNBENCHFLAGS="-v 0"
     # Disable core file emission, the script doesn't find it anyway because it
     # is put into /cores.
     ULIMITCMD="$ULIMITCMD ulimit -c 0;"
@@ -137,7 +145,13 @@ COMMAND="$RUN_UNDER $PROGRAM $*"
 COMMAND="${DIR}TimedExec.sh $ULIMIT $PWD $COMMAND"
 COMMAND=$(echo "$COMMAND" | sed -e 's#"#\\"#g')
 
-if [ "x$RHOST" = x ] ; then
+if [ "x$RHOST" = x -a -x "$RUNBENCH" ] ; then
+  # runbench sets the same limits, times the run with the monotonic clock
+  # and rusage, and writes $OUTFILE.time itself (see runbench.cpp)
+  # RUNBENCH_REPEAT holds RunSafelyAndStable.sh's -w/-r/-ci flags;
+  # $RUN_UNDER is split into words like in $COMMAND above
+  $RUNBENCH $RUNBENCHFLAGS $RUNBENCH_REPEAT $ULIMIT $INFILE $OUTFILE $RUN_UNDER $PROGRAM "$@"
+elif [ "x$RHOST" = x ] ; then
   # echo "$ULIMITCMD $TIMEIT -p sh -c '$COMMAND >$OUTFILE 2>&1 < $INFILE; echo exit \$?'"
   ( sh -c "$ULIMITCMD $TIMEIT -p sh -c '$COMMAND >$OUTFILE 2>&1 < $INFILE; echo exit \$?'" ) 2>&1 \
     | awk -- '\
@@ -2,11 +2,23 @@
 #
 # Program:  RunSafelyAndStable.sh
 #
-# Synopsis: This script runs another program three times by repeatedly 
-#           invoking the RunSafely.sh script. It collects the timings of
-#           the program and reports the smallest one. The <outfile>.time
-#           file will reflect the time and result code of the fastest
-#           run.
+# Synopsis: This script runs another program several times through the
+#           RunSafely.sh script to get a stable timing: $STABLE_WARMUP
+#           warmup runs (default 1) that are thrown away, then
+#           $STABLE_RUNS measured runs (default 5). The <outfile>.time
+#           file has the last run, the statistics of the user times of
+#           the measured runs
+#             runs median mad min ci95_lo ci95_hi
+#           (mad is the median absolute deviation, ci95 the 95%
+#           confidence interval of the median) and the median as the
+#           program time. A failing run stops the repetition and its
+#           .time file is kept as is.
+#
+#           With the runbench tool installed ($RUNBENCH), the runs happen
+#           in one runbench call, and setting $STABLE_CI to a percent
+#           makes it run until the confidence interval is within that
+#           percent of the median, up to $STABLE_MAXRUNS runs (default
+#           30). Without it $STABLE_CI is ignored.
 #
 # Syntax: 
 #   ./RunSafelyAndStable.sh <ulimit> <exitok> <infile> <outfile> \
@@ -22,38 +34,71 @@ OUTFILE=$4
 PROGRAM=$5
 shift 5
 
-# Run it the first time
-exec ${DIR}/RunSafely.sh $ULIMIT $EXITOK $INFILE $OUTFILE $PROGRAM $*
-exitval=$?
-mv $OUTFILE.time $OUTFILE.time1
-TIME1=`grep program $OUTFILE.time1 | sed 's/^program//'`
+WARMUP=${STABLE_WARMUP:-1}
+RUNS=${STABLE_RUNS:-5}
 
-if [ "x$VERBOSE" != x ] ; then
-    echo "Program $PROGRAM run #1 time: $TIME1"
+if [ -x "$RUNBENCH" ] ; then
+  if [ "x$STABLE_CI" != x ] ; then
+    RUNBENCH_REPEAT="-w $WARMUP -r ${STABLE_MAXRUNS:-30} -ci $STABLE_CI"
+  else
+    RUNBENCH_REPEAT="-w $WARMUP -r $RUNS"
+  fi
+  export RUNBENCH_REPEAT
+  ${DIR}/RunSafely.sh $ULIMIT $EXITOK $INFILE $OUTFILE $PROGRAM "$@"
+  if [ "x$VERBOSE" != x ] ; then
+    grep -E '^(runs|median|mad|min|ci95_lo|ci95_hi) ' $OUTFILE.time
+  fi
+  exit 0
 fi
 
-# Run it the second time
-exec ${DIR}/RunSafely.sh $ULIMIT $EXITOK $INFILE $OUTFILE $PROGRAM $*
-mv $OUTFILE.time $OUTFILE.time2
-TIME2=`grep program $OUTFILE.time2 | sed 's/^program//'`
-if [ "x$VERBOSE" != x ] ; then
-    echo "Program $PROGRAM run #2 time: $TIME2"
-fi
-# Run it the third time
-exec ${DIR}/RunSafely.sh $ULIMIT $EXITOK $INFILE $OUTFILE $PROGRAM $*
-mv $OUTFILE.time $OUTFILE.time3
-TIME3=`grep program $OUTFILE.time3 | sed 's/^program//'`
-if [ "x$VERBOSE" != x ] ; then
-    echo "Program $PROGRAM run #3 time: $TIME3"
-fi
+# Without runbench: one RunSafely.sh call per run
+i=1
+while [ $i -le `expr $WARMUP + $RUNS` ] ; do
+  ${DIR}/RunSafely.sh $ULIMIT $EXITOK $INFILE $OUTFILE $PROGRAM "$@"
+  mv $OUTFILE.time $OUTFILE.time$i
+  LAST=$i
+  if [ "x$VERBOSE" != x ] ; then
+    echo "Program $PROGRAM run #$i time: `grep '^program' $OUTFILE.time$i | sed 's/^program //'`"
+  fi
+  if [ "`grep '^exit ' $OUTFILE.time$i`" != "exit 0" ] ; then
+    break
+  fi
+  i=`expr $i + 1`
+done
 
-# Figure out which run had the smallest run time:
-SHORTEST=`echo -e "$TIME1 time1\n$TIME2 time2\n$TIME3 time3" | sort | 
-                head -1 | sed "s|.*time||"`
-
-if [ "x$VERBOSE" != x ] ; then
-    echo "Program $PROGRAM run #$SHORTEST was fastest"
+if [ "`grep '^exit ' $OUTFILE.time$LAST`" != "exit 0" ] ; then
+  cp $OUTFILE.time$LAST $OUTFILE.time
+else
+  grep -v '^program' $OUTFILE.time$LAST > $OUTFILE.time
+  # same statistics as runbench: the median's distribution-free 95% CI is
+  # the order statistics x(j), x(n+1-j) for the largest j with
+  # P(Binomial(n, 1/2) < j) <= 2.5%, or min..max when no j qualifies
+  i=`expr $WARMUP + 1`
+  while [ $i -le $LAST ] ; do
+    grep '^program' $OUTFILE.time$i | sed 's/^program //'
+    i=`expr $i + 1`
+  done | sort -n | awk -- '
+{ x[NR] = $1 }
+END {
+  n = NR
+  med = n % 2 ? x[(n + 1) / 2] : (x[n / 2] + x[n / 2 + 1]) / 2
+  for (i = 1; i <= n; i++) {
+    d[i] = x[i] > med ? x[i] - med : med - x[i]
+    for (k = i; k > 1 && d[k - 1] > d[k]; k--) { t = d[k]; d[k] = d[k - 1]; d[k - 1] = t }
+  }
+  mad = n % 2 ? d[(n + 1) / 2] : (d[n / 2] + d[n / 2 + 1]) / 2
+  j = 0; term = 0.5 ^ n; cdf = term
+  while (j + 1 < int(n / 2) + 1 && cdf <= 0.025) { j++; term = term * (n - j + 1) / j; cdf += term }
+  printf("runs %d\nmedian %f\nmad %f\nmin %f\n", n, med, mad, x[1])
+  printf("ci95_lo %f\nci95_hi %f\nprogram %f\n", j ? x[j] : x[1], j ? x[n + 1 - j] : x[n], med)
+}' >> $OUTFILE.time
 fi
-cp $OUTFILE.time$SHORTEST $OUTFILE.time
 
-exit $exitval
+if [ "x$VERBOSE" = x ] ; then
+  i=1
+  while [ $i -le $LAST ] ; do
+    rm -f $OUTFILE.time$i
+    i=`expr $i + 1`
+  done
+fi
+exit 0
@@ -5,6 +5,20 @@ import re
 import os
 
 Stats = {}
+# 95% confidence interval of the program time, from RunSafelyAndStable.sh
+Errors = {}
+# all the values of each .time file, for the hardware counters of runbench
+Values = {}
+
+# extra columns after each configuration when its counters are there:
+# name, numerator, denominator, scale
+Metrics = [
+    ("ipc", "instructions", "cycles", 1),
+    ("br-miss%", "branch-misses", "branches", 100),
+    ("l1d/ki", "l1d-misses", "instructions", 1000),
+    ("llc/ki", "llc-misses", "instructions", 1000),
+    ("dtlb/ki", "dtlb-misses", "instructions", 1000),
+]
 
 p_name = re.compile('.*/(\w+)(\.[\-\w]+)?\.out\.time',re.IGNORECASE)
 
@@ -53,22 +67,73 @@ for fName in timings:
 
     if not Stats[opt].has_key(name):
         Stats[opt][name] = 0
+        Errors.setdefault(opt, {})
+        Values.setdefault(opt, {})
 
+    values = {}
     for line in iter(f.readline, ''):
         s = line.split(' ')
         if len(s) != 2:
             continue
+        try:
+            values[s[0]] = float(s[1])
+        except ValueError:
+            pass
 
-        if s[0] == "program":
-            Stats[opt][name] = float(s[1])
-            break
+    Values[opt][name] = values
+    if values.has_key("program"):
+        Stats[opt][name] = values["program"]
+    if values.has_key("ci95_lo") and values.has_key("ci95_hi"):
+        Errors[opt][name] = (values["ci95_lo"], values["ci95_hi"])
 
 
-s = "Category".ljust(20,)
 keys = Stats.keys()
 keys.sort(cmp)
+
+# with confidence intervals, cells are value+-error, where error is the
+# larger side of the interval, and ~ marks a configuration whose interval
+# overlaps the baseline's (the -N one, or else the first column)
+HaveErrors = False
 for k in keys:
-    s += k.rjust(10)
+    if Errors[k]:
+        HaveErrors = True
+width = 10
+if HaveErrors:
+    width = 18
+Base_key = keys[0]
+if Normalize and Stats.has_key(Normalize_key):
+    Base_key = Normalize_key
+
+def overlaps(k, i):
+    if k == Base_key or not Errors[k].has_key(i) or not Errors[Base_key].has_key(i):
+        return False
+    lo, hi = Errors[k][i]
+    base_lo, base_hi = Errors[Base_key][i]
+    return lo <= base_hi and base_lo <= hi
+
+def metric(k, i, m):
+    name, num, den, scale = m
+    v = Values[k].get(i, {})
+    if not v.has_key(num) or not v.get(den):
+        return None
+    return scale * v[num] / v[den]
+
+Shown = []
+for m in Metrics:
+    for k in keys:
+        if [i for i in Values[k] if metric(k, i, m) != None]:
+            Shown.append(m)
+            break
+
+def error(k, i):
+    lo, hi = Errors[k][i]
+    return max(hi - Stats[k][i], Stats[k][i] - lo)
+
+s = "Category".ljust(20,)
+for k in keys:
+    s += k.rjust(width)
+    for m in Shown:
+        s += (k + ":" + m[0]).rjust(13)
 
 print s
 
@@ -80,12 +145,32 @@ for i in benchs:
     for k in keys:
         if Stats[k].has_key(i):
             if Normalize==True and Stats.has_key(Normalize_key) :
-                if Stats['.None'][i] > 0:
-                    s += str(Stats[k][i]/Stats[Normalize_key][i])[0:3].rjust(10,'.')
+                if Stats[Normalize_key][i] > 0:
+                    c = str(Stats[k][i]/Stats[Normalize_key][i])[0:3]
+                    if Errors[k].has_key(i):
+                        c += "+-%.2f" % (error(k, i)/Stats[Normalize_key][i])
                 else:
-                    s += str('x').rjust(10,'.');
+                    c = 'x'
             else:
-                s += str(Stats[k][i]).rjust(10,'.')
+                c = str(Stats[k][i])
+                if Errors[k].has_key(i):
+                    c += "+-%.3f" % error(k, i)
+            if overlaps(k, i):
+                c += "~"
+            s += c.rjust(width,'.')
         else:
-            s += '(missing)'.rjust(10,'.')
+            s += '(missing)'.rjust(width,'.')
+        for m in Shown:
+            v = None
+            if Stats[k].has_key(i):
+                v = metric(k, i, m)
+            if v == None:
+                s += '-'.rjust(13,'.')
+            else:
+                s += ("%.2f" % v).rjust(13,'.')
     print s
+
+if HaveErrors:
+    print
+    print "value+-e: median, e the larger side of its 95% confidence interval"
+    print "~: interval overlaps the one of %s, the difference is not significant" % Base_key